@@ -362,17 +362,17 @@ struct PossibleSpellcast
 
 struct CurrentOffensivePotential
 {
-	std::map<const CStack *, PotentialTargets> ourAttacks;
-	std::map<const CStack *, PotentialTargets> enemyAttacks;
+	std::map<ui32, PotentialTargets> ourAttacks; //by stack ID
+	std::map<ui32, PotentialTargets> enemyAttacks;
 
 	CurrentOffensivePotential(ui8 side)
 	{
 		for(auto stack : cbc->battleGetStacks())
 		{
 			if(stack->attackerOwned == !side)
-				ourAttacks[stack] = PotentialTargets(stack);
+				ourAttacks[stack->ID] = PotentialTargets(stack);
 			else
-				enemyAttacks[stack] = PotentialTargets(stack);
+				enemyAttacks[stack->ID] = PotentialTargets(stack);
 		}
 	}
 
@@ -440,11 +440,11 @@ void CBattleAI::attemptCastingSpell()
 	if(possibleCasts.empty())
 		return;
 
-	std::map<const CStack*, int> valueOfStack;
+	std::map<ui32, int> valueOfStack; //by stack ID
 	for(auto stack : cb->battleGetStacks())
 	{
 		PotentialTargets pt(stack);
-		valueOfStack[stack] = pt.bestActionValue();
+		valueOfStack[stack->ID] = pt.bestActionValue();
 	}
 
 	auto evaluateSpellcast = [&] (const PossibleSpellcast &ps) -> int
@@ -494,11 +494,11 @@ void CBattleAI::attemptCastingSpell()
 				CStack::stackEffectToFeature(swb.bonusesToAdd, pseudoBonus);
 
 				HypotheticChangesToBattleState state;
-				state.bonusesOfStacks[swb.stack] = &swb;
+				state.bonusesOfStacks[swb.stack->ID] = &swb;
 
 				PotentialTargets pt(swb.stack, state);
 				auto newValue = pt.bestActionValue();
-				auto oldValue = valueOfStack[swb.stack];
+				auto oldValue = valueOfStack[swb.stack->ID];
 				auto gain = newValue - oldValue;
 				if(swb.stack->owner != playerID) //enemy
 					gain = -gain;
@@ -643,7 +643,7 @@ AttackPossibility AttackPossibility::evaluate(const BattleAttackInfo &AttackInfo
 	auto attacker = AttackInfo.attacker;
 	auto enemy = AttackInfo.defender;
 
-	const int remainingCounterAttacks = getValOr(state.counterAttacksLeft, enemy, enemy->counterAttacksRemaining());
+	const int remainingCounterAttacks = getValOr(state.counterAttacksLeft, enemy->ID, enemy->counterAttacksRemaining());
 	const bool counterAttacksBlocked = attacker->hasBonusOfType(Bonus::BLOCKS_RETALIATION) || enemy->hasBonusOfType(Bonus::NO_RETALIATION);
 	const int totalAttacks = 1 + AttackInfo.attackerBonuses->getBonuses(Selector::type(Bonus::ADDITIONAL_ATTACK), (Selector::effectRange (Bonus::NO_LIMIT).Or(Selector::effectRange(Bonus::ONLY_MELEE_FIGHT))))->totalValue();
 
@@ -691,8 +691,8 @@ PotentialTargets::PotentialTargets(const CStack *attacker, const HypotheticChang
 		auto GenerateAttackInfo = [&](bool shooting, BattleHex hex) -> AttackPossibility
 		{
 			auto bai = BattleAttackInfo(attacker, enemy, shooting);
-			bai.attackerBonuses = getValOr(state.bonusesOfStacks, bai.attacker, bai.attacker);
-			bai.defenderBonuses = getValOr(state.bonusesOfStacks, bai.defender, bai.defender);
+			bai.attackerBonuses = getValOr(state.bonusesOfStacks, bai.attacker->ID, bai.attacker);
+			bai.defenderBonuses = getValOr(state.bonusesOfStacks, bai.defender->ID, bai.defender);
 
 			if(hex.isValid())
 			{
@@ -62,8 +62,8 @@ struct ThreatMap
 
 struct HypotheticChangesToBattleState
 {
-	std::map<const CStack *, const IBonusBearer *> bonusesOfStacks;
-	std::map<const CStack *, int> counterAttacksLeft;
+	std::map<ui32, const IBonusBearer *> bonusesOfStacks; //by stack ID
+	std::map<ui32, int> counterAttacksLeft; //by stack ID
 };
 
 struct AttackPossibility
@@ -5,6 +5,9 @@
 
 #include "../../lib/UnlockGuard.h"
 #include "../../lib/CConfigHandler.h"
+#include "../../lib/VCMIDirs.h"
+#include "../../lib/StringConstants.h"
+#include "../../lib/CFogOfWarMap.h"
 #include "../../lib/CHeroHandler.h"
 #include "../../lib/mapObjects/CBank.h"
 #include "../../lib/mapObjects/CGTownInstance.h"
@@ -12,6 +15,10 @@
 #include "../../lib/CPathfinder.h"
 #include "../../lib/mapping/CMapDefines.h"
 
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
 /*
  * AIUtility.cpp, part of VCMI engine
  *
@@ -181,8 +188,9 @@ std::string strFromInt3(int3 pos)
 
 bool CDistanceSorter::operator ()(const CGObjectInstance *lhs, const CGObjectInstance *rhs)
 {
-	const CGPathNode *ln = ai->myCb->getPathsInfo(hero)->getPathInfo(lhs->visitablePos()),
-	                 *rn = ai->myCb->getPathsInfo(hero)->getPathInfo(rhs->visitablePos());
+	auto paths = ai->getPathsInfo(hero);
+	const CGPathNode *ln = paths->getPathInfo(lhs->visitablePos()),
+	                 *rn = paths->getPathInfo(rhs->visitablePos());
 
 	if(ln->turns != rn->turns)
 		return ln->turns < rn->turns;
@@ -376,7 +384,7 @@ int3 whereToExplore(HeroPtr h)
 			{
 				int3 op = obj->visitablePos();
 				CGPath p;
-				ai->myCb->getPathsInfo(h.get())->getPath(p, op);
+				ai->getPathsInfo(h.get())->getPath(p, op);
 				if (p.nodes.size() && p.endPos() == op && p.nodes.size() <= DIST_LIMIT)
 					if (ai->isGoodForVisit(obj, h, *sm))
 						nearbyVisitableObjs.push_back(obj);
@@ -407,23 +415,27 @@ bool isBlockedBorderGate(int3 tileToHit)
 
 int howManyTilesWillBeDiscovered(const int3 &pos, int radious, CCallback * cbp)
 { //TODO: do not explore dead-end boundaries
+	std::vector<TileSpan> hidden; //only hidden tiles in range are visited
+	cbp->getVisibilityMap().getCircleSpans(hidden, pos, radious, false);
+
 	int ret = 0;
-	for(int x = pos.x - radious; x <= pos.x + radious; x++)
+	for(const TileSpan & span : hidden)
 	{
-		for(int y = pos.y - radious; y <= pos.y + radious; y++)
+		for(int x = span.start.x; x < span.start.x + span.length; x++)
 		{
-			int3 npos = int3(x,y,pos.z);
-			if(cbp->isInTheMap(npos) && pos.dist2d(npos) - 0.5 < radious  && !cbp->isVisible(npos))
-			{
-				if (!boundaryBetweenTwoPoints (pos, npos, cbp))
-					ret++;
-			}
+			if (!boundaryBetweenTwoPoints (pos, int3(x, span.start.y, span.start.z), cbp))
+				ret++;
 		}
 	}
 
 	return ret;
 }
 
+int howManyTilesCanBeDiscovered(const int3 &pos, int radious, CCallback * cbp)
+{
+	return cbp->getVisibilityMap().countCircle(pos, radious, false);
+}
+
 bool boundaryBetweenTwoPoints (int3 pos1, int3 pos2, CCallback * cbp) //determines if two points are separated by known barrier
 {
 	int xMin = std::min (pos1.x, pos2.x);
@@ -451,6 +463,22 @@ int howManyTilesWillBeDiscovered(int radious, int3 pos, crint3 dir)
 	return howManyTilesWillBeDiscovered(pos + dir, radious, cb.get());
 }
 
+void getHiddenTiles(std::vector<int3> &out, CCallback * cbp)
+{
+	std::vector<TileSpan> hidden;
+	cbp->getVisibilityMap().getCircleSpans(hidden, int3(), -1, false);
+	const size_t first = out.size();
+	for(const TileSpan & span : hidden)
+		for(int x = span.start.x; x < span.start.x + span.length; x++)
+			out.push_back(int3(x, span.start.y, span.start.z));
+
+	//spans go by rows, but exploration breaks ties by order of foreach_tile_pos: x, then y, then z
+	std::sort(out.begin() + first, out.end(), [](const int3 & lhs, const int3 & rhs)
+	{
+		return std::tie(lhs.x, lhs.y, lhs.z) < std::tie(rhs.x, rhs.y, rhs.z);
+	});
+}
+
 void getVisibleNeighbours(const std::vector<int3> &tiles, std::vector<int3> &out)
 {
 	for(const int3 &tile : tiles)
@@ -514,3 +542,437 @@ bool compareArtifacts(const CArtifactInstance *a1, const CArtifactInstance *a2)
 	else
 		return art1->price > art2->price;
 }
+
+TurnBudget::Phase::Phase(TurnBudget & Budget, EPhase phase):
+	budget(Budget)
+{
+	boost::unique_lock<boost::mutex> lock(budget.mx);
+	active = budget.enterPhase(phase);
+}
+
+TurnBudget::Phase::~Phase()
+{
+	if(active)
+	{
+		boost::unique_lock<boost::mutex> lock(budget.mx);
+		budget.leavePhase();
+	}
+}
+
+TurnBudget::HeroScope::HeroScope(TurnBudget & Budget, HeroPtr h):
+	budget(Budget)
+{
+	boost::unique_lock<boost::mutex> lock(budget.mx);
+	active = budget.enterHeroScope(h);
+}
+
+TurnBudget::HeroScope::~HeroScope()
+{
+	if(active)
+	{
+		boost::unique_lock<boost::mutex> lock(budget.mx);
+		budget.leaveHeroScope();
+	}
+}
+
+TurnBudget::TurnBudget():
+	running(false)
+{
+}
+
+void TurnBudget::start(int turnLimitMs, int heroLimitMs)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	running = true;
+	thread = boost::this_thread::get_id();
+	startTime = lastSwitch = heroSwitch = TClock::now();
+	turnLimit = std::chrono::milliseconds(turnLimitMs);
+	heroLimit = std::chrono::milliseconds(heroLimitMs);
+	phaseTime.fill(TClock::duration::zero());
+	phases.clear();
+	heroes.clear();
+	heroTime.clear();
+}
+
+void TurnBudget::finish()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(!running)
+		return;
+
+	switchPhase();
+	switchHero();
+	running = false;
+
+	auto ms = [](TClock::duration time)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+	};
+	const auto total = TClock::now() - startTime;
+	logAi->info("Turn planning took %d ms of %d ms budget: pathfinding %d ms, goal decomposition %d ms, fuzzy evaluation %d ms, buying %d ms, other %d ms",
+		ms(total), ms(turnLimit), ms(phaseTime[PATHFINDING]), ms(phaseTime[DECOMPOSITION]), ms(phaseTime[FUZZY]), ms(phaseTime[BUYING]), ms(phaseTime[OTHER]));
+	for(auto & hero : heroTime)
+		logAi->debug("Hero %d took %d ms of %d ms budget", hero.first.getNum(), ms(hero.second), ms(heroLimit));
+}
+
+PathsCache::PathsCache():
+	revision(0), computed(0), reused(0), avoided(0)
+{
+}
+
+std::shared_ptr<const CPathsInfo> PathsCache::get(CCallback * cbp, const CGHeroInstance * h)
+{
+	assert(h);
+	ui32 requestedRevision;
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		auto it = paths.find(h->id);
+		if(it != paths.end())
+		{
+			reused++;
+			if(lastHero != h->id)
+				avoided++;
+			lastHero = h->id;
+			return it->second;
+		}
+		requestedRevision = revision;
+	}
+
+	//computed without lock, other threads evaluating goals may need paths of other heroes meanwhile
+	auto ret = std::make_shared<CPathsInfo>(cbp->getMapSize());
+	cbp->calculatePaths(h, *ret);
+
+	boost::unique_lock<boost::mutex> lock(mx);
+	computed++;
+	lastHero = h->id;
+	if(revision == requestedRevision) //otherwise game changed meanwhile, paths may be outdated already
+		paths[h->id] = ret;
+	return ret;
+}
+
+void PathsCache::invalidate()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	revision++;
+	paths.clear();
+	lastHero = ObjectInstanceID();
+}
+
+void PathsCache::invalidate(const CGHeroInstance * h)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	revision++;
+	paths.erase(h->id);
+	if(lastHero == h->id)
+		lastHero = ObjectInstanceID();
+}
+
+void PathsCache::clear()
+{
+	invalidate();
+	boost::unique_lock<boost::mutex> lock(mx);
+	computed = reused = avoided = 0;
+}
+
+void PathsCache::logStatistics() const
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	logAi->info("Paths of heroes computed %d times, reused %d times, %d recomputations avoided", computed, reused, avoided);
+}
+
+ExplorationFrontier::ExplorationFrontier():
+	revision(0)
+{
+}
+
+std::shared_ptr<const ExplorationFrontier::TRings> ExplorationFrontier::get(CCallback * cbp, int radius)
+{
+	std::shared_ptr<const TRings> known;
+	ui32 requestedRevision;
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		if(rings && (int)rings->size() >= radius)
+			return rings;
+		known = rings;
+		requestedRevision = revision;
+	}
+
+	//hero with wider sight needs more rings, the known ones are kept
+	auto ret = known ? std::make_shared<TRings>(*known) : std::make_shared<TRings>();
+	if(ret->empty())
+	{
+		ret->emplace_back();
+		getHiddenTiles(ret->front(), cbp);
+	}
+	while((int)ret->size() < radius)
+	{
+		std::vector<int3> ring;
+		getVisibleNeighbours(ret->back(), ring);
+		vstd::removeDuplicates(ring);
+		ret->push_back(std::move(ring));
+	}
+
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(revision == requestedRevision)
+		rings = ret;
+	return ret;
+}
+
+void ExplorationFrontier::invalidate()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	revision++;
+	rings.reset();
+}
+
+bool TurnBudget::turnTimeLeft() const
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	return !running || turnLimit == TClock::duration::zero() || TClock::now() - startTime < turnLimit;
+}
+
+bool TurnBudget::heroTimeLeft(HeroPtr h) const
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(!running || heroLimit == TClock::duration::zero())
+		return true;
+
+	auto time = TClock::duration::zero();
+	auto it = heroTime.find(h.hid);
+	if(it != heroTime.end())
+		time += it->second;
+	if(!heroes.empty() && heroes.back() == h.hid)
+		time += TClock::now() - heroSwitch;
+	return time < heroLimit;
+}
+
+bool TurnBudget::measured() const
+{
+	return running && boost::this_thread::get_id() == thread;
+}
+
+void TurnBudget::switchPhase()
+{
+	const auto now = TClock::now();
+	phaseTime[phases.empty() ? OTHER : phases.back()] += now - lastSwitch;
+	lastSwitch = now;
+}
+
+void TurnBudget::switchHero()
+{
+	const auto now = TClock::now();
+	if(!heroes.empty())
+		heroTime[heroes.back()] += now - heroSwitch;
+	heroSwitch = now;
+}
+
+bool TurnBudget::enterPhase(EPhase phase)
+{
+	if(!measured())
+		return false;
+
+	switchPhase();
+	phases.push_back(phase);
+	return true;
+}
+
+void TurnBudget::leavePhase()
+{
+	if(running) //turn may have finished meanwhile
+	{
+		switchPhase();
+		phases.pop_back();
+	}
+}
+
+bool TurnBudget::enterHeroScope(HeroPtr h)
+{
+	if(!measured())
+		return false;
+
+	switchHero();
+	heroes.push_back(h.hid);
+	return true;
+}
+
+void TurnBudget::leaveHeroScope()
+{
+	if(running)
+	{
+		switchHero();
+		heroes.pop_back();
+	}
+}
+
+TurnProfiler::Scope::Scope(TurnProfiler & Profiler, const char * Category, const char * Name):
+	profiler(Profiler), active(Profiler.running()), category(Category), name(Name)
+{
+	if(active)
+		start = TClock::now();
+}
+
+TurnProfiler::Scope::~Scope()
+{
+	if(!active)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(profiler.mx);
+	if(!profiler.active)
+		return; //scope left after end of turn
+
+	auto thread = profiler.threads.insert(std::make_pair(boost::this_thread::get_id(), profiler.threads.size() + 1));
+	profiler.record(category, name, thread.first->second, start, args);
+}
+
+TurnProfiler::TurnProfiler():
+	active(false), day(0)
+{
+}
+
+void TurnProfiler::start(PlayerColor Player, int Day)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	active = settings["server"]["aiProfiling"].Bool();
+	player = Player;
+	day = Day;
+	startTime = TClock::now();
+	events.clear();
+	threads.clear();
+	threads[boost::this_thread::get_id()] = 1;
+	pendingRequests.clear();
+}
+
+void TurnProfiler::finish()
+{
+	if(!active)
+		return;
+
+	std::vector<Event> turnEvents;
+	int threadsCount;
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		active = false;
+		JsonNode turnArgs;
+		turnArgs["day"].Float() = day;
+		record("turn", "turn", 1, startTime, turnArgs);
+		//requests not realized till the end of turn are shown as lasting till then
+		for(auto & request : pendingRequests)
+		{
+			JsonNode args;
+			args["realized"].Bool() = false;
+			record("request", request.second.first, 0, request.second.second, args);
+		}
+		turnEvents.swap(events);
+		threadsCount = threads.size();
+	}
+
+	auto us = [](TClock::duration time)
+	{
+		return (double)std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+	};
+	auto metadata = [this](const std::string & name, int thread, const std::string & value) -> JsonNode
+	{
+		JsonNode ret;
+		ret["name"].String() = name;
+		ret["ph"].String() = "M";
+		ret["pid"].Float() = player.getNum();
+		ret["tid"].Float() = thread;
+		ret["args"]["name"].String() = value;
+		return ret;
+	};
+
+	JsonNode trace;
+	JsonVector & list = trace["traceEvents"].Vector();
+	list.push_back(metadata("process_name", 0, "AI " + GameConstants::PLAYER_COLOR_NAMES[player.getNum()]));
+	list.push_back(metadata("thread_name", 0, "requests"));
+	list.push_back(metadata("thread_name", 1, "turn"));
+	for(int thread = 2; thread <= threadsCount; thread++)
+		list.push_back(metadata("thread_name", thread, "worker " + boost::lexical_cast<std::string>(thread - 1)));
+
+	for(auto & event : turnEvents)
+	{
+		list.push_back(JsonNode());
+		JsonNode & node = list.back();
+		node["name"].String() = event.name;
+		node["cat"].String() = event.category;
+		node["ph"].String() = "X";
+		node["ts"].Float() = us(event.start);
+		node["dur"].Float() = us(event.duration);
+		node["pid"].Float() = player.getNum();
+		node["tid"].Float() = event.thread;
+		if(!event.args.isNull())
+			node["args"].swap(event.args);
+	}
+	trace["displayTimeUnit"].String() = "ms";
+
+	const auto dir = VCMIDirs::get().userCachePath() / "AITraces";
+	const auto fname = dir / boost::str(boost::format("Trace_%s_day%d_%d.json") % GameConstants::PLAYER_COLOR_NAMES[player.getNum()] % day % std::time(nullptr));
+	try
+	{
+		boost::filesystem::create_directories(dir);
+		boost::filesystem::ofstream out(fname);
+		out.precision(15); //microseconds since start of turn, exponent notation would drop them
+		out << trace;
+		logAi->info("Trace of turn written to %s", fname.string());
+	}
+	catch(std::exception & e)
+	{
+		logAi->error("Cannot write trace of turn to %s: %s", fname.string(), e.what());
+	}
+}
+
+bool TurnProfiler::running() const
+{
+	return active;
+}
+
+static std::string packTypeName(const CPack * pack) //e.g. "MoveHero" instead of mangled name
+{
+	const char * name = typeid(*pack).name();
+#ifdef __GNUC__
+	int status = 0;
+	std::unique_ptr<char, void(*)(void *)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+	return status == 0 ? demangled.get() : name;
+#else
+	const char * space = std::strchr(name, ' '); //"struct MoveHero"
+	return space ? space + 1 : name;
+#endif
+}
+
+void TurnProfiler::requestSent(int requestID, const CPack * pack)
+{
+	if(!active)
+		return;
+
+	const auto type = packTypeName(pack);
+	boost::unique_lock<boost::mutex> lock(mx);
+	pendingRequests[requestID] = std::make_pair(type, TClock::now());
+}
+
+void TurnProfiler::requestRealized(int requestID)
+{
+	if(!active)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(mx);
+	auto it = pendingRequests.find(requestID);
+	if(it == pendingRequests.end())
+		return;
+
+	JsonNode args;
+	args["requestID"].Float() = requestID;
+	record("request", it->second.first, 0, it->second.second, args);
+	pendingRequests.erase(it);
+}
+
+void TurnProfiler::record(const char * category, const std::string & name, int thread, TClock::time_point start, JsonNode & args)
+{
+	events.push_back(Event());
+	Event & event = events.back();
+	event.category = category;
+	event.name = name;
+	event.thread = thread;
+	event.start = start - startTime;
+	event.duration = TClock::now() - start;
+	event.args.swap(args);
+}
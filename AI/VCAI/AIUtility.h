@@ -7,6 +7,9 @@
 #include "../../lib/spells/CSpellHandler.h"
 #include "../../lib/Connection.h"
 #include "../../lib/CStopWatch.h"
+#include "../../lib/JsonNode.h"
+
+#include <chrono>
 
 /*
  * AIUtility.h, part of VCMI engine
@@ -19,6 +22,7 @@
  */
 
 class CCallback;
+struct CPathsInfo;
 
 typedef const int3& crint3;
 typedef const std::string& crstring;
@@ -109,6 +113,150 @@ struct TimeCheck
 	}
 };
 
+/// Wall time limits of one AI turn and time spent in each phase of planning during it.
+/// Only thread that started the turn is measured, time of nested phases is not counted to the outer one.
+/// Limits may be checked and scopes entered on any thread, e.g. by workers evaluating goals.
+class TurnBudget
+{
+public:
+	enum EPhase {PATHFINDING, DECOMPOSITION, FUZZY, BUYING, OTHER, PHASES_COUNT};
+
+	struct Phase
+	{
+		TurnBudget & budget;
+		bool active;
+		Phase(TurnBudget & Budget, EPhase phase);
+		~Phase();
+	};
+
+	/// Time spent in scope is charged to given hero, time of nested scopes is charged to their heroes
+	struct HeroScope
+	{
+		TurnBudget & budget;
+		bool active;
+		HeroScope(TurnBudget & Budget, HeroPtr h);
+		~HeroScope();
+	};
+
+	TurnBudget();
+	void start(int turnLimitMs, int heroLimitMs); //0 = no limit
+	void finish(); //logs usage of the budget
+	bool turnTimeLeft() const;
+	bool heroTimeLeft(HeroPtr h) const;
+
+private:
+	typedef std::chrono::steady_clock TClock;
+
+	mutable boost::mutex mx; //guards all members below
+	bool running;
+	boost::thread::id thread;
+	TClock::time_point startTime, lastSwitch, heroSwitch;
+	TClock::duration turnLimit, heroLimit;
+	std::array<TClock::duration, PHASES_COUNT> phaseTime;
+	std::vector<EPhase> phases; //currently entered, innermost last
+	std::vector<ObjectInstanceID> heroes; //heroes of entered scopes, innermost last
+	std::map<ObjectInstanceID, TClock::duration> heroTime;
+
+	//members below expect mx to be locked
+	bool measured() const;
+	void switchPhase(); //charges time since last switch to current phase
+	void switchHero(); //same for current hero
+
+	bool enterPhase(EPhase phase); //false if this thread is not measured
+	void leavePhase();
+	bool enterHeroScope(HeroPtr h); //false if this thread is not measured
+	void leaveHeroScope();
+};
+
+/// Timeline of one AI turn in Chrome trace format (chrome://tracing, Perfetto), enabled by "server"/"aiProfiling".
+/// Events of scopes entered on any thread during the turn are kept in memory and written to a file when the turn ends.
+class TurnProfiler
+{
+public:
+	/// Records time between construction and destruction as one event, does nothing if turn is not profiled
+	struct Scope
+	{
+		TurnProfiler & profiler;
+		bool active;
+		JsonNode args; //details shown with the event, fill only if active
+		Scope(TurnProfiler & Profiler, const char * Category, const char * Name);
+		~Scope();
+
+	private:
+		const char * category, * name;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	TurnProfiler();
+	void start(PlayerColor player, int day); //starts recording if enabled in settings
+	void finish(); //writes trace of the turn to user cache
+	bool running() const;
+
+	/// Request is shown from sending till its realization was reported by server
+	void requestSent(int requestID, const CPack * pack);
+	void requestRealized(int requestID);
+
+private:
+	typedef std::chrono::steady_clock TClock;
+
+	struct Event
+	{
+		const char * category;
+		std::string name;
+		int thread; //0 - requests sent to server, threads which entered scopes are numbered from 1
+		TClock::duration start, duration; //start since beginning of turn
+		JsonNode args;
+	};
+
+	std::atomic<bool> active;
+	mutable boost::mutex mx;
+	PlayerColor player;
+	int day;
+	TClock::time_point startTime;
+	std::vector<Event> events;
+	std::map<boost::thread::id, int> threads;
+	std::map<int, std::pair<std::string, TClock::time_point>> pendingRequests;
+
+	void record(const char * category, const std::string & name, int thread, TClock::time_point start, JsonNode & args); //requires locked mx
+};
+
+/// Paths of AI heroes, computed once and kept until a change of the game that may affect them.
+/// Callback keeps paths of one hero only and forgets them after any change, so goals of several heroes recompute them over and over.
+/// Paths being read stay valid when they are invalidated meanwhile, they are freed with the last reference.
+class PathsCache
+{
+public:
+	PathsCache();
+	std::shared_ptr<const CPathsInfo> get(CCallback * cbp, const CGHeroInstance * h);
+	void invalidate(); //change visible to all heroes: movement of any hero, revealed tiles, added or removed object...
+	void invalidate(const CGHeroInstance * h); //change of hero's movement points, army, artifacts or skills
+	void clear(); //start of turn, also resets statistics
+	void logStatistics() const;
+
+private:
+	mutable boost::mutex mx;
+	std::map<ObjectInstanceID, std::shared_ptr<const CPathsInfo>> paths;
+	ui32 revision; //of the game state as far as paths are concerned
+	ObjectInstanceID lastHero; //paths of this hero would be still kept by callback, nobody if they were invalidated
+	int computed, reused, avoided; //avoided - reused paths which callback would have to compute again
+};
+
+/// Tiles by their distance from fog of war, shared by exploration of all heroes until fog changes.
+class ExplorationFrontier
+{
+public:
+	typedef std::vector<std::vector<int3>> TRings; //rings[distance to fog], rings[0] are hidden tiles
+
+	ExplorationFrontier();
+	std::shared_ptr<const TRings> get(CCallback * cbp, int radius); //returns at least radius rings
+	void invalidate(); //tiles were revealed or hidden
+
+private:
+	mutable boost::mutex mx;
+	std::shared_ptr<const TRings> rings;
+	ui32 revision;
+};
+
 struct AtScopeExit
 {
 	std::function<void()> foo;
@@ -140,6 +288,8 @@ void foreach_neighbour(CCallback * cbp, const int3 &pos, std::function<void(CCal
 
 int howManyTilesWillBeDiscovered(const int3 &pos, int radious, CCallback * cbp);
 int howManyTilesWillBeDiscovered(int radious, int3 pos, crint3 dir);
+int howManyTilesCanBeDiscovered(const int3 &pos, int radious, CCallback * cbp); //hidden tiles in range, upper bound of the above; popcount of fog rows, O(radius)
+void getHiddenTiles(std::vector<int3> &out, CCallback * cbp);
 void getVisibleNeighbours(const std::vector<int3> &tiles, std::vector<int3> &out);
 
 bool canBeEmbarkmentPoint(const TerrainTile *t, bool fromWater);
@@ -8,6 +8,8 @@
 #include "../../lib/CPathfinder.h"
 #include "../../lib/CGameStateFwd.h"
 #include "../../lib/VCMI_Lib.h"
+#include "../../lib/CThreadHelper.h"
+#include "../../lib/CConfigHandler.h"
 #include "../../CCallback.h"
 #include "VCAI.h"
 
@@ -21,7 +23,6 @@
  *
 */
 
-#define MIN_AI_STRENGHT (0.5f) //lower when combat AI gets smarter
 #define UNGUARDED_OBJECT (100.0f) //we consider unguarded objects 100 times weaker than us
 
 struct BankConfig;
@@ -38,22 +39,6 @@ FuzzyHelper *fh;
 extern boost::thread_specific_ptr<CCallback> cb;
 extern boost::thread_specific_ptr<VCAI> ai;
 
-engineBase::engineBase()
-{
-	engine.addRuleBlock(&rules);
-}
-
-void engineBase::configure()
-{
-	engine.configure("Minimum", "Maximum", "Minimum", "AlgebraicSum", "Centroid");
-	logAi->info(engine.toString());
-}
-
-void engineBase::addRule(const std::string &txt)
-{
-	rules.addRule(fl::Rule::parse(txt, &engine));
-}
-
 struct armyStructure
 {
 	float walkers, shooters, flyers;
@@ -95,118 +80,61 @@ armyStructure evaluateArmyStructure (const CArmedInstance * army)
 	return as;
 }
 
-FuzzyHelper::FuzzyHelper()
+FuzzyHelper::FuzzyHelper():
+	currentEngines([](Engines *){}), //engines are returned to the pool by lease, not deleted with thread
+	revision(0)
 {
-	initTacticalAdvantage();
-	ta.configure();
-	initVisitTile();
-	vt.configure();
+	compileRules = settings["server"]["aiCompiledFuzzyRules"].Bool();
+	freeEngines.push_back(makeEngines());
 }
 
-
-void FuzzyHelper::initTacticalAdvantage()
+FuzzyHelper::Engines::Engines(bool compile):
+	ta(compile), vt(SAFE_ATTACK_CONSTANT, compile)
 {
-	try
-	{
-
-		ta.ourShooters = new fl::InputVariable("OurShooters");
-		ta.ourWalkers = new fl::InputVariable("OurWalkers");
-		ta.ourFlyers = new fl::InputVariable("OurFlyers");
-		ta.enemyShooters = new fl::InputVariable("EnemyShooters");
-		ta.enemyWalkers = new fl::InputVariable("EnemyWalkers");
-		ta.enemyFlyers = new fl::InputVariable("EnemyFlyers");
-
-		//Tactical advantage calculation
-		std::vector<fl::InputVariable*> helper =
-		{
-			ta.ourShooters, ta.ourWalkers, ta.ourFlyers, ta.enemyShooters, ta.enemyWalkers, ta.enemyFlyers
-		};
-
-		for (auto val : helper)
-		{
-			ta.engine.addInputVariable(val);
-			val->addTerm(new fl::Ramp("FEW", 0.6, 0.0));
-			val->addTerm(new fl::Ramp("MANY", 0.4, 1));
-			val->setRange(0.0, 1.0);
-		}
-
-		ta.ourSpeed = new fl::InputVariable("OurSpeed");
-		ta.enemySpeed = new fl::InputVariable("EnemySpeed");
-
-		helper = {ta.ourSpeed, ta.enemySpeed};
-
-		for (auto val : helper)
-		{
-			ta.engine.addInputVariable(val);
-			val->addTerm(new fl::Ramp("LOW", 6.5, 3));
-			val->addTerm(new fl::Triangle("MEDIUM", 5.5, 10.5));
-			val->addTerm(new fl::Ramp("HIGH", 8.5, 16));
-			val->setRange(0, 25);
-		}
-
-		ta.castleWalls = new fl::InputVariable("CastleWalls");
-		ta.engine.addInputVariable(ta.castleWalls);
-		{
-			fl::Rectangle* none = new fl::Rectangle("NONE", CGTownInstance::NONE, CGTownInstance::NONE + (CGTownInstance::FORT - CGTownInstance::NONE) * 0.5f);
-			ta.castleWalls->addTerm(none);
-
-			fl::Trapezoid* medium = new fl::Trapezoid("MEDIUM", (CGTownInstance::FORT - CGTownInstance::NONE) * 0.5f, CGTownInstance::FORT,
-				CGTownInstance::CITADEL, CGTownInstance::CITADEL + (CGTownInstance::CASTLE - CGTownInstance::CITADEL) * 0.5f);
-			ta.castleWalls->addTerm(medium);
-
-			fl::Ramp* high = new fl::Ramp("HIGH", CGTownInstance::CITADEL - 0.1, CGTownInstance::CASTLE);
-			ta.castleWalls->addTerm(high);
-
-			ta.castleWalls->setRange(CGTownInstance::NONE, CGTownInstance::CASTLE);
-		}
+}
 
+std::unique_ptr<FuzzyHelper::Engines> FuzzyHelper::makeEngines()
+{
+	return make_unique<Engines>(compileRules);
+}
 
+FuzzyHelper::EnginesLease::EnginesLease(FuzzyHelper & Owner):
+	owner(Owner), borrowed(nullptr)
+{
+	if(owner.currentEngines.get())
+		return; //nested evaluation uses engines of the outer one
 
-		ta.bankPresent = new fl::InputVariable("Bank");
-		ta.engine.addInputVariable(ta.bankPresent);
+	{
+		boost::unique_lock<boost::mutex> lock(owner.enginesMx);
+		if(!owner.freeEngines.empty())
 		{
-			fl::Rectangle* termFalse = new fl::Rectangle("FALSE", 0.0, 0.5f);
-			ta.bankPresent->addTerm(termFalse);
-			fl::Rectangle* termTrue = new fl::Rectangle("TRUE", 0.5f, 1);
-			ta.bankPresent->addTerm(termTrue);
-			ta.bankPresent->setRange(0, 1);
+			borrowed = owner.freeEngines.back().release();
+			owner.freeEngines.pop_back();
 		}
+	}
+	if(!borrowed)
+		borrowed = owner.makeEngines().release();
+	owner.currentEngines.reset(borrowed);
+}
 
-		ta.threat = new fl::OutputVariable("Threat");
-		ta.engine.addOutputVariable(ta.threat);
-		ta.threat->addTerm(new fl::Ramp("LOW", 1, MIN_AI_STRENGHT));
-		ta.threat->addTerm(new fl::Triangle("MEDIUM", 0.8, 1.2));
-		ta.threat->addTerm(new fl::Ramp("HIGH", 1, 1.5));
-		ta.threat->setRange(MIN_AI_STRENGHT, 1.5);
-
-		ta.addRule("if OurShooters is MANY and EnemySpeed is LOW then Threat is LOW");
-		ta.addRule("if OurShooters is MANY and EnemyShooters is FEW then Threat is LOW");
-		ta.addRule("if OurSpeed is LOW and EnemyShooters is MANY then Threat is HIGH");
-		ta.addRule("if OurSpeed is HIGH and EnemyShooters is MANY then Threat is LOW");
-
-		ta.addRule("if OurWalkers is FEW and EnemyShooters is MANY then Threat is somewhat LOW");
-		ta.addRule("if OurShooters is MANY and EnemySpeed is HIGH then Threat is somewhat HIGH");
-		//just to cover all cases
-		ta.addRule("if OurShooters is FEW and EnemySpeed is HIGH then Threat is MEDIUM");
-		ta.addRule("if EnemySpeed is MEDIUM then Threat is MEDIUM");
-		ta.addRule("if EnemySpeed is LOW and OurShooters is FEW then Threat is MEDIUM");
-
-		ta.addRule("if Bank is TRUE and OurShooters is MANY then Threat is somewhat HIGH");
-		ta.addRule("if Bank is TRUE and EnemyShooters is MANY then Threat is LOW");
+FuzzyHelper::EnginesLease::~EnginesLease()
+{
+	if(!borrowed)
+		return;
 
-		ta.addRule("if CastleWalls is HIGH and OurWalkers is MANY then Threat is very HIGH");
-		ta.addRule("if CastleWalls is HIGH and OurFlyers is MANY and OurShooters is MANY then Threat is MEDIUM");
-		ta.addRule("if CastleWalls is MEDIUM and OurShooters is MANY and EnemyWalkers is MANY then Threat is LOW");
+	owner.currentEngines.reset();
+	boost::unique_lock<boost::mutex> lock(owner.enginesMx);
+	owner.freeEngines.push_back(std::unique_ptr<Engines>(borrowed));
+}
 
-	}
-	catch (fl::Exception & pe)
-	{
-		logAi->error("initTacticalAdvantage: %s", pe.getWhat());
-	}
+FuzzyHelper::Engines & FuzzyHelper::EnginesLease::get() const
+{
+	return *owner.currentEngines;
 }
 
 ui64 FuzzyHelper::estimateBankDanger (const CBank * bank)
 {
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::FUZZY);
 	//this one is not fuzzy anymore, just calculate weighted average
 
 	auto objectInfo = VLC->objtypeh->getHandlerFor(bank->ID, bank->subID)->getObjectInfo(bank->appearance);
@@ -226,6 +154,11 @@ ui64 FuzzyHelper::estimateBankDanger (const CBank * bank)
 
 float FuzzyHelper::getTacticalAdvantage (const CArmedInstance *we, const CArmedInstance *enemy)
 {
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::FUZZY);
+	TurnProfiler::Scope scope(ai->profiler, "fuzzy", "getTacticalAdvantage");
+	EnginesLease engines(*this);
+	TacticalAdvantage & ta = engines.get().ta;
+
 	float output = 1;
 	try
 	{
@@ -257,7 +190,7 @@ float FuzzyHelper::getTacticalAdvantage (const CArmedInstance *we, const CArmedI
 			ta.castleWalls->setInputValue(0);
 
 		//engine.process(TACTICAL_ADVANTAGE);//TODO: Process only Tactical_Advantage
-		ta.engine.process();
+		ta.process();
 		output = ta.threat->getOutputValue();
 	}
 	catch (fl::Exception & fe)
@@ -280,31 +213,18 @@ float FuzzyHelper::getTacticalAdvantage (const CArmedInstance *we, const CArmedI
 	return output;
 }
 
-FuzzyHelper::TacticalAdvantage::~TacticalAdvantage()
-{
-	//TODO: smart pointers?
-	delete ourWalkers;
-	delete ourShooters;
-	delete ourFlyers;
-	delete enemyWalkers;
-	delete enemyShooters;
-	delete enemyFlyers;
-	delete ourSpeed;
-	delete enemySpeed;
-	delete bankPresent;
-	delete castleWalls;
-	delete threat;
-}
-
 //std::shared_ptr<AbstractGoal> chooseSolution (std::vector<std::shared_ptr<AbstractGoal>> & vec)
 
 Goals::TSubgoal FuzzyHelper::chooseSolution (Goals::TGoalVec vec)
 {
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::FUZZY);
+	TurnProfiler::Scope scope(ai->profiler, "fuzzy", "chooseSolution");
+	if (scope.active)
+		scope.args["candidates"].Float() = vec.size();
+
 	if (vec.empty()) //no possibilities found
 		return sptr(Goals::Invalid());
 
-	ai->cachedSectorMaps.clear();
-
 	//a trick to switch between heroes less often - calculatePaths is costly
 	auto sortByHeroes = [](const Goals::TSubgoal & lhs, const Goals::TSubgoal & rhs) -> bool
 	{
@@ -312,18 +232,20 @@ Goals::TSubgoal FuzzyHelper::chooseSolution (Goals::TGoalVec vec)
 	};
 	boost::sort (vec, sortByHeroes);
 
-	for (auto g : vec)
+	//goals which can't be evaluated concurrently go first, on this thread
+	VCAI * owner = ai.get();
+	auto isReentrantGoal = [this](const Goals::TSubgoal & g){ return isReentrant(*g); };
+	auto evaluateGoal = [this, owner](Goals::TSubgoal g) -> float
 	{
+		std::unique_ptr<SetGlobalState> state;
+		if (!ai.get()) //worker thread; tasks run on calling thread if there are few of them
+			state = make_unique<SetGlobalState>(owner);
 		setPriority(g);
-	}
-
-	auto compareGoals = [](const Goals::TSubgoal & lhs, const Goals::TSubgoal & rhs) -> bool
-	{
-		return lhs->priority < rhs->priority;
+		return g->priority;
 	};
-	boost::sort (vec, compareGoals);
+	auto priorities = evaluateCandidates(vec, isReentrantGoal, evaluateGoal);
 
-	return vec.back();
+	return vec[bestCandidate(priorities)];
 }
 
 float FuzzyHelper::evaluate (Goals::Explore & g)
@@ -334,86 +256,6 @@ float FuzzyHelper::evaluate (Goals::RecruitHero & g)
 {
 	return 1; //just try to recruit hero as one of options
 }
-FuzzyHelper::EvalVisitTile::~EvalVisitTile()
-{
-	delete strengthRatio;
-	delete heroStrength;
-	delete turnDistance;
-	delete missionImportance;
-}
-
-void FuzzyHelper::initVisitTile()
-{
-	try
-	{
-		vt.strengthRatio = new fl::InputVariable("strengthRatio"); //hero must be strong enough to defeat guards
-		vt.heroStrength = new fl::InputVariable("heroStrength"); //we want to use weakest possible hero
-		vt.turnDistance = new fl::InputVariable("turnDistance"); //we want to use hero who is near
-		vt.missionImportance = new fl::InputVariable("lockedMissionImportance"); //we may want to preempt hero with low-priority mission
-		vt.value = new fl::OutputVariable("Value");
-		vt.value->setMinimum(0);
-		vt.value->setMaximum(5);
-
-		std::vector<fl::InputVariable*> helper = {vt.strengthRatio, vt.heroStrength, vt.turnDistance, vt.missionImportance};
-		for (auto val : helper)
-		{
-			vt.engine.addInputVariable(val);
-		}
-		vt.engine.addOutputVariable(vt.value);
-
-		vt.strengthRatio->addTerm(new fl::Ramp("LOW", SAFE_ATTACK_CONSTANT, 0));
-		vt.strengthRatio->addTerm(new fl::Ramp("HIGH", SAFE_ATTACK_CONSTANT, SAFE_ATTACK_CONSTANT * 3));
-		vt.strengthRatio->setRange(0, SAFE_ATTACK_CONSTANT * 3 );
-
-		//strength compared to our main hero
-		vt.heroStrength->addTerm(new fl::Ramp("LOW", 0.2, 0));
-		vt.heroStrength->addTerm(new fl::Triangle("MEDIUM", 0.2, 0.8));
-		vt.heroStrength->addTerm(new fl::Ramp("HIGH", 0.5, 1));
-		vt.heroStrength->setRange(0.0, 1.0);
-
-		vt.turnDistance->addTerm(new fl::Ramp("SMALL", 0.5, 0));
-		vt.turnDistance->addTerm(new fl::Triangle("MEDIUM", 0.1, 0.8));
-		vt.turnDistance->addTerm(new fl::Ramp("LONG", 0.5, 3));
-		vt.turnDistance->setRange(0.0, 3.0);
-
-		vt.missionImportance->addTerm(new fl::Ramp("LOW", 2.5, 0));
-		vt.missionImportance->addTerm(new fl::Triangle("MEDIUM", 2, 3));
-		vt.missionImportance->addTerm(new fl::Ramp("HIGH", 2.5, 5));
-		vt.missionImportance->setRange(0.0, 5.0);
-
-		//an issue: in 99% cases this outputs center of mass (2.5) regardless of actual input :/
-		 //should be same as "mission Importance" to keep consistency
-		vt.value->addTerm(new fl::Ramp("LOW", 2.5, 0));
-		vt.value->addTerm(new fl::Triangle("MEDIUM", 2, 3)); //can't be center of mass :/
-		vt.value->addTerm(new fl::Ramp("HIGH", 2.5, 5));
-		vt.value->setRange(0.0,5.0);
-
-		//use unarmed scouts if possible
-		vt.addRule("if strengthRatio is HIGH and heroStrength is LOW then Value is very HIGH");
-		//we may want to use secondary hero(es) rather than main hero
-		vt.addRule("if strengthRatio is HIGH and heroStrength is MEDIUM then Value is somewhat HIGH");
-		vt.addRule("if strengthRatio is HIGH and heroStrength is HIGH then Value is somewhat LOW");
-		//don't assign targets to heroes who are too weak, but prefer targets of our main hero (in case we need to gather army)
-		vt.addRule("if strengthRatio is LOW and heroStrength is LOW then Value is very LOW");
-		//attempt to arm secondary heroes is not stupid
-		vt.addRule("if strengthRatio is LOW and heroStrength is MEDIUM then Value is somewhat HIGH");
-		vt.addRule("if strengthRatio is LOW and heroStrength is HIGH then Value is LOW");
-
-		//do not cancel important goals
-		vt.addRule("if lockedMissionImportance is HIGH then Value is very LOW");
-		vt.addRule("if lockedMissionImportance is MEDIUM then Value is somewhat LOW");
-		vt.addRule("if lockedMissionImportance is LOW then Value is HIGH");
-		//pick nearby objects if it's easy, avoid long walks
-		vt.addRule("if turnDistance is SMALL then Value is HIGH");
-		vt.addRule("if turnDistance is MEDIUM then Value is MEDIUM");
-		vt.addRule("if turnDistance is LONG then Value is LOW");
-	}
-	catch (fl::Exception & fe)
-	{
-		logAi->error("visitTile: %s",fe.getWhat());
-	}
-}
-
 float FuzzyHelper::evaluate (Goals::VisitTile & g)
 {
 	//we assume that hero is already set and we want to choose most suitable one for the mission
@@ -434,14 +276,17 @@ float FuzzyHelper::evaluate (Goals::VisitTile & g)
 	}
 
 	float missionImportance = 0;
-	if (vstd::contains(ai->lockedHeroes, g.hero))
-		missionImportance = ai->lockedHeroes[g.hero]->priority;
+	auto mission = ai->lockedHeroes.find(g.hero); //other threads may evaluate too, don't use operator[]
+	if (mission != ai->lockedHeroes.end())
+		missionImportance = mission->second->priority;
 
 	float strengthRatio = 10.0f; //we are much stronger than enemy
 	ui64 danger = evaluateDanger (g.tile, g.hero.h);
 	if (danger)
 		strengthRatio = (fl::scalar)g.hero.h->getTotalStrength() / danger;
 
+	EnginesLease engines(*this);
+	EvalVisitTile & vt = engines.get().vt;
 	try
 	{
 		vt.strengthRatio->setInputValue(strengthRatio);
@@ -449,7 +294,7 @@ float FuzzyHelper::evaluate (Goals::VisitTile & g)
 		vt.turnDistance->setInputValue(turns);
 		vt.missionImportance->setInputValue(missionImportance);
 
-		vt.engine.process();
+		vt.process();
 		//engine.process(VISIT_TILE); //TODO: Process only Visit_Tile
 		g.priority = vt.value->getOutputValue();
 	}
@@ -529,5 +374,75 @@ float FuzzyHelper::evaluate (Goals::AbstractGoal & g)
 }
 void FuzzyHelper::setPriority (Goals::TSubgoal & g)
 {
-	g->setpriority(g->accept(this)); //this enforces returned value is set
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::FUZZY);
+	TurnProfiler::Scope scope(ai->profiler, "fuzzy", "evaluate");
+	if (scope.active)
+		scope.args["goal"].String() = g->name();
+	g->setpriority(evaluateMemoized(g)); //this enforces returned value is set
+}
+
+void FuzzyHelper::gameChanged()
+{
+	revision++;
+}
+
+bool FuzzyHelper::EvaluationStamp::operator==(const EvaluationStamp & other) const
+{
+	return heroPos == other.heroPos && heroMovement == other.heroMovement
+		&& heroStrength == other.heroStrength && missionImportance == other.missionImportance;
+}
+
+bool FuzzyHelper::isReentrant(const Goals::AbstractGoal & g) const
+{
+	switch (g.goalType)
+	{
+	case Goals::INVALID:
+	case Goals::BUILD:
+	case Goals::EXPLORE:
+	case Goals::GATHER_ARMY:
+	case Goals::RECRUIT_HERO:
+	case Goals::BUILD_STRUCTURE:
+	case Goals::COLLECT_RES:
+	case Goals::VISIT_HERO:
+	case Goals::VISIT_TILE:
+	case Goals::DIG_AT_TILE:
+		return true;
+	default: //ClearWayTo updates sector map
+		return false;
+	}
+}
+
+bool FuzzyHelper::isMemoizable(const Goals::AbstractGoal & g) const
+{
+	switch (g.goalType)
+	{
+	case Goals::GATHER_ARMY:
+	case Goals::VISIT_HERO:
+	case Goals::VISIT_TILE:
+		return g.hero.validAndSet();
+	default: //others are constant or not reentrant
+		return false;
+	}
+}
+
+FuzzyHelper::EvaluationStamp FuzzyHelper::getStamp(const Goals::AbstractGoal & g) const
+{
+	EvaluationStamp ret;
+	ret.heroPos = g.hero->visitablePos();
+	ret.heroMovement = g.hero->movement;
+	ret.heroStrength = g.hero->getTotalStrength();
+	ret.missionImportance = 0;
+	auto mission = ai->lockedHeroes.find(g.hero);
+	if (mission != ai->lockedHeroes.end())
+		ret.missionImportance = mission->second->priority;
+	return ret;
+}
+
+float FuzzyHelper::evaluateMemoized(Goals::TSubgoal & g)
+{
+	if (!isMemoizable(*g))
+		return g->accept(this);
+
+	const TEvaluationKey key(g->goalType, g->hero.hid.getNum(), g->tile, g->objid, g->value);
+	return evaluations.get(key, revision, getStamp(*g), [&]{ return g->accept(this); });
 }
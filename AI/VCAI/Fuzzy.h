@@ -1,5 +1,6 @@
 #pragma once
-#include "fl/Headers.h"
+#include "FuzzyEngines.h"
+#include "GoalEvaluation.h"
 #include "Goals.h"
 
 /*
@@ -17,53 +18,63 @@ class CArmedInstance;
 class CBank;
 class SectorMap;
 
-class engineBase
-{
-public:
-	fl::Engine engine;
-	fl::RuleBlock rules;
-
-	engineBase();
-	void configure();
-	void addRule(const std::string &txt);
-};
-
 class FuzzyHelper
 {
 	friend class VCAI;
 
-	class TacticalAdvantage : public engineBase
+	/// Engines keep input values of the last evaluation, so each thread evaluating goals needs its own set.
+	/// Sets are pooled and reused by other threads once they are released.
+	struct Engines
 	{
-	public:
-		fl::InputVariable * ourWalkers, * ourShooters, * ourFlyers, * enemyWalkers, * enemyShooters, * enemyFlyers;
-		fl::InputVariable * ourSpeed, * enemySpeed;
-		fl::InputVariable * bankPresent;
-		fl::InputVariable * castleWalls;
-		fl::OutputVariable * threat;
-		~TacticalAdvantage();
-	} ta;
-
-	class EvalVisitTile : public engineBase
+		TacticalAdvantage ta;
+		EvalVisitTile vt;
+
+		Engines(bool compile);
+	};
+
+	/// Engines of current thread, borrowed from the pool by the outermost lease
+	class EnginesLease
 	{
+		FuzzyHelper & owner;
+		Engines * borrowed;
 	public:
-		fl::InputVariable * strengthRatio;
-		fl::InputVariable * heroStrength;
-		fl::InputVariable * turnDistance;
-		fl::InputVariable * missionImportance;
-		fl::OutputVariable * value;
-		fl::RuleBlock rules;
-		~EvalVisitTile();
-	} vt;
+		EnginesLease(FuzzyHelper & Owner);
+		~EnginesLease();
+		Engines & get() const;
+	};
+
+	/// Inputs of evaluation besides the goal itself and the game revision; memoized priority is valid while they are unchanged
+	struct EvaluationStamp
+	{
+		int3 heroPos;
+		ui32 heroMovement;
+		ui64 heroStrength;
+		float missionImportance;
+
+		bool operator==(const EvaluationStamp & other) const;
+	};
+	typedef std::tuple<int, si32, int3, int, int> TEvaluationKey; //goal type, hero, tile, object, value
+
+	bool compileRules; //evaluate engines with CompiledFuzzyEngine
+	boost::mutex enginesMx;
+	std::vector<std::unique_ptr<Engines>> freeEngines;
+	boost::thread_specific_ptr<Engines> currentEngines;
+
+	std::atomic<ui32> revision; //of the game, see gameChanged()
+	EvaluationMemo<TEvaluationKey, EvaluationStamp> evaluations;
 
-	
+	std::unique_ptr<Engines> makeEngines();
+	bool isReentrant(const Goals::AbstractGoal & g) const; //evaluation only reads the game, so it can run on any thread
+	bool isMemoizable(const Goals::AbstractGoal & g) const;
+	EvaluationStamp getStamp(const Goals::AbstractGoal & g) const;
+	float evaluateMemoized(Goals::TSubgoal & g);
 
 public:
 	enum RuleBlocks {BANK_DANGER, TACTICAL_ADVANTAGE, VISIT_TILE};
 	//blocks should be initialized in this order, which may be confusing :/
 
 	FuzzyHelper();
-	void initTacticalAdvantage();
-	void initVisitTile();
+	void gameChanged(); //invalidates memoized evaluations
 
 	float evaluate (Goals::Explore & g);
 	float evaluate (Goals::RecruitHero & g);
@@ -82,6 +93,6 @@ public:
 	ui64 estimateBankDanger (const CBank * bank);
 	float getTacticalAdvantage (const CArmedInstance *we, const CArmedInstance *enemy); //returns factor how many times enemy is stronger than us
 
-	Goals::TSubgoal chooseSolution (Goals::TGoalVec vec);
+	Goals::TSubgoal chooseSolution (Goals::TGoalVec vec); //candidates are evaluated in parallel
 	//std::shared_ptr<AbstractGoal> chooseSolution (std::vector<std::shared_ptr<AbstractGoal>> & vec);
 };
@@ -0,0 +1,441 @@
+#include "StdInc.h"
+#include "FuzzyEngines.h"
+
+#include "../../lib/mapObjects/CGTownInstance.h"
+
+/*
+ * FuzzyEngines.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+*/
+
+#define MIN_AI_STRENGHT (0.5f) //lower when combat AI gets smarter
+
+CompiledFuzzyEngine::CompiledFuzzyEngine():
+	compiled(false)
+{
+}
+
+bool CompiledFuzzyEngine::compile(const fl::Engine & engine)
+{
+	compiled = false;
+	propositions.clear();
+	rules.clear();
+	outputs.clear();
+
+	for(int i = 0; i < engine.numberOfOutputVariables(); i++)
+	{
+		fl::OutputVariable * variable = engine.getOutputVariable(i);
+		auto centroid = dynamic_cast<const fl::Centroid *>(variable->getDefuzzifier());
+		if(!variable->isEnabled() || !centroid || !dynamic_cast<const fl::AlgebraicSum *>(variable->fuzzyOutput()->getAccumulation()))
+			return false;
+		if(!fl::Op::isFinite(variable->getMinimum() + variable->getMaximum()))
+			return false;
+
+		Output output;
+		output.variable = variable;
+		output.minimum = variable->getMinimum();
+		output.resolution = centroid->getResolution();
+		output.dx = (variable->getMaximum() - variable->getMinimum()) / output.resolution;
+		outputs.push_back(output);
+	}
+
+	for(int i = 0; i < engine.numberOfRuleBlocks(); i++)
+	{
+		const fl::RuleBlock * block = engine.getRuleBlock(i);
+		if(!block->isEnabled())
+			continue;
+		if(!dynamic_cast<const fl::Minimum *>(block->getConjunction()) || !dynamic_cast<const fl::Minimum *>(block->getActivation()))
+			return false;
+
+		for(const fl::Rule * blockRule : block->rules())
+		{
+			if(!blockRule->isLoaded())
+				continue; //interpreter skips them too
+
+			Rule rule;
+			rule.weight = blockRule->getWeight();
+			if(!compileExpression(blockRule->getAntecedent()->getExpression(), rule.antecedent))
+				return false;
+			for(const Operation & operation : rule.antecedent)
+			{
+				if(operation.type == OR && !dynamic_cast<const fl::Maximum *>(block->getDisjunction()))
+					return false;
+			}
+
+			for(const fl::Proposition * proposition : blockRule->getConsequent()->conclusions())
+			{
+				Conclusion conclusion;
+				conclusion.output = findOutput(proposition->variable);
+				if(conclusion.output < 0)
+					return false;
+				conclusion.hedges.assign(proposition->hedges.begin(), proposition->hedges.end());
+
+				const Output & output = outputs[conclusion.output];
+				for(int j = 0; j < output.resolution; j++)
+					conclusion.samples.push_back(proposition->term->membership(output.minimum + (j + 0.5) * output.dx));
+				rule.conclusions.push_back(conclusion);
+			}
+			rules.push_back(rule);
+		}
+	}
+
+	memberships.resize(propositions.size());
+	activations.resize(outputs.size());
+	compiled = true;
+	return true;
+}
+
+bool CompiledFuzzyEngine::compileExpression(const fl::Expression * expression, std::vector<Operation> & out)
+{
+	if(auto proposition = dynamic_cast<const fl::Proposition *>(expression))
+	{
+		auto variable = dynamic_cast<const fl::InputVariable *>(proposition->variable);
+		if(!variable || !variable->isEnabled())
+			return false; //propositions about output variables are not supported
+		for(const fl::Hedge * hedge : proposition->hedges)
+		{
+			if(dynamic_cast<const fl::Any *>(hedge))
+				return false;
+		}
+
+		Operation operation;
+		operation.type = MEMBERSHIP;
+		operation.hedges.assign(proposition->hedges.begin(), proposition->hedges.end());
+		auto key = std::make_pair(variable, static_cast<const fl::Term *>(proposition->term));
+		operation.membership = std::find(propositions.begin(), propositions.end(), key) - propositions.begin();
+		if(operation.membership == static_cast<int>(propositions.size()))
+			propositions.push_back(key);
+		out.push_back(operation);
+		return true;
+	}
+
+	auto fuzzyOperator = dynamic_cast<const fl::Operator *>(expression);
+	if(!fuzzyOperator || !fuzzyOperator->left || !fuzzyOperator->right)
+		return false;
+
+	Operation operation;
+	operation.membership = -1;
+	if(fuzzyOperator->name == fl::Rule::andKeyword())
+		operation.type = AND;
+	else if(fuzzyOperator->name == fl::Rule::orKeyword())
+		operation.type = OR;
+	else
+		return false;
+
+	if(!compileExpression(fuzzyOperator->left, out) || !compileExpression(fuzzyOperator->right, out))
+		return false;
+	out.push_back(operation);
+	return true;
+}
+
+int CompiledFuzzyEngine::findOutput(const fl::Variable * variable) const
+{
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		if(outputs[i].variable == variable)
+			return i;
+	}
+	return -1;
+}
+
+bool CompiledFuzzyEngine::isCompiled() const
+{
+	return compiled;
+}
+
+void CompiledFuzzyEngine::process()
+{
+	assert(compiled);
+
+	for(size_t i = 0; i < propositions.size(); i++)
+		memberships[i] = propositions[i].second->membership(propositions[i].first->getInputValue());
+	for(auto & outputActivations : activations)
+		outputActivations.clear();
+
+	for(const Rule & rule : rules)
+	{
+		stack.clear();
+		for(const Operation & operation : rule.antecedent)
+		{
+			if(operation.type == MEMBERSHIP)
+			{
+				fl::scalar result = memberships[operation.membership];
+				for(auto hedge = operation.hedges.rbegin(); hedge != operation.hedges.rend(); ++hedge)
+					result = (*hedge)->hedge(result);
+				stack.push_back(result);
+			}
+			else
+			{
+				const fl::scalar right = stack.back();
+				stack.pop_back();
+				fl::scalar & left = stack.back();
+				left = operation.type == AND ? fl::Op::min(left, right) : fl::Op::max(left, right);
+			}
+		}
+
+		fl::scalar degree = rule.weight * stack.back();
+		if(!fl::Op::isGt(degree, 0.0))
+			continue;
+
+		//like in fl::Consequent::modify, hedges of a conclusion apply to the following ones too
+		for(const Conclusion & conclusion : rule.conclusions)
+		{
+			for(auto hedge = conclusion.hedges.rbegin(); hedge != conclusion.hedges.rend(); ++hedge)
+				degree = (*hedge)->hedge(degree);
+			Activation activation;
+			activation.samples = &conclusion.samples;
+			activation.degree = degree;
+			activations[conclusion.output].push_back(activation);
+		}
+	}
+
+	for(size_t i = 0; i < outputs.size(); i++)
+	{
+		const Output & output = outputs[i];
+		fl::OutputVariable * variable = output.variable;
+		if(fl::Op::isFinite(variable->getOutputValue()))
+			variable->setPreviousOutputValue(variable->getOutputValue());
+
+		fl::scalar result;
+		if(!activations[i].empty())
+		{
+			//accumulated membership at each point is summed in order of activations, as fl::Accumulated does
+			accumulated.assign(output.resolution, 0.0);
+			for(const Activation & activation : activations[i])
+			{
+				const std::vector<fl::scalar> & samples = *activation.samples;
+				for(int j = 0; j < output.resolution; j++)
+				{
+					const fl::scalar mu = fl::Op::min(samples[j], activation.degree);
+					accumulated[j] = accumulated[j] + mu - (accumulated[j] * mu);
+				}
+			}
+
+			fl::scalar xcentroid = 0, area = 0;
+			for(int j = 0; j < output.resolution; j++)
+			{
+				xcentroid += accumulated[j] * (output.minimum + (j + 0.5) * output.dx);
+				area += accumulated[j];
+			}
+			result = xcentroid / area;
+		}
+		else if(variable->isLockedPreviousOutputValue() && !fl::Op::isNaN(variable->getPreviousOutputValue()))
+			result = variable->getPreviousOutputValue();
+		else
+			result = variable->getDefaultValue();
+
+		if(variable->isLockedOutputValueInRange())
+			result = fl::Op::bound(result, variable->getMinimum(), variable->getMaximum());
+		variable->setOutputValue(result);
+	}
+}
+
+engineBase::engineBase()
+{
+	rules = new fl::RuleBlock();
+	engine.addRuleBlock(rules);
+}
+
+void engineBase::configure(bool compile)
+{
+	engine.configure("Minimum", "Maximum", "Minimum", "AlgebraicSum", "Centroid");
+	if(logAi->isTraceEnabled()) //engines are made for each thread evaluating goals, printing them is expensive
+		logAi->trace(engine.toString());
+	if(compile && !compiled.compile(engine))
+		logAi->warn("Rules of fuzzy engine can't be compiled, they will be interpreted");
+}
+
+void engineBase::addRule(const std::string &txt)
+{
+	rules->addRule(fl::Rule::parse(txt, &engine));
+}
+
+void engineBase::process()
+{
+	if(compiled.isCompiled())
+		compiled.process();
+	else
+		engine.process();
+}
+
+TacticalAdvantage::TacticalAdvantage(bool compile)
+{
+	try
+	{
+
+		ourShooters = new fl::InputVariable("OurShooters");
+		ourWalkers = new fl::InputVariable("OurWalkers");
+		ourFlyers = new fl::InputVariable("OurFlyers");
+		enemyShooters = new fl::InputVariable("EnemyShooters");
+		enemyWalkers = new fl::InputVariable("EnemyWalkers");
+		enemyFlyers = new fl::InputVariable("EnemyFlyers");
+
+		//Tactical advantage calculation
+		std::vector<fl::InputVariable*> helper =
+		{
+			ourShooters, ourWalkers, ourFlyers, enemyShooters, enemyWalkers, enemyFlyers
+		};
+
+		for (auto val : helper)
+		{
+			engine.addInputVariable(val);
+			val->addTerm(new fl::Ramp("FEW", 0.6, 0.0));
+			val->addTerm(new fl::Ramp("MANY", 0.4, 1));
+			val->setRange(0.0, 1.0);
+		}
+
+		ourSpeed = new fl::InputVariable("OurSpeed");
+		enemySpeed = new fl::InputVariable("EnemySpeed");
+
+		helper = {ourSpeed, enemySpeed};
+
+		for (auto val : helper)
+		{
+			engine.addInputVariable(val);
+			val->addTerm(new fl::Ramp("LOW", 6.5, 3));
+			val->addTerm(new fl::Triangle("MEDIUM", 5.5, 10.5));
+			val->addTerm(new fl::Ramp("HIGH", 8.5, 16));
+			val->setRange(0, 25);
+		}
+
+		castleWalls = new fl::InputVariable("CastleWalls");
+		engine.addInputVariable(castleWalls);
+		{
+			fl::Rectangle* none = new fl::Rectangle("NONE", CGTownInstance::NONE, CGTownInstance::NONE + (CGTownInstance::FORT - CGTownInstance::NONE) * 0.5f);
+			castleWalls->addTerm(none);
+
+			fl::Trapezoid* medium = new fl::Trapezoid("MEDIUM", (CGTownInstance::FORT - CGTownInstance::NONE) * 0.5f, CGTownInstance::FORT,
+				CGTownInstance::CITADEL, CGTownInstance::CITADEL + (CGTownInstance::CASTLE - CGTownInstance::CITADEL) * 0.5f);
+			castleWalls->addTerm(medium);
+
+			fl::Ramp* high = new fl::Ramp("HIGH", CGTownInstance::CITADEL - 0.1, CGTownInstance::CASTLE);
+			castleWalls->addTerm(high);
+
+			castleWalls->setRange(CGTownInstance::NONE, CGTownInstance::CASTLE);
+		}
+
+
+
+		bankPresent = new fl::InputVariable("Bank");
+		engine.addInputVariable(bankPresent);
+		{
+			fl::Rectangle* termFalse = new fl::Rectangle("FALSE", 0.0, 0.5f);
+			bankPresent->addTerm(termFalse);
+			fl::Rectangle* termTrue = new fl::Rectangle("TRUE", 0.5f, 1);
+			bankPresent->addTerm(termTrue);
+			bankPresent->setRange(0, 1);
+		}
+
+		threat = new fl::OutputVariable("Threat");
+		engine.addOutputVariable(threat);
+		threat->addTerm(new fl::Ramp("LOW", 1, MIN_AI_STRENGHT));
+		threat->addTerm(new fl::Triangle("MEDIUM", 0.8, 1.2));
+		threat->addTerm(new fl::Ramp("HIGH", 1, 1.5));
+		threat->setRange(MIN_AI_STRENGHT, 1.5);
+
+		addRule("if OurShooters is MANY and EnemySpeed is LOW then Threat is LOW");
+		addRule("if OurShooters is MANY and EnemyShooters is FEW then Threat is LOW");
+		addRule("if OurSpeed is LOW and EnemyShooters is MANY then Threat is HIGH");
+		addRule("if OurSpeed is HIGH and EnemyShooters is MANY then Threat is LOW");
+
+		addRule("if OurWalkers is FEW and EnemyShooters is MANY then Threat is somewhat LOW");
+		addRule("if OurShooters is MANY and EnemySpeed is HIGH then Threat is somewhat HIGH");
+		//just to cover all cases
+		addRule("if OurShooters is FEW and EnemySpeed is HIGH then Threat is MEDIUM");
+		addRule("if EnemySpeed is MEDIUM then Threat is MEDIUM");
+		addRule("if EnemySpeed is LOW and OurShooters is FEW then Threat is MEDIUM");
+
+		addRule("if Bank is TRUE and OurShooters is MANY then Threat is somewhat HIGH");
+		addRule("if Bank is TRUE and EnemyShooters is MANY then Threat is LOW");
+
+		addRule("if CastleWalls is HIGH and OurWalkers is MANY then Threat is very HIGH");
+		addRule("if CastleWalls is HIGH and OurFlyers is MANY and OurShooters is MANY then Threat is MEDIUM");
+		addRule("if CastleWalls is MEDIUM and OurShooters is MANY and EnemyWalkers is MANY then Threat is LOW");
+
+	}
+	catch (fl::Exception & pe)
+	{
+		logAi->error("initTacticalAdvantage: %s", pe.getWhat());
+	}
+
+	configure(compile);
+}
+
+EvalVisitTile::EvalVisitTile(double safeAttackConstant, bool compile)
+{
+	try
+	{
+		strengthRatio = new fl::InputVariable("strengthRatio"); //hero must be strong enough to defeat guards
+		heroStrength = new fl::InputVariable("heroStrength"); //we want to use weakest possible hero
+		turnDistance = new fl::InputVariable("turnDistance"); //we want to use hero who is near
+		missionImportance = new fl::InputVariable("lockedMissionImportance"); //we may want to preempt hero with low-priority mission
+		value = new fl::OutputVariable("Value");
+		value->setMinimum(0);
+		value->setMaximum(5);
+
+		std::vector<fl::InputVariable*> helper = {strengthRatio, heroStrength, turnDistance, missionImportance};
+		for (auto val : helper)
+		{
+			engine.addInputVariable(val);
+		}
+		engine.addOutputVariable(value);
+
+		strengthRatio->addTerm(new fl::Ramp("LOW", safeAttackConstant, 0));
+		strengthRatio->addTerm(new fl::Ramp("HIGH", safeAttackConstant, safeAttackConstant * 3));
+		strengthRatio->setRange(0, safeAttackConstant * 3 );
+
+		//strength compared to our main hero
+		heroStrength->addTerm(new fl::Ramp("LOW", 0.2, 0));
+		heroStrength->addTerm(new fl::Triangle("MEDIUM", 0.2, 0.8));
+		heroStrength->addTerm(new fl::Ramp("HIGH", 0.5, 1));
+		heroStrength->setRange(0.0, 1.0);
+
+		turnDistance->addTerm(new fl::Ramp("SMALL", 0.5, 0));
+		turnDistance->addTerm(new fl::Triangle("MEDIUM", 0.1, 0.8));
+		turnDistance->addTerm(new fl::Ramp("LONG", 0.5, 3));
+		turnDistance->setRange(0.0, 3.0);
+
+		missionImportance->addTerm(new fl::Ramp("LOW", 2.5, 0));
+		missionImportance->addTerm(new fl::Triangle("MEDIUM", 2, 3));
+		missionImportance->addTerm(new fl::Ramp("HIGH", 2.5, 5));
+		missionImportance->setRange(0.0, 5.0);
+
+		//an issue: in 99% cases this outputs center of mass (2.5) regardless of actual input :/
+		 //should be same as "mission Importance" to keep consistency
+		value->addTerm(new fl::Ramp("LOW", 2.5, 0));
+		value->addTerm(new fl::Triangle("MEDIUM", 2, 3)); //can't be center of mass :/
+		value->addTerm(new fl::Ramp("HIGH", 2.5, 5));
+		value->setRange(0.0,5.0);
+
+		//use unarmed scouts if possible
+		addRule("if strengthRatio is HIGH and heroStrength is LOW then Value is very HIGH");
+		//we may want to use secondary hero(es) rather than main hero
+		addRule("if strengthRatio is HIGH and heroStrength is MEDIUM then Value is somewhat HIGH");
+		addRule("if strengthRatio is HIGH and heroStrength is HIGH then Value is somewhat LOW");
+		//don't assign targets to heroes who are too weak, but prefer targets of our main hero (in case we need to gather army)
+		addRule("if strengthRatio is LOW and heroStrength is LOW then Value is very LOW");
+		//attempt to arm secondary heroes is not stupid
+		addRule("if strengthRatio is LOW and heroStrength is MEDIUM then Value is somewhat HIGH");
+		addRule("if strengthRatio is LOW and heroStrength is HIGH then Value is LOW");
+
+		//do not cancel important goals
+		addRule("if lockedMissionImportance is HIGH then Value is very LOW");
+		addRule("if lockedMissionImportance is MEDIUM then Value is somewhat LOW");
+		addRule("if lockedMissionImportance is LOW then Value is HIGH");
+		//pick nearby objects if it's easy, avoid long walks
+		addRule("if turnDistance is SMALL then Value is HIGH");
+		addRule("if turnDistance is MEDIUM then Value is MEDIUM");
+		addRule("if turnDistance is LONG then Value is LOW");
+	}
+	catch (fl::Exception & fe)
+	{
+		logAi->error("visitTile: %s",fe.getWhat());
+	}
+
+	configure(compile);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "fl/Headers.h"
+
+/*
+ * FuzzyEngines.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+*/
+
+/// Evaluator of fixed rule base of fuzzylite engine, prepared once instead of interpreting the rules on every process().
+/// Memberships of output terms at points sampled by centroid defuzzifier are tabulated, rules are flattened to arrays.
+/// It does same operations in same order as the interpreter, so results are identical.
+class CompiledFuzzyEngine
+{
+public:
+	CompiledFuzzyEngine();
+
+	/// Returns false if engine uses operator, hedge or defuzzifier that is not supported.
+	/// Engine must outlive this object and its variables, terms and rules must not change after compilation.
+	bool compile(const fl::Engine & engine);
+	bool isCompiled() const;
+
+	/// Same as fl::Engine::process(): reads input values of input variables and sets output values of output variables
+	void process();
+
+private:
+	enum EOperation {MEMBERSHIP, AND, OR};
+
+	struct Operation
+	{
+		EOperation type;
+		int membership; //index in memberships for MEMBERSHIP
+		std::vector<const fl::Hedge *> hedges; //applied in reverse order, as interpreter does
+	};
+
+	struct Conclusion
+	{
+		int output;
+		std::vector<fl::scalar> samples; //membership of term at points of centroid
+		std::vector<const fl::Hedge *> hedges;
+	};
+
+	struct Rule
+	{
+		fl::scalar weight;
+		std::vector<Operation> antecedent; //in postfix order
+		std::vector<Conclusion> conclusions;
+	};
+
+	struct Output
+	{
+		fl::OutputVariable * variable;
+		fl::scalar minimum, dx;
+		int resolution;
+	};
+
+	struct Activation
+	{
+		const std::vector<fl::scalar> * samples;
+		fl::scalar degree;
+	};
+
+	bool compiled;
+	std::vector<std::pair<const fl::InputVariable *, const fl::Term *>> propositions; //distinct input terms used by rules
+	std::vector<Rule> rules;
+	std::vector<Output> outputs;
+
+	std::vector<fl::scalar> memberships, stack, accumulated; //buffers of process()
+	std::vector<std::vector<Activation>> activations; //per output
+
+	bool compileExpression(const fl::Expression * expression, std::vector<Operation> & out);
+	int findOutput(const fl::Variable * variable) const;
+};
+
+/// Fuzzylite engine with one rule block, optionally evaluated by CompiledFuzzyEngine
+class engineBase
+{
+public:
+	fl::Engine engine;
+	fl::RuleBlock * rules; //owned by engine
+	CompiledFuzzyEngine compiled;
+
+	engineBase();
+	void configure(bool compile); //compile - use compiled evaluator if it supports the rules
+	void addRule(const std::string &txt);
+	void process();
+};
+
+/// Variables are owned by engine
+class TacticalAdvantage : public engineBase
+{
+public:
+	fl::InputVariable * ourWalkers, * ourShooters, * ourFlyers, * enemyWalkers, * enemyShooters, * enemyFlyers;
+	fl::InputVariable * ourSpeed, * enemySpeed;
+	fl::InputVariable * bankPresent;
+	fl::InputVariable * castleWalls;
+	fl::OutputVariable * threat;
+
+	TacticalAdvantage(bool compile);
+};
+
+class EvalVisitTile : public engineBase
+{
+public:
+	fl::InputVariable * strengthRatio;
+	fl::InputVariable * heroStrength;
+	fl::InputVariable * turnDistance;
+	fl::InputVariable * missionImportance;
+	fl::OutputVariable * value;
+
+	EvalVisitTile(double safeAttackConstant, bool compile);
+};
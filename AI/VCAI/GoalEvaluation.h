@@ -0,0 +1,106 @@
+#pragma once
+#include "../../lib/CThreadHelper.h"
+
+/*
+ * GoalEvaluation.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+*/
+
+const int EVALUATIONS_PER_THREAD = 8; //fewer candidate goals are evaluated on calling thread
+
+/// Evaluates all candidates and returns their priorities in the same order.
+/// Candidates accepted by isReentrant are evaluated concurrently, at least tasksPerThread of them on each thread;
+/// the others are evaluated before them, in order, on calling thread.
+/// Exception thrown by any evaluation is rethrown once all evaluations have ended.
+template <typename Candidate, typename IsReentrant, typename Evaluate>
+std::vector<float> evaluateCandidates(const std::vector<Candidate> & candidates, IsReentrant isReentrant, Evaluate evaluate, int tasksPerThread = EVALUATIONS_PER_THREAD)
+{
+	std::vector<float> priorities(candidates.size());
+	std::vector<std::exception_ptr> errors(candidates.size());
+	std::vector<Task> tasks;
+	for(size_t i = 0; i < candidates.size(); i++)
+	{
+		if(!isReentrant(candidates[i]))
+		{
+			priorities[i] = evaluate(candidates[i]);
+			continue;
+		}
+		tasks.push_back([&, i]()
+		{
+			try
+			{
+				priorities[i] = evaluate(candidates[i]);
+			}
+			catch(...)
+			{
+				errors[i] = std::current_exception();
+			}
+		});
+	}
+	{
+		boost::this_thread::disable_interruption noInterruption; //workers use our locals, we can't leave before they end
+		CThreadHelper::runTasks(tasks, tasksPerThread);
+	}
+	for(auto & error : errors)
+	{
+		if(error)
+			std::rethrow_exception(error);
+	}
+	return priorities;
+}
+
+/// Index of candidate with highest priority, the last one of equal ones; priorities must not be empty
+inline size_t bestCandidate(const std::vector<float> & priorities)
+{
+	size_t best = 0;
+	for(size_t i = 1; i < priorities.size(); i++)
+	{
+		if(priorities[i] >= priorities[best])
+			best = i;
+	}
+	return best;
+}
+
+/// Priorities of evaluated goals, shared by threads evaluating them.
+/// Remembered priority is valid while game revision and inputs of evaluation (stamp) are the same as when it was stored.
+template <typename Key, typename Stamp>
+class EvaluationMemo
+{
+	boost::mutex mx;
+	ui32 revision;
+	std::map<Key, std::pair<Stamp, float>> evaluations;
+
+public:
+	EvaluationMemo():
+		revision(0)
+	{
+	}
+
+	/// Remembered priority or result of evaluate(), which is called without lock, so it may run on many threads at once
+	template <typename Evaluate>
+	float get(const Key & key, ui32 gameRevision, const Stamp & stamp, Evaluate evaluate)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mx);
+			if(gameRevision > revision)
+			{
+				evaluations.clear();
+				revision = gameRevision;
+			}
+			auto it = evaluations.find(key);
+			if(revision == gameRevision && it != evaluations.end() && it->second.first == stamp)
+				return it->second.second;
+		}
+
+		const float priority = evaluate();
+		boost::unique_lock<boost::mutex> lock(mx);
+		if(revision == gameRevision)
+			evaluations[key] = std::make_pair(stamp, priority);
+		return priority;
+	}
+};
@@ -911,8 +911,9 @@ TSubgoal GatherTroops::whatToDoToAchieve()
 		// sorted helper
 		auto comparator = [](const TDwellMap::value_type & a, const TDwellMap::value_type & b) -> bool
 		{
-			const CGPathNode *ln = ai->myCb->getPathsInfo(a.first)->getPathInfo(a.second->visitablePos()),
-			                 *rn = ai->myCb->getPathsInfo(b.first)->getPathInfo(b.second->visitablePos());
+			auto lpaths = ai->getPathsInfo(a.first), rpaths = ai->getPathsInfo(b.first);
+			const CGPathNode *ln = lpaths->getPathInfo(a.second->visitablePos()),
+			                 *rn = rpaths->getPathInfo(b.second->visitablePos());
 
 			if(ln->turns != rn->turns)
 				return ln->turns < rn->turns;
@@ -3,6 +3,7 @@
 #include "Fuzzy.h"
 
 #include "../../lib/UnlockGuard.h"
+#include "../../lib/ScopeGuard.h"
 #include "../../lib/mapObjects/MapObjects.h"
 #include "../../lib/CConfigHandler.h"
 #include "../../lib/CHeroHandler.h"
@@ -35,60 +36,26 @@ boost::thread_specific_ptr<VCAI> ai;
 //std::map<int, std::map<int, int> > HeroView::infosCount;
 
 //helper RAII to manage global ai/cb ptrs
-struct SetGlobalState
+SetGlobalState::SetGlobalState(VCAI * AI)
 {
-	SetGlobalState(VCAI * AI)
-	{
-		assert(!ai.get());
-		assert(!cb.get());
-
-		ai.reset(AI);
-		cb.reset(AI->myCb.get());
-	}
-	~SetGlobalState()
-	{
-		ai.release();
-		cb.release();
-	}
-};
-
-
-#define SET_GLOBAL_STATE(ai) SetGlobalState _hlpSetState(ai);
-
-#define NET_EVENT_HANDLER SET_GLOBAL_STATE(this)
-#define MAKING_TURN SET_GLOBAL_STATE(this)
+	assert(!ai.get());
+	assert(!cb.get());
 
-unsigned char &retreiveTileN(std::vector< std::vector< std::vector<unsigned char> > > &vectors, const int3 &pos)
-{
-	return vectors[pos.x][pos.y][pos.z];
+	ai.reset(AI);
+	cb.reset(AI->myCb.get());
 }
 
-const unsigned char &retreiveTileN(const std::vector< std::vector< std::vector<unsigned char> > > &vectors, const int3 &pos)
+SetGlobalState::~SetGlobalState()
 {
-	return vectors[pos.x][pos.y][pos.z];
+	ai.release();
+	cb.release();
 }
 
-void foreach_tile(std::vector< std::vector< std::vector<unsigned char> > > &vectors, std::function<void(unsigned char &in)> foo)
-{
-	for(auto & vector : vectors)
-		for(auto j = vector.begin(); j != vector.end(); j++)
-			for(auto & elem : *j)
-				foo(elem);
-}
 
-struct ObjInfo
-{
-	int3 pos;
-	std::string name;
-	ObjInfo(){}
-	ObjInfo(const CGObjectInstance *obj):
-		pos(obj->pos),
-		name(obj->getObjectName())
-	{
-	}
-};
+#define SET_GLOBAL_STATE(ai) SetGlobalState _hlpSetState(ai);
 
-std::map<const CGObjectInstance *, ObjInfo> helperObjInfo;
+#define NET_EVENT_HANDLER SET_GLOBAL_STATE(this); BackgroundPlanner::EventScope _planningScope(planner); if(fh) fh->gameChanged()
+#define MAKING_TURN SET_GLOBAL_STATE(this)
 
 VCAI::VCAI(void)
 {
@@ -96,6 +63,7 @@ VCAI::VCAI(void)
 	makingTurn = nullptr;
 	destinationTeleport = ObjectInstanceID();
 	destinationTeleportPos = int3(-1);
+	sectorMap = std::make_shared<SectorMap>(); //explored on first use; never replaced, so event handlers can report changes to it any time
 }
 
 VCAI::~VCAI(void)
@@ -114,8 +82,12 @@ void VCAI::heroMoved(const TryMoveHero & details)
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
 
+	pathsCache.invalidate(); //moved hero doesn't block the same tiles
 	validateObject(details.id); //enemy hero may have left visible area
-	cachedSectorMaps.clear();
+	if(auto hero = cb->getObj(details.id, false))
+		rememberObject(hero); //or walked into it, no tile was revealed for us then
+	//objects on both tiles changed, boat may have been left or taken
+	sectorMap->tilesChanged({CGHeroInstance::convertPosition(details.start, false), CGHeroInstance::convertPosition(details.end, false)});
 
 	if(details.result == TryMoveHero::TELEPORTATION)
 	{
@@ -145,12 +117,14 @@ void VCAI::stackChagedCount(const StackLocation &location, const TQuantity &chan
 {
 	LOG_TRACE_PARAMS(logAi, "isAbsolute '%i'", isAbsolute);
 	NET_EVENT_HANDLER;
+	armyChanged(location.army);
 }
 
 void VCAI::heroInGarrisonChange(const CGTownInstance *town)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate();
 }
 
 void VCAI::centerView(int3 pos, int focusTime)
@@ -163,12 +137,15 @@ void VCAI::artifactMoved(const ArtifactLocation &src, const ArtifactLocation &ds
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(src.relatedObj());
+	armyChanged(dst.relatedObj());
 }
 
 void VCAI::artifactAssembled(const ArtifactLocation &al)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(al.relatedObj());
 }
 
 void VCAI::showTavernWindow(const CGObjectInstance *townOrTavern)
@@ -231,24 +208,28 @@ void VCAI::artifactPut(const ArtifactLocation &al)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(al.relatedObj());
 }
 
 void VCAI::artifactRemoved(const ArtifactLocation &al)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(al.relatedObj());
 }
 
 void VCAI::stacksErased(const StackLocation &location)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(location.army);
 }
 
 void VCAI::artifactDisassembled(const ArtifactLocation &al)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(al.relatedObj());
 }
 
 
@@ -286,7 +267,18 @@ void VCAI::tileHidden(const std::unordered_set<int3, ShashInt3> &pos)
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
 
-	validateVisitableObjs();
+	pathsCache.invalidate();
+	explorationFrontier.invalidate();
+
+	//only objects whose entrance got hidden may be out of sight now, they are dropped if they are
+	std::vector<ObjectInstanceID> onHiddenTiles;
+	for(auto & known : knownObjs)
+	{
+		if(pos.count(known.second->visitablePos()))
+			onHiddenTiles.push_back(known.first);
+	}
+	for(ObjectInstanceID id : onHiddenTiles)
+		validateObject(id);
 	clearPathsInfo();
 }
 
@@ -298,7 +290,10 @@ void VCAI::tileRevealed(const std::unordered_set<int3, ShashInt3> &pos)
 		for(const CGObjectInstance *obj : myCb->getVisitableObjs(tile))
 			addVisitableObj(obj);
 
-	clearPathsInfo();
+	heroesUnableToExplore.clear();
+	pathsCache.invalidate();
+	explorationFrontier.invalidate();
+	sectorMap->tilesChanged(std::vector<int3>(pos.begin(), pos.end()));
 }
 
 void VCAI::heroExchangeStarted(ObjectInstanceID hero1, ObjectInstanceID hero2, QueryID query)
@@ -363,42 +358,49 @@ void VCAI::heroMovePointsChanged(const CGHeroInstance * hero)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate(hero);
 }
 
 void VCAI::stackChangedType(const StackLocation &location, const CCreature &newType)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(location.army);
 }
 
 void VCAI::stacksRebalanced(const StackLocation &src, const StackLocation &dst, TQuantity count)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(src.army);
+	armyChanged(dst.army);
 }
 
 void VCAI::newObject(const CGObjectInstance * obj)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate();
 	if(obj->isVisitable())
 		addVisitableObj(obj);
 
-	cachedSectorMaps.clear();
+	sectorMap->objectChanged(obj);
 }
 
 void VCAI::objectRemoved(const CGObjectInstance *obj)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate();
 
 	vstd::erase_if_present(visitableObjs, obj);
 	vstd::erase_if_present(alreadyVisited, obj);
+	forgetObject(obj->id);
 
 	for (auto h : cb->getHeroesInfo())
 		unreserveObject(h, obj);
 
-	cachedSectorMaps.clear(); //invalidate all paths
+	sectorMap->objectChanged(obj); //object is still present, but its tiles will be free when sectors are updated
 
 	//TODO
 	//there are other places where CGObjectinstance ptrs are stored...
@@ -425,12 +427,14 @@ void VCAI::playerBonusChanged(const Bonus &bonus, bool gain)
 {
 	LOG_TRACE_PARAMS(logAi, "gain '%i'", gain);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate();
 }
 
 void VCAI::newStackInserted(const StackLocation &location, const CStackInstance &stack)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	armyChanged(location.army);
 }
 
 void VCAI::heroCreated(const CGHeroInstance* h)
@@ -468,6 +472,7 @@ void VCAI::requestRealized(PackageApplied *pa)
 	{
 		status.receivedAnswerConfirmation(pa->requestID, pa->result);
 	}
+	profiler.requestRealized(pa->requestID);
 }
 
 void VCAI::receivedResource(int type, int val)
@@ -498,12 +503,14 @@ void VCAI::heroSecondarySkillChanged(const CGHeroInstance * hero, int which, int
 {
 	LOG_TRACE_PARAMS(logAi, "which '%d', val '%d'", which % val);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate(hero);
 }
 
 void VCAI::battleResultsApplied()
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate();
 	assert(status.getBattle() == ENDING_BATTLE);
 	status.setBattle(NO_BATTLE);
 }
@@ -512,8 +519,13 @@ void VCAI::objectPropertyChanged(const SetObjectProperty * sop)
 {
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate(); //e.g. owner of garrison or passability of border gate
 	if(sop->what == ObjProperty::OWNER)
 	{
+		auto changed = myCb->getObj(sop->id, false);
+		if(changed && knownObjs.count(changed->id))
+			rememberObject(changed); //it may become ours or stop being ours
+
 		//we don't want to visit know object twice (do we really?)
 		if(sop->val == playerID.getNum())
 			vstd::erase_if_present(visitableObjs, myCb->getObj(sop->id));
@@ -540,6 +552,7 @@ void VCAI::heroBonusChanged(const CGHeroInstance *hero, const Bonus &bonus, bool
 {
 	LOG_TRACE_PARAMS(logAi, "gain '%i'", gain);
 	NET_EVENT_HANDLER;
+	pathsCache.invalidate(hero);
 }
 
 void VCAI::showMarketWindow(const IMarket *market, const CGHeroInstance *visitor)
@@ -569,6 +582,8 @@ void VCAI::init(std::shared_ptr<CCallback> CB)
 		fh = new FuzzyHelper();
 
 	retreiveVisitableObjs();
+	if(settings["server"]["aiBackgroundPlanning"].Bool())
+		planner.start(this);
 }
 
 void VCAI::yourTurn()
@@ -576,6 +591,7 @@ void VCAI::yourTurn()
 	LOG_TRACE(logAi);
 	NET_EVENT_HANDLER;
 	status.startedTurn();
+	planner.pause();
 	makingTurn = make_unique<boost::thread>(&VCAI::makeTurn, this);
 }
 
@@ -702,6 +718,8 @@ void makePossibleUpgrades(const CArmedInstance *obj)
 	if(!obj)
 		return;
 
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::BUYING);
+
 	for(int i = 0; i < GameConstants::ARMY_SIZE; i++)
 	{
 		if(const CStackInstance *s = obj->getStackPtr(SlotID(i)))
@@ -723,6 +741,9 @@ void VCAI::makeTurn()
 	MAKING_TURN;
 	boost::shared_lock<boost::shared_mutex> gsLock(cb->getGsMutex());
 	setThreadName("VCAI::makeTurn");
+	turnBudget.start(settings["server"]["aiTurnTimeLimit"].Float(), settings["server"]["aiHeroTimeLimit"].Float());
+	profiler.start(playerID, cb->getDate(Date::DAY));
+	pathsCache.clear(); //movement points were restored
 
 	switch(cb->getDate(Date::DAY_OF_WEEK))
 	{
@@ -745,13 +766,39 @@ void VCAI::makeTurn()
 	markHeroAbleToExplore (primaryHero());
 
 	makeTurnInternal();
+	planner.resume();
 	makingTurn.reset();
 
 	return;
 }
 
+bool VCAI::planAhead(size_t & step)
+{
+	//paths depend on movement points restored at start of turn, so only data which survive it are prepared;
+	//turn uses them after applying changes reported meanwhile
+	if(step == 0)
+	{
+		//exploring whole map takes long, it's done in parts so that gs and events are not held up
+		static const size_t TILES_PER_STEP = 4096;
+		if(sectorMap->applyChanges(TILES_PER_STEP))
+			step++;
+		return true;
+	}
+
+	auto heroes = cb->getHeroesInfo();
+	if(step > heroes.size())
+		return false;
+
+	HeroPtr h = heroes[step - 1];
+	sectorMap->prepare(h);
+	explorationFrontier.get(cb.get(), h->getSightRadius());
+	step++;
+	return true;
+}
+
 void VCAI::makeTurnInternal()
 {
+	auto onExit = vstd::makeScopeGuard([&]{ profiler.finish(); }); //trace is written also when turn is interrupted
 	saving = 0;
 
 	//it looks messy here, but it's better to have armed heroes before attempting realizing goals
@@ -764,6 +811,8 @@ void VCAI::makeTurnInternal()
 		auto reservedHeroesCopy = reservedHeroesMap; //work on copy => the map may be changed while iterating (eg because hero died when attempting a goal)
 		for (auto hero : reservedHeroesCopy)
 		{
+			if(!turnBudget.turnTimeLeft())
+				break;
 			if(reservedHeroesMap.count(hero.first))
 				continue; //hero might have been removed while we were in this loop
 			if(!hero.first.validAndSet())
@@ -771,6 +820,9 @@ void VCAI::makeTurnInternal()
 				logAi->error("Hero %s present on reserved map. Shouldn't be.", hero.first.name);
 				continue;
 			}
+			if(!turnBudget.heroTimeLeft(hero.first))
+				continue;
+			TurnBudget::HeroScope heroScope(turnBudget, hero.first);
 
 			std::vector<const CGObjectInstance *> vec(hero.second.begin(), hero.second.end());
 			boost::sort (vec, CDistanceSorter(hero.first.get()));
@@ -789,9 +841,10 @@ void VCAI::makeTurnInternal()
 		striveToGoal(sptr(Goals::Win()));
 
 		//finally, continue our abstract long-term goals
+		//the most important one is realized first, so if we run out of time the rest can wait for next turn
 		int oldMovement = 0;
 		int newMovement = 0;
-		while (true)
+		while (turnBudget.turnTimeLeft())
 		{
 			oldMovement = newMovement; //remember old value
 			newMovement = 0;
@@ -799,7 +852,7 @@ void VCAI::makeTurnInternal()
 			for (auto mission : lockedHeroes)
 			{
 				fh->setPriority (mission.second); //re-evaluate
-				if (canAct(mission.first))
+				if (canAct(mission.first) && turnBudget.heroTimeLeft(mission.first))
 				{
 					newMovement += mission.first->movement;
 					safeCopy.push_back (mission);
@@ -821,6 +874,7 @@ void VCAI::makeTurnInternal()
 					return m1.second->priority < m2.second->priority;
 				};
 				boost::sort(safeCopy, lockedHeroesSorter);
+				TurnBudget::HeroScope heroScope(turnBudget, safeCopy.back().first);
 				striveToGoal (safeCopy.back().second);
 			}
 		}
@@ -828,9 +882,12 @@ void VCAI::makeTurnInternal()
 		auto quests = myCb->getMyQuests();
 		for (auto quest : quests)
 		{
+			if(!turnBudget.turnTimeLeft())
+				break;
 			striveToQuest (quest);
 		}
 
+		//spending resources is cheap to plan, it's done even if we are out of time
 		striveToGoal(sptr(Goals::Build())); //TODO: smarter building management
 		performTypicalActions();
 
@@ -851,6 +908,8 @@ void VCAI::makeTurnInternal()
 		logAi->debug("Making turn thread has caught an exception: %s", e.what());
 	}
 
+	turnBudget.finish();
+	pathsCache.logStatistics();
 	endTurn();
 }
 
@@ -1108,6 +1167,7 @@ void VCAI::pickBestArtifacts(const CGHeroInstance * h, const CGHeroInstance * ot
 
 void VCAI::recruitCreatures(const CGDwelling * d, const CArmedInstance * recruiter)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::BUYING);
 	for(int i = 0; i < d->creatures.size(); i++)
 	{
 		if(!d->creatures[i].second.size())
@@ -1127,6 +1187,7 @@ void VCAI::recruitCreatures(const CGDwelling * d, const CArmedInstance * recruit
 
 bool VCAI::tryBuildStructure(const CGTownInstance * t, BuildingID building, unsigned int maxDays)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::BUYING);
 	if (maxDays == 0)
 	{
 		logAi->warn("Request to build building %d in 0 days!", building.toEnum());
@@ -1334,6 +1395,7 @@ static const BuildingID extra[] = {BuildingID::RESOURCE_SILO, BuildingID::SPECIA
 
 void VCAI::buildStructure(const CGTownInstance * t)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::BUYING);
 	//TODO make *real* town development system
 	//TODO: faction-specific development: use special buildings, build dwellings in better order, etc
 	//TODO: build resource silo, defences when needed
@@ -1447,9 +1509,8 @@ void VCAI::wander(HeroPtr h)
 
 	TimeCheck tc("looking for wander destination");
 
-	while (h->movement)
+	while (h->movement && turnBudget.turnTimeLeft() && turnBudget.heroTimeLeft(h))
 	{
-		validateVisitableObjs();
 		std::vector <ObjectIdRef> dests;
 
 		auto sm = getCachedSectorMap(h);
@@ -1648,6 +1709,7 @@ void VCAI::battleEnd(const BattleResult *br)
 
 void VCAI::waitTillFree()
 {
+	TurnProfiler::Scope scope(profiler, "wait", "waitTillFree");
 	auto unlock = vstd::makeUnlockSharedGuard(cb->getGsMutex());
 	status.waitTillFree();
 }
@@ -1689,7 +1751,13 @@ bool VCAI::isAbleToExplore (HeroPtr h)
 void VCAI::clearPathsInfo()
 {
 	heroesUnableToExplore.clear();
-	cachedSectorMaps.clear();
+	sectorMap->invalidate(); //hidden tiles may split sectors, explore everything again
+}
+
+void VCAI::armyChanged(const CArmedInstance * army)
+{
+	if(auto hero = dynamic_cast<const CGHeroInstance *>(army))
+		pathsCache.invalidate(hero);
 }
 
 void VCAI::validateVisitableObjs()
@@ -1724,47 +1792,61 @@ void VCAI::validateVisitableObjs()
 	//TODO overkill, hidden object should not be removed. However, we can't know if hidden object is erased from game.
 	errorMsg = " shouldn't be on the already visited objs list!";
 	vstd::erase_if(alreadyVisited, shouldBeErased);
+
+	typedef std::pair<const ObjectInstanceID, const CGObjectInstance *> TKnownObj;
+	vstd::erase_if(knownObjs, [this](const TKnownObj & known){ return !cb->getObj(known.first, false); });
+	vstd::erase_if(flaggedObjs, [this](const TKnownObj & flagged){ return !knownObjs.count(flagged.first); });
 }
 
 void VCAI::retreiveVisitableObjs(std::vector<const CGObjectInstance *> &out, bool includeOwned /*= false*/) const
 {
-	foreach_tile_pos([&](const int3 &pos)
+	for(auto & known : knownObjs)
 	{
-		for(const CGObjectInstance *obj : myCb->getVisitableObjs(pos, false))
-		{
-			if(includeOwned || obj->tempOwner != playerID)
-				out.push_back(obj);
-		}
-	});
+		if(includeOwned || known.second->tempOwner != playerID)
+			out.push_back(known.second);
+	}
 }
 
 void VCAI::retreiveVisitableObjs()
 {
-	foreach_tile_pos([&](const int3 &pos)
+	for(int level = 0; level < cb->getMapSize().z; level++)
 	{
-		for(const CGObjectInstance *obj : myCb->getVisitableObjs(pos, false))
+		for(const CGObjectInstance *obj : myCb->getVisitableObjsInRange(int3(0, 0, level), -1))
 		{
+			rememberObject(obj);
 			if(obj->tempOwner != playerID)
 				addVisitableObj(obj);
 		}
-	});
+	}
 }
 
 std::vector<const CGObjectInstance *> VCAI::getFlaggedObjects() const
 {
 	std::vector<const CGObjectInstance *> ret;
-	for(const CGObjectInstance *obj : visitableObjs)
-	{
-		if(obj->tempOwner == playerID)
-			ret.push_back(obj);
-	}
+	for(auto & flagged : flaggedObjs)
+		ret.push_back(flagged.second);
 	return ret;
 }
 
+void VCAI::rememberObject(const CGObjectInstance *obj)
+{
+	knownObjs[obj->id] = obj;
+	if(obj->tempOwner == playerID)
+		flaggedObjs[obj->id] = obj;
+	else
+		flaggedObjs.erase(obj->id);
+}
+
+void VCAI::forgetObject(ObjectInstanceID id)
+{
+	knownObjs.erase(id);
+	flaggedObjs.erase(id);
+}
+
 void VCAI::addVisitableObj(const CGObjectInstance *obj)
 {
 	visitableObjs.insert(obj);
-	helperObjInfo[obj] = ObjInfo(obj);
+	rememberObject(obj);
 
 	// All teleport objects seen automatically assigned to appropriate channels
 	auto teleportObj = dynamic_cast<const CGTeleport *>(obj);
@@ -1819,6 +1901,7 @@ const CGObjectInstance * VCAI::getUnvisitedObj(const std::function<bool(const CG
 
 bool VCAI::isAccessibleForHero(const int3 & pos, HeroPtr h, bool includeAllies /*= false*/) const
 {
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::PATHFINDING);
 	if (!includeAllies)
 	{ //don't visit tile occupied by allied hero
 		for (auto obj : cb->getVisitableObjs(pos))
@@ -1829,7 +1912,16 @@ bool VCAI::isAccessibleForHero(const int3 & pos, HeroPtr h, bool includeAllies /
 				return false;
 		}
 	}
-	return cb->getPathsInfo(h.get())->getPathInfo(pos)->reachable();
+	return ai->getPathsInfo(h.get())->getPathInfo(pos)->reachable();
+}
+
+std::shared_ptr<const CPathsInfo> VCAI::getPathsInfo(const CGHeroInstance * h)
+{
+	TurnBudget::Phase phase(turnBudget, TurnBudget::PATHFINDING);
+	TurnProfiler::Scope scope(profiler, "pathfinder", "getPathsInfo");
+	if(scope.active)
+		scope.args["hero"].String() = h->name;
+	return pathsCache.get(myCb.get(), h);
 }
 
 bool VCAI::moveHeroToTile(int3 dst, HeroPtr h)
@@ -1862,7 +1954,7 @@ bool VCAI::moveHeroToTile(int3 dst, HeroPtr h)
 	else
 	{
 		CGPath path;
-		cb->getPathsInfo(h.get())->getPath(path, dst);
+		getPathsInfo(h.get())->getPath(path, dst);
 		if(path.nodes.empty())
 		{
 			logAi->error("Hero %s cannot reach %s.", h->name, dst());
@@ -2059,6 +2151,7 @@ void VCAI::tryRealize(Goals::VisitHero & g)
 
 void VCAI::tryRealize(Goals::BuildThis & g)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::BUYING);
 	const CGTownInstance *t = g.town;
 
 	if(!t && g.hero)
@@ -2103,6 +2196,7 @@ void VCAI::tryRealize(Goals::DigAtTile & g)
 
 void VCAI::tryRealize(Goals::CollectRes & g)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::BUYING);
 	if(cb->getResourceAmount(static_cast<Res::ERes>(g.resID)) >= g.value)
 	throw cannotFulfillGoalException("Goal is already fulfilled!");
 
@@ -2243,6 +2337,10 @@ void VCAI::striveToGoal(Goals::TSubgoal ultimateGoal)
 	if (ultimateGoal->invalid())
 		return;
 
+	TurnProfiler::Scope scope(profiler, "goal", "striveToGoal");
+	if(scope.active)
+		scope.args["goal"].String() = ultimateGoal->name();
+
 	//we are looking for abstract goals
 	auto abstractGoal = striveToGoalInternal (ultimateGoal, false);
 
@@ -2261,8 +2359,15 @@ Goals::TSubgoal VCAI::striveToGoalInternal(Goals::TSubgoal ultimateGoal, bool on
 	const int searchDepth2 = searchDepth-2;
 	Goals::TSubgoal abstractGoal = sptr(Goals::Invalid());
 
-	while(1)
+	for(bool firstStep = true; ; firstStep = false)
 	{
+		if(!firstStep && !turnBudget.turnTimeLeft())
+		{
+			//anytime planning - steps realized so far were the best ones we found, stop looking for more
+			logAi->debugStream() << boost::format("Turn time budget exhausted, stopping realization of goal %s") % ultimateGoal->name();
+			break;
+		}
+
 		Goals::TSubgoal goal = ultimateGoal;
 		logAi->debugStream() << boost::format("Striving to goal of type %s") % ultimateGoal->name();
 		int maxGoals = searchDepth; //preventing deadlock for mutually dependent goals
@@ -2272,6 +2377,13 @@ Goals::TSubgoal VCAI::striveToGoalInternal(Goals::TSubgoal ultimateGoal, bool on
 			try
 			{
 				boost::this_thread::interruption_point();
+				TurnBudget::Phase phase(turnBudget, TurnBudget::DECOMPOSITION);
+				TurnProfiler::Scope scope(profiler, "goal", "whatToDoToAchieve");
+				if(scope.active)
+				{
+					scope.args["goal"].String() = goal->name();
+					scope.args["depth"].Float() = searchDepth - maxGoals;
+				}
 				goal = goal->whatToDoToAchieve();
 				--maxGoals;
 				if (*goal == *ultimateGoal) //compare objects by value
@@ -2494,8 +2606,14 @@ void VCAI::performTypicalActions()
 		logAi->debugStream() << boost::format("Looking into %s, MP=%d") % h->name.c_str() % h->movement;
 		makePossibleUpgrades(*h);
 		pickBestArtifacts(*h);
+		if(!turnBudget.turnTimeLeft() || !turnBudget.heroTimeLeft(h))
+		{
+			logAi->debugStream() << boost::format("No time left to plan moves of %s") % h->name;
+			continue;
+		}
 		try
 		{
+			TurnBudget::HeroScope heroScope(turnBudget, h);
 			wander(h);
 		}
 		catch(std::exception &e)
@@ -2516,6 +2634,7 @@ void VCAI::buildArmyIn(const CGTownInstance * t)
 
 int3 VCAI::explorationBestNeighbour(int3 hpos, int radius, HeroPtr h)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::PATHFINDING);
 	int3 ourPos = h->convertPosition(h->pos, false);
 	std::map<int3, int> dstToRevealedTiles;
 	for(crint3 dir : int3::getDirs())
@@ -2527,10 +2646,11 @@ int3 VCAI::explorationBestNeighbour(int3 hpos, int radius, HeroPtr h)
 	if (dstToRevealedTiles.empty()) //yes, it DID happen!
 		throw cannotFulfillGoalException("No neighbour will bring new discoveries!");
 
+	auto paths = getPathsInfo(h.get());
 	auto best = dstToRevealedTiles.begin();
 	for (auto i = dstToRevealedTiles.begin(); i != dstToRevealedTiles.end(); i++)
 	{
-		const CGPathNode *pn = cb->getPathsInfo(h.get())->getPathInfo(i->first);
+		const CGPathNode *pn = paths->getPathInfo(i->first);
 		//const TerrainTile *t = cb->getTile(i->first);
 		if(best->second < i->second && pn->reachable() && pn->accessible == CGPathNode::ACCESSIBLE)
 			best = i;
@@ -2544,18 +2664,13 @@ int3 VCAI::explorationBestNeighbour(int3 hpos, int radius, HeroPtr h)
 
 int3 VCAI::explorationNewPoint(HeroPtr h)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::PATHFINDING);
 	int radius = h->getSightRadius();
 	CCallback * cbp = cb.get();
 	const CGHeroInstance * hero = h.get();
-
-	std::vector<std::vector<int3> > tiles; //tiles[distance_to_fow]
-	tiles.resize(radius);
-
-	foreach_tile_pos([&](const int3 &pos)
-	{
-		if(!cbp->isVisible(pos))
-			tiles[0].push_back(pos);
-	});
+	auto paths = getPathsInfo(hero);
+	auto frontier = explorationFrontier.get(cbp, radius);
+	const auto & tiles = *frontier; //tiles[distance_to_fow]
 
 	float bestValue = 0; //discovered tile to node distance ratio
 	int3 bestTile(-1,-1,-1);
@@ -2563,18 +2678,17 @@ int3 VCAI::explorationNewPoint(HeroPtr h)
 
 	for (int i = 1; i < radius; i++)
 	{
-		getVisibleNeighbours(tiles[i-1], tiles[i]);
-		vstd::removeDuplicates(tiles[i]);
-
 		for(const int3 &tile : tiles[i])
 		{
 			if (tile == ourPos) //shouldn't happen, but it does
 				continue;
-			if (!cb->getPathsInfo(hero)->getPathInfo(tile)->reachable()) //this will remove tiles that are guarded by monsters (or removable objects)
+			if (!paths->getPathInfo(tile)->reachable()) //this will remove tiles that are guarded by monsters (or removable objects)
 				continue;
 
 			CGPath path;
-			cb->getPathsInfo(hero)->getPath(path, tile);
+			paths->getPath(path, tile);
+			if ((float)howManyTilesCanBeDiscovered(tile, radius, cbp) / (path.nodes.size() + 1) <= bestValue) //cheap upper bound, exact count can't be better
+				continue;
 			float ourValue = (float)howManyTilesWillBeDiscovered(tile, radius, cbp) / (path.nodes.size() + 1); //+1 prevents erratic jumps
 
 			if (ourValue > bestValue) //avoid costly checks of tiles that don't reveal much
@@ -2592,33 +2706,23 @@ int3 VCAI::explorationNewPoint(HeroPtr h)
 
 int3 VCAI::explorationDesperate(HeroPtr h)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::PATHFINDING);
 	auto sm = getCachedSectorMap(h);
 	int radius = h->getSightRadius();
-
-	std::vector<std::vector<int3> > tiles; //tiles[distance_to_fow]
-	tiles.resize(radius);
-
 	CCallback * cbp = cb.get();
-
-	foreach_tile_pos([&](const int3 &pos)
-	{
-		if(!cbp->isVisible(pos))
-			tiles[0].push_back(pos);
-	});
+	auto frontier = explorationFrontier.get(cbp, radius);
+	const auto & tiles = *frontier; //tiles[distance_to_fow]
 
 	ui64 lowestDanger = -1;
 	int3 bestTile(-1,-1,-1);
 
 	for(int i = 1; i < radius; i++)
 	{
-		getVisibleNeighbours(tiles[i-1], tiles[i]);
-		vstd::removeDuplicates(tiles[i]);
-
 		for(const int3 &tile : tiles[i])
 		{
 			if (cbp->getTile(tile)->blocked) //does it shorten the time?
 				continue;
-			if (!howManyTilesWillBeDiscovered(tile, radius, cbp)) //avoid costly checks of tiles that don't reveal much
+			if (!howManyTilesCanBeDiscovered(tile, radius, cbp) || !howManyTilesWillBeDiscovered(tile, radius, cbp)) //avoid costly checks of tiles that don't reveal much
 				continue;
 
 			auto t = sm->firstTileToGet(h, tile);
@@ -2699,6 +2803,7 @@ void VCAI::checkHeroArmy (HeroPtr h)
 
 void VCAI::recruitHero(const CGTownInstance * t, bool throwing)
 {
+	TurnBudget::Phase phase(turnBudget, TurnBudget::BUYING);
 	logAi->debugStream() << boost::format("Trying to recruit a hero in %s at %s") % t->name % t->visitablePos();
 
 	auto heroes = cb->getAvailableHeroes(t);
@@ -2720,6 +2825,7 @@ void VCAI::finish()
 {
 	if(makingTurn)
 		makingTurn->interrupt();
+	planner.interrupt();
 }
 
 void VCAI::requestActionASAP(std::function<void()> whatToDo)
@@ -2743,7 +2849,7 @@ void VCAI::lostHero(HeroPtr h)
 		vstd::erase_if_present(reservedObjs, obj); //unreserve all objects for that hero
 	}
 	vstd::erase_if_present(reservedHeroesMap, h);
-	vstd::erase_if_present(cachedSectorMaps, h);
+	sectorMap->forgetHero(h);
 }
 
 void VCAI::answerQuery(QueryID queryID, int selection)
@@ -2763,6 +2869,7 @@ void VCAI::answerQuery(QueryID queryID, int selection)
 void VCAI::requestSent(const CPackForServer *pack, int requestID)
 {
 	//BNLOG("I have sent request of type %s", typeid(*pack).name());
+	profiler.requestSent(requestID, pack);
 	if(auto reply = dynamic_cast<const QueryReply*>(pack))
 	{
 		status.attemptedAnsweringQuery(reply->qid, requestID);
@@ -2784,16 +2891,27 @@ void VCAI::validateObject(const CGObjectInstance *obj)
 
 void VCAI::validateObject(ObjectIdRef obj)
 {
-	auto matchesId = [&](const CGObjectInstance *hlpObj) -> bool { return hlpObj->id == obj.id; };
-	if(!obj)
-	{
-		vstd::erase_if(visitableObjs, matchesId);
+	if(obj)
+		return;
 
+	auto known = knownObjs.find(obj.id);
+	if(known != knownObjs.end())
+	{
+		const CGObjectInstance *hlpObj = known->second;
+		visitableObjs.erase(hlpObj);
 		for(auto &p : reservedHeroesMap)
-			vstd::erase_if(p.second, matchesId);
-
-		vstd::erase_if(reservedObjs, matchesId);
+			p.second.erase(hlpObj);
+		reservedObjs.erase(hlpObj);
+		forgetObject(obj.id);
+		return;
 	}
+
+	//object may be on lists without being known, e.g. after loading game; look for it by id
+	auto matchesId = [&](const CGObjectInstance *hlpObj) -> bool { return hlpObj->id == obj.id; };
+	vstd::erase_if(visitableObjs, matchesId);
+	for(auto &p : reservedHeroesMap)
+		vstd::erase_if(p.second, matchesId);
+	vstd::erase_if(reservedObjs, matchesId);
 }
 
 TResources VCAI::freeResources() const
@@ -2806,13 +2924,91 @@ TResources VCAI::freeResources() const
 
 std::shared_ptr<SectorMap> VCAI::getCachedSectorMap(HeroPtr h)
 {
-	auto it = cachedSectorMaps.find(h);
-	if (it != cachedSectorMaps.end())
-		return it->second;
-	else
+	TurnBudget::Phase phase(turnBudget, TurnBudget::PATHFINDING);
+	sectorMap->applyChanges();
+	return sectorMap;
+}
+
+BackgroundPlanner::EventScope::EventScope(BackgroundPlanner & planner):
+	planner(planner), lock(planner.mx)
+{
+}
+
+BackgroundPlanner::EventScope::~EventScope()
+{
+	planner.revision++;
+	planner.cv.notify_one();
+}
+
+BackgroundPlanner::BackgroundPlanner():
+	paused(false), revision(0), plannedRevision(0)
+{
+}
+
+BackgroundPlanner::~BackgroundPlanner()
+{
+	if(thread)
+	{
+		thread->interrupt();
+		thread->join();
+	}
+}
+
+void BackgroundPlanner::start(VCAI * ai)
+{
+	if(!thread)
+		thread = make_unique<boost::thread>(&BackgroundPlanner::run, this, ai);
+}
+
+void BackgroundPlanner::interrupt()
+{
+	if(thread)
+		thread->interrupt();
+}
+
+void BackgroundPlanner::pause()
+{
+	paused = true;
+}
+
+void BackgroundPlanner::resume()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	paused = false;
+	revision++; //turn has changed everything
+	cv.notify_one();
+}
+
+void BackgroundPlanner::run(VCAI * ai)
+{
+	setThreadName("VCAI::BackgroundPlanner");
+	SET_GLOBAL_STATE(ai);
+	try
 	{
-		cachedSectorMaps[h] = std::make_shared<SectorMap>(h);
-		return cachedSectorMaps[h];
+		boost::unique_lock<boost::mutex> lock(mx);
+		while(true)
+		{
+			while(paused || plannedRevision == revision)
+				cv.wait(lock);
+
+			plannedRevision = revision;
+			for(size_t step = 0; !paused && plannedRevision == revision;)
+			{
+				{
+					boost::shared_lock<boost::shared_mutex> gsLock(cb->getGsMutex());
+					if(!ai->planAhead(step))
+						break;
+				}
+				//let events in between steps, they restart planning
+				lock.unlock();
+				boost::this_thread::interruption_point();
+				lock.lock();
+			}
+		}
+	}
+	catch(boost::thread_interrupted & e)
+	{
+		logAi->debug("Background planning stopped");
 	}
 }
 
@@ -2969,18 +3165,50 @@ bool AIStatus::channelProbing()
 	return ongoingChannelProbing;
 }
 
-SectorMap::SectorMap()
+SectorMap::SectorMap():
+	outdated(true), revision(0), exploredTile(0), exploredSector(-1)
 {
-	update();
 }
 
-SectorMap::SectorMap(HeroPtr h)
+size_t SectorMap::tileIndex(crint3 pos) const
 {
-	update();
-	makeParentBFS(h->visitablePos());
+	return (size_t(pos.z) * sizes.y + pos.y) * sizes.x + pos.x;
 }
 
-bool SectorMap::markIfBlocked(ui8 &sec, crint3 pos, const TerrainTile *t)
+int3 SectorMap::tilePos(size_t index) const
+{
+	return int3(index % sizes.x, (index / sizes.x) % sizes.y, index / (size_t(sizes.x) * sizes.y));
+}
+
+int SectorMap::findRoot(int label)
+{
+	while(sectorParent[label] != label)
+	{
+		sectorParent[label] = sectorParent[sectorParent[label]]; //path halving
+		label = sectorParent[label];
+	}
+	return label;
+}
+
+int SectorMap::joinSectors(int a, int b)
+{
+	a = findRoot(a);
+	b = findRoot(b);
+	if(a == b)
+		return a;
+
+	if(infoOnSectors[a].tiles.size() < infoOnSectors[b].tiles.size())
+		std::swap(a, b); //move tiles of smaller sector
+
+	Sector &to = infoOnSectors[a], &from = infoOnSectors[b];
+	range::copy(from.tiles, std::back_inserter(to.tiles));
+	to.dirty = true;
+	infoOnSectors.erase(b);
+	sectorParent[b] = a;
+	return a;
+}
+
+bool SectorMap::markIfBlocked(si32 &sec, const TerrainTile *t)
 {
 	if(t->blocked && !t->visitable)
 	{
@@ -2991,53 +3219,96 @@ bool SectorMap::markIfBlocked(ui8 &sec, crint3 pos, const TerrainTile *t)
 	return false;
 }
 
-bool SectorMap::markIfBlocked(ui8 &sec, crint3 pos)
-{
-	return markIfBlocked(sec, pos, getTile(pos));
-}
-
 void SectorMap::update()
 {
-	visibleTiles = cb->getAllVisibleTiles();
-
 	clear();
-	int curSector = 3; //0 is invisible, 1 is not explored
+	exploreMap(std::numeric_limits<size_t>::max());
+}
 
+bool SectorMap::exploreMap(size_t maxTiles)
+{
 	CCallback * cbp = cb.get(); //optimization
-	foreach_tile_pos([&](crint3 pos)
+	while(exploreSector(cbp, maxTiles))
 	{
-		if(retreiveTile(pos) == NOT_CHECKED)
-		{
-			if(!markIfBlocked(retreiveTile(pos), pos))
-				exploreNewSector(pos, curSector++, cbp);
-		}
-	});
-	valid = true;
+		while(exploredTile < sector.size() && (sector[exploredTile] != NOT_CHECKED || markIfBlocked(sector[exploredTile], tiles[exploredTile])))
+			exploredTile++;
+		if(exploredTile == sector.size())
+			return true;
+
+		beginSector(tilePos(exploredTile));
+	}
+	return false;
 }
 
 void SectorMap::clear()
 {
-	sector = cb->getVisibilityMap();
-	valid = false;
+	auto visibleTiles = cb->getAllVisibleTiles();
+	sizes = cb->getMapSize();
+
+	const size_t count = size_t(sizes.x) * sizes.y * sizes.z;
+	sector.assign(count, NOT_VISIBLE);
+	tiles.assign(count, nullptr);
+	for(size_t i = 0; i < count; i++)
+	{
+		const int3 pos = tilePos(i);
+		tiles[i] = (*visibleTiles)[pos.x][pos.y][pos.z];
+		if(tiles[i])
+			sector[i] = NOT_CHECKED;
+	}
+
+	sectorParent.clear();
+	for(int i = NOT_VISIBLE; i <= NOT_AVAILABLE; i++)
+		sectorParent.push_back(i); //so that special values are their own roots
+	infoOnSectors.clear();
+	heroTrees.clear();
+	revision++;
+
+	exploredTile = 0;
+	exploredSector = -1;
+	toVisit = std::queue<int3>();
+	adjacentSectors.clear();
+}
+
+void SectorMap::exploreNewSector(crint3 pos, CCallback * cbp)
+{
+	size_t maxTiles = std::numeric_limits<size_t>::max();
+	beginSector(pos);
+	exploreSector(cbp, maxTiles);
 }
 
-void SectorMap::exploreNewSector(crint3 pos, int num, CCallback * cbp)
+void SectorMap::beginSector(crint3 pos)
 {
+	const int num = sectorParent.size();
+	sectorParent.push_back(num);
+
 	Sector &s = infoOnSectors[num];
 	s.id = num;
 	s.water = getTile(pos)->isWater();
 
-	std::queue<int3> toVisit;
+	exploredSector = num;
 	toVisit.push(pos);
+}
+
+bool SectorMap::exploreSector(CCallback * cbp, size_t & maxTiles)
+{
+	if(exploredSector < 0)
+		return true;
+
+	const int num = exploredSector;
+	Sector &s = infoOnSectors[num];
 	while(!toVisit.empty())
 	{
+		if(!maxTiles)
+			return false;
+		maxTiles--;
+
 		int3 curPos = toVisit.front();
 		toVisit.pop();
-		ui8 &sec = retreiveTile(curPos);
+		si32 &sec = sector[tileIndex(curPos)];
 		if(sec == NOT_CHECKED)
 		{
 			const TerrainTile *t = getTile(curPos);
-			if(!markIfBlocked(sec, curPos, t))
+			if(!markIfBlocked(sec, t))
 			{
 				if(t->isWater() == s.water) //sector is only-water or only-land
 				{
@@ -3045,42 +3316,195 @@ void SectorMap::exploreNewSector(crint3 pos, int num, CCallback * cbp)
 					s.tiles.push_back(curPos);
 					foreach_neighbour(cbp, curPos, [&](CCallback * cbp, crint3 neighPos)
 					{
-						if(retreiveTile(neighPos) == NOT_CHECKED)
-						{
+						const si32 neighSec = sector[tileIndex(neighPos)];
+						if(neighSec == NOT_CHECKED)
 							toVisit.push(neighPos);
-							//parent[neighPos] = curPos;
-						}
-						const TerrainTile *nt = getTile(neighPos);
-						if(nt && nt->isWater() != s.water && canBeEmbarkmentPoint(nt, s.water))
-						{
-							s.embarkmentPoints.push_back(neighPos);
-						}
+						else if(neighSec > NOT_AVAILABLE && neighSec != num && getTile(neighPos)->isWater() == s.water)
+							adjacentSectors.insert(neighSec);
 					});
-
-					if(t->visitable)
-					{
-						auto obj = t->visitableObjects.front();
-						if(cb->getObj(obj->id, false)) // FIXME: we have to filter invisible objcts like events, but probably TerrainTile shouldn't be used in SectorMap at all
-							s.visitableObjs.push_back(obj);
-					}
 				}
 			}
 		}
 	}
 
+	int joined = num;
+	for(int adjacent : adjacentSectors)
+		joined = joinSectors(joined, adjacent);
+	adjacentSectors.clear();
+	exploredSector = -1;
+	return true;
+}
+
+void SectorMap::collectSectorInfo(Sector & s, CCallback * cbp)
+{
+	s.embarkmentPoints.clear();
+	s.visitableObjs.clear();
+	for(crint3 pos : s.tiles)
+	{
+		foreach_neighbour(cbp, pos, [&](CCallback * cbp, crint3 neighPos)
+		{
+			const TerrainTile *nt = getTile(neighPos);
+			if(nt && nt->isWater() != s.water && canBeEmbarkmentPoint(nt, s.water))
+			{
+				s.embarkmentPoints.push_back(neighPos);
+			}
+		});
+
+		const TerrainTile *t = getTile(pos);
+		if(t->visitable)
+		{
+			auto obj = t->visitableObjects.front();
+			if(cbp->getObj(obj->id, false)) // FIXME: we have to filter invisible objcts like events, but probably TerrainTile shouldn't be used in SectorMap at all
+				s.visitableObjs.push_back(obj);
+		}
+	}
+
 	vstd::removeDuplicates(s.embarkmentPoints);
+	s.dirty = false;
+}
+
+void SectorMap::tilesChanged(const std::vector<int3> & changed)
+{
+	boost::unique_lock<boost::mutex> lock(changesMx);
+	range::copy(changed, std::back_inserter(changedTiles));
+}
+
+void SectorMap::invalidate()
+{
+	boost::unique_lock<boost::mutex> lock(changesMx);
+	outdated = true;
+}
+
+void SectorMap::objectChanged(const CGObjectInstance * obj)
+{
+	std::vector<int3> changed;
+	range::copy(obj->getBlockedPos(), std::back_inserter(changed));
+	if(obj->isVisitable())
+		changed.push_back(obj->visitablePos());
+	tilesChanged(changed);
+}
+
+bool SectorMap::applyChanges(size_t maxTiles)
+{
+	std::vector<int3> changed;
+	std::vector<HeroPtr> forgotten;
+	bool all;
+	{
+		boost::unique_lock<boost::mutex> lock(changesMx);
+		forgotten.swap(forgottenHeroes);
+		all = outdated;
+		outdated = false;
+		if(all)
+			changedTiles.clear(); //changes reported from now on will be applied to new sectors, earlier ones are included
+	}
+	for(auto h : forgotten)
+		vstd::erase_if_present(heroTrees, h);
+
+	if(all || sectorParent.size() > sector.size()) //explicitly requested or too many labels of removed sectors, start again
+		clear();
+	if(!exploreMap(maxTiles))
+		return false; //changes wait till whole map is explored
+
+	{
+		boost::unique_lock<boost::mutex> lock(changesMx);
+		changed.swap(changedTiles);
+	}
+	if(changed.empty())
+		return true;
+
+	CCallback * cbp = cb.get();
+	std::set<int> splitSectors; //some of their tiles are no longer accessible, have to be explored again
+	std::set<int> changedSectors; //only embarkment points or objects may have changed
+	std::vector<int3> toExplore;
+	for(crint3 pos : changed)
+	{
+		if(!cbp->isInTheMap(pos))
+			continue;
+
+		const size_t index = tileIndex(pos);
+		const TerrainTile *t = cbp->getTile(pos, false);
+		tiles[index] = t;
+		if(sector[index] > NOT_AVAILABLE)
+		{
+			if(!t || (t->blocked && !t->visitable))
+				splitSectors.insert(findRoot(sector[index]));
+			else
+				changedSectors.insert(findRoot(sector[index]));
+		}
+		else
+		{
+			sector[index] = t ? NOT_CHECKED : NOT_VISIBLE;
+			toExplore.push_back(pos);
+		}
+
+		foreach_neighbour(cbp, pos, [&](CCallback * cbp, crint3 neighPos)
+		{
+			const si32 neighSec = sector[tileIndex(neighPos)];
+			if(neighSec > NOT_AVAILABLE)
+				changedSectors.insert(findRoot(neighSec));
+		});
+	}
+
+	for(int id : splitSectors)
+	{
+		for(crint3 pos : infoOnSectors[id].tiles)
+		{
+			const size_t index = tileIndex(pos);
+			sector[index] = tiles[index] ? NOT_CHECKED : NOT_VISIBLE;
+			toExplore.push_back(pos);
+		}
+		infoOnSectors.erase(id);
+	}
+
+	bool labelsChanged = !splitSectors.empty();
+	for(crint3 pos : toExplore)
+	{
+		si32 &sec = sector[tileIndex(pos)];
+		if(sec == NOT_CHECKED && !markIfBlocked(sec, getTile(pos)))
+		{
+			exploreNewSector(pos, cbp);
+			labelsChanged = true;
+		}
+	}
+
+	for(int id : changedSectors)
+	{
+		auto it = infoOnSectors.find(findRoot(id));
+		if(it != infoOnSectors.end())
+			it->second.dirty = true;
+	}
+
+	if(labelsChanged)
+	{
+		revision++; //paths of heroes have to be found again
+	}
+	else
+	{
+		//tiles stayed in their sectors, but objects on them decide where heroes can move inside sector
+		vstd::erase_if(heroTrees, [&](const std::pair<const HeroPtr, HeroTree> & elem)
+		{
+			return vstd::contains(changedSectors, getSectorId(elem.second.source));
+		});
+	}
+	return true;
+}
+
+void SectorMap::forgetHero(HeroPtr h)
+{
+	boost::unique_lock<boost::mutex> lock(changesMx);
+	forgottenHeroes.push_back(h);
 }
 
 void SectorMap::write(crstring fname)
 {
 	std::ofstream out(fname);
-	for(int k = 0; k < cb->getMapSize().z; k++)
+	for(int k = 0; k < sizes.z; k++)
 	{
-		for(int j = 0; j < cb->getMapSize().y; j++)
+		for(int j = 0; j < sizes.y; j++)
 		{
-			for(int i = 0; i < cb->getMapSize().x; i++)
+			for(int i = 0; i < sizes.x; i++)
 			{
-				out << (int)sector[i][j][k] << '\t';
+				out << getSectorId(int3(i, j, k)) << '\t';
 			}
 			out << std::endl;
 		}
@@ -3217,13 +3641,14 @@ this functions returns one target tile or invalid tile. We will use it to poll p
 For ship construction etc, another function (goal?) is needed
 */
 {
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::PATHFINDING);
 	int3 ret(-1,-1,-1);
 
-	int sourceSector = retreiveTile(h->visitablePos()),
-		destinationSector = retreiveTile(dst);
+	int sourceSector = getSectorId(h->visitablePos()),
+		destinationSector = getSectorId(dst);
 
-	const Sector *src = &infoOnSectors[sourceSector],
-		*dest = &infoOnSectors[destinationSector];
+	const Sector *src = &getSector(sourceSector),
+		*dest = &getSector(destinationSector);
 
 	if(sourceSector != destinationSector) //use ships, shipyards etc..
 	{
@@ -3240,7 +3665,7 @@ For ship construction etc, another function (goal?) is needed
 
 			for(int3 ep : s->embarkmentPoints)
 			{
-				Sector *neigh = &infoOnSectors[retreiveTile(ep)];
+				Sector *neigh = &getSector(getSectorId(ep));
 				//preds[s].push_back(neigh);
 				if(!preds[neigh])
 				{
@@ -3277,7 +3702,7 @@ For ship construction etc, another function (goal?) is needed
 				{
 					const TerrainTile *t = getTile(pos);
                     return t && t->visitableObjects.size() == 1 && t->topVisitableId() == Obj::BOAT
-						&& retreiveTile(pos) == sectorToReach->id;
+						&& getSectorId(pos) == sectorToReach->id;
 				});
 
 				if(firstEP != src->embarkmentPoints.end())
@@ -3304,7 +3729,7 @@ For ship construction etc, another function (goal?) is needed
 
 					shipyards.erase(boost::remove_if(shipyards, [=](const IShipyard *shipyard) -> bool
 					{
-						return shipyard->shipyardStatus() != 0 || retreiveTile(shipyard->bestLocation()) != sectorToReach->id;
+						return shipyard->shipyardStatus() != 0 || getSectorId(shipyard->bestLocation()) != sectorToReach->id;
 					}),shipyards.end());
 
 					if(!shipyards.size())
@@ -3379,6 +3804,7 @@ int3 SectorMap::findFirstVisitableTile (HeroPtr h, crint3 dst)
 {
 	int3 ret(-1,-1,-1);
 	int3 curtile = dst;
+	const HeroTree &tree = getHeroTree(h);
 
 	while(curtile != h->visitablePos())
 	{
@@ -3389,17 +3815,17 @@ int3 SectorMap::findFirstVisitableTile (HeroPtr h, crint3 dst)
 			logAi->warnStream() << ("Another allied hero stands in our way");
 			return ret;
 		}
-		if(ai->myCb->getPathsInfo(h.get())->getPathInfo(curtile)->reachable())
+		if(ai->getPathsInfo(h.get())->getPathInfo(curtile)->reachable())
 		{
 			return curtile;
 		}
 		else
 		{
-			auto i = parent.find(curtile);
-			if(i != parent.end())
+			const si32 prev = cb->isInTheMap(curtile) ? tree.parent[tileIndex(curtile)] : -1;
+			if(prev >= 0)
 			{
-				assert(curtile != i->second);
-				curtile = i->second;
+				assert(curtile != tilePos(prev));
+				curtile = tilePos(prev);
 			}
 			else
 			{
@@ -3411,56 +3837,91 @@ int3 SectorMap::findFirstVisitableTile (HeroPtr h, crint3 dst)
 	return ret;
 }
 
-void SectorMap::makeParentBFS(crint3 source)
+const SectorMap::HeroTree & SectorMap::getHeroTree(HeroPtr h)
 {
-	parent.clear();
+	HeroTree &tree = heroTrees[h];
+	if(tree.parent.empty() || tree.revision != revision || tree.source != h->visitablePos())
+	{
+		tree.source = h->visitablePos();
+		tree.revision = revision;
+		makeParentBFS(tree);
+	}
+	return tree;
+}
+
+void SectorMap::makeParentBFS(HeroTree & tree)
+{
+	tree.parent.assign(sector.size(), -1);
+	const size_t sourceIndex = tileIndex(tree.source);
+	tree.parent[sourceIndex] = sourceIndex;
 
-	int mySector = retreiveTile(source);
+	int mySector = getSectorId(tree.source);
 	std::queue<int3> toVisit;
-	toVisit.push(source);
+	toVisit.push(tree.source);
 	while(!toVisit.empty())
 	{
 		int3 curPos = toVisit.front();
 		toVisit.pop();
-		ui8 &sec = retreiveTile(curPos);
-		assert(sec == mySector); //consider only tiles from the same sector
-		UNUSED(sec);
+		const size_t curIndex = tileIndex(curPos);
 
 		foreach_neighbour(curPos, [&](crint3 neighPos)
 		{
-			if(retreiveTile(neighPos) == mySector && !vstd::contains(parent, neighPos))
+			const size_t neighIndex = tileIndex(neighPos);
+			if(tree.parent[neighIndex] < 0 && getSectorId(neighPos) == mySector)
 			{
 				if (cb->canMoveBetween(curPos, neighPos))
 				{
 					toVisit.push(neighPos);
-					parent[neighPos] = curPos;
+					tree.parent[neighIndex] = curIndex;
 				}
 			}
 		});
 	}
 }
 
-unsigned char & SectorMap::retreiveTile(crint3 pos)
+int SectorMap::getSectorId(crint3 pos)
 {
-	return retreiveTileN(sector, pos);
+	if(pos.x < 0 || pos.y < 0 || pos.z < 0 || pos.x >= sizes.x || pos.y >= sizes.y || pos.z >= sizes.z)
+		return NOT_VISIBLE;
+
+	const si32 sec = sector[tileIndex(pos)];
+	return sec > NOT_AVAILABLE ? findRoot(sec) : sec;
+}
+
+SectorMap::Sector & SectorMap::getSector(int id)
+{
+	Sector &s = infoOnSectors[id];
+	if(s.dirty)
+		collectSectorInfo(s, cb.get());
+	return s;
+}
+
+const TerrainTile * SectorMap::getTile(crint3 pos) const
+{
+	if(pos.x < 0 || pos.y < 0 || pos.z < 0 || pos.x >= sizes.x || pos.y >= sizes.y || pos.z >= sizes.z)
+		return nullptr;
+
+	return tiles[tileIndex(pos)];
 }
 
-TerrainTile* SectorMap::getTile(crint3 pos) const
+void SectorMap::prepare(HeroPtr h)
 {
-	//out of bounds access should be handled by boost::multi_array
-	//still we cached this array to avoid any checks
-	return visibleTiles->operator[](pos.x)[pos.y][pos.z];
+	const Sector & heroSector = getSector(getSectorId(h->visitablePos()));
+	for(auto embarkPoint : heroSector.embarkmentPoints)
+		getSector(getSectorId(embarkPoint));
+	getHeroTree(h);
 }
 
 std::vector<const CGObjectInstance *> SectorMap::getNearbyObjs(HeroPtr h, bool sectorsAround)
 {
-	const Sector *heroSector = &infoOnSectors[retreiveTile(h->visitablePos())];
+	TurnBudget::Phase phase(ai->turnBudget, TurnBudget::PATHFINDING);
+	const Sector *heroSector = &getSector(getSectorId(h->visitablePos()));
 	if(sectorsAround)
 	{
 		std::vector<const CGObjectInstance *> ret;
 		for(auto embarkPoint : heroSector->embarkmentPoints)
 		{
-			const Sector *embarkSector = &infoOnSectors[retreiveTile(embarkPoint)];
+			const Sector *embarkSector = &getSector(getSectorId(embarkPoint));
 			range::copy(embarkSector->visitableObjs, std::back_inserter(ret));
 		}
 		return ret;
@@ -81,37 +81,111 @@ struct SectorMap
 		std::vector<int3> embarkmentPoints; //tiles of other sectors onto which we can (dis)embark
 		std::vector<const CGObjectInstance *> visitableObjs;
 		bool water; //all tiles of sector are land or water
+		bool dirty; //embarkment points and objects have to be collected again
 		Sector()
 		{
 			id = -1;
+			water = false;
+			dirty = true;
 		}
 	};
 
-	bool valid; //some kind of lazy eval
-	std::map<int3, int3> parent;
-	std::vector<std::vector<std::vector<unsigned char>>> sector;
-	//std::vector<std::vector<std::vector<unsigned char>>> pathfinderSector;
+	//shortest paths inside sector of hero, from his position
+	struct HeroTree
+	{
+		int3 source;
+		ui32 revision; //of sector map the tree was built for
+		std::vector<si32> parent; //tile index -> index of previous tile on the path, -1 if unreachable
+	};
 
-	std::map<int, Sector> infoOnSectors;
-	std::shared_ptr<boost::multi_array<TerrainTile*, 3>> visibleTiles;
+	//sectors are shared by all heroes; labels of tiles are kept in flat array and sectors merged by revealing tiles
+	//or removing objects are joined with union-find, so only sectors around changed tiles are ever explored again
+	int3 sizes;
+	std::vector<si32> sector; //tile index -> NOT_VISIBLE, NOT_AVAILABLE or label of sector (possibly merged into another one)
+	std::vector<si32> sectorParent; //union-find over labels, label -> label it was merged into (itself for roots)
+	std::vector<const TerrainTile *> tiles; //tile index -> tile, nullptr if not visible
+
+	std::map<int, Sector> infoOnSectors; //only for roots of union-find
+	std::vector<int3> changedTiles; //reported by events, applied on next access
+	std::vector<HeroPtr> forgottenHeroes; //reported by events, their trees are dropped on next access
+	bool outdated; //whole map has to be explored again on next access
+	boost::mutex changesMx; //guards changes reported by events, everything else is used only by thread making turn or planning
+	std::map<HeroPtr, HeroTree> heroTrees;
+	ui32 revision;
+
+	//exploration of whole map may be spread over many calls of applyChanges
+	size_t exploredTile; //tile index, all tiles before it are explored
+	int exploredSector; //label of sector being explored, -1 if none
+	std::queue<int3> toVisit; //tiles of that sector still to be explored
+	std::set<int> adjacentSectors; //explored before, connected to that sector through new tiles
 
 	SectorMap();
-	SectorMap(HeroPtr h);
-	void update();
-	void clear();
-	void exploreNewSector(crint3 pos, int num, CCallback * cbp);
+	void update(); //explores whole map again
+	void clear(); //forgets all sectors, they are explored by next update or applyChanges
+	void tilesChanged(const std::vector<int3> & changed); //visibility, blocking or objects of these tiles have changed
+	void objectChanged(const CGObjectInstance * obj); //object was added or is about to be removed
+	void invalidate(); //everything is explored again on next access
+	bool applyChanges(size_t maxTiles = std::numeric_limits<size_t>::max()); //returns false if whole map is explored only partially yet, after maxTiles
+	void forgetHero(HeroPtr h);
 	void write(crstring fname);
 
-	bool markIfBlocked(ui8 &sec, crint3 pos, const TerrainTile *t);
-	bool markIfBlocked(ui8 &sec, crint3 pos);
-	unsigned char &retreiveTile(crint3 pos);
-	TerrainTile* getTile(crint3 pos) const;
+	int getSectorId(crint3 pos); //label of sector root, or one of NOT_VISIBLE, NOT_AVAILABLE
+	Sector & getSector(int id);
+	const TerrainTile * getTile(crint3 pos) const;
 	std::vector<const CGObjectInstance *> getNearbyObjs(HeroPtr h, bool sectorsAround);
 
-	void makeParentBFS(crint3 source);
-
 	int3 firstTileToGet(HeroPtr h, crint3 dst); //if h wants to reach tile dst, which tile he should visit to clear the way?
 	int3 findFirstVisitableTile(HeroPtr h, crint3 dst);
+	void prepare(HeroPtr h); //collects sectors around hero and builds his tree ahead of time
+
+private:
+	size_t tileIndex(crint3 pos) const;
+	int3 tilePos(size_t index) const;
+	int findRoot(int label);
+	int joinSectors(int a, int b); //returns label of joined sector
+	bool markIfBlocked(si32 &sec, const TerrainTile *t);
+	bool exploreMap(size_t maxTiles); //continues exploring whole map, returns true when it's done
+	void exploreNewSector(crint3 pos, CCallback * cbp);
+	void beginSector(crint3 pos);
+	bool exploreSector(CCallback * cbp, size_t & maxTiles); //continues exploring sector, returns true when it's done
+	void collectSectorInfo(Sector & s, CCallback * cbp);
+	const HeroTree & getHeroTree(HeroPtr h);
+	void makeParentBFS(HeroTree & tree);
+};
+
+/// Optional ("server"/"aiBackgroundPlanning") thread refreshing data for the next turn while other players move, see VCAI::planAhead.
+/// Each step of planning holds mx, which handlers of game events lock too, so state of AI doesn't change under the planner.
+/// Steps are short, so that events and the rest of the game are not held up.
+class BackgroundPlanner : boost::noncopyable
+{
+public:
+	boost::mutex mx;
+
+	/// Locks planner for game event handler, planning restarts when it's done
+	class EventScope
+	{
+		BackgroundPlanner & planner;
+		boost::unique_lock<boost::mutex> lock;
+	public:
+		EventScope(BackgroundPlanner & planner);
+		~EventScope();
+	};
+
+	BackgroundPlanner();
+	~BackgroundPlanner(); //interrupts and joins thread
+
+	void start(VCAI * ai);
+	void interrupt();
+	void pause(); //our turn started, mx has to be held
+	void resume(); //our turn ended
+
+private:
+	std::unique_ptr<boost::thread> thread;
+	boost::condition_variable cv;
+	bool paused;
+	ui32 revision, plannedRevision; //of events handled by AI
+
+	void run(VCAI * ai);
 };
 
 class VCAI : public CAdventureAI
@@ -143,11 +217,19 @@ public:
 	std::set<HeroPtr> heroesUnableToExplore; //these heroes will not be polled for exploration in current state of game
 
 	//sets are faster to search, also do not contain duplicates
-	std::set<const CGObjectInstance *> visitableObjs;
-	std::set<const CGObjectInstance *> alreadyVisited;
+	std::unordered_set<const CGObjectInstance *> visitableObjs;
+	std::unordered_set<const CGObjectInstance *> alreadyVisited;
 	std::set<const CGObjectInstance *> reservedObjs; //to be visited by specific hero
 
-	std::map <HeroPtr, std::shared_ptr<SectorMap>> cachedSectorMaps; //TODO: serialize? not necessary
+	//all visible visitable objects and ours among them, kept up to date by events instead of scanning the map, not serialized
+	std::unordered_map<ObjectInstanceID, const CGObjectInstance *> knownObjs;
+	std::unordered_map<ObjectInstanceID, const CGObjectInstance *> flaggedObjs;
+
+	std::shared_ptr<SectorMap> sectorMap; //shared by all heroes, not serialized
+	TurnBudget turnBudget; //time limits of current turn, not serialized
+	TurnProfiler profiler; //trace of current turn, not serialized
+	PathsCache pathsCache; //paths of our heroes in current turn, not serialized
+	ExplorationFrontier explorationFrontier; //not serialized
 
 	TResources saving;
 
@@ -157,6 +239,7 @@ public:
 	std::shared_ptr<CCallback> myCb;
 
 	std::unique_ptr<boost::thread> makingTurn;
+	BackgroundPlanner planner; //last member, its thread uses the others until it is joined
 
 	VCAI(void);
 	~VCAI(void);
@@ -247,6 +330,7 @@ public:
 	void makeTurn();
 
 	void makeTurnInternal();
+	bool planAhead(size_t & step); //one short step of background planning, advances step when its part is done; returns false after the last one
 	void performTypicalActions();
 
 	void buildArmyIn(const CGTownInstance * t);
@@ -276,6 +360,8 @@ public:
 	void waitTillFree();
 
 	void addVisitableObj(const CGObjectInstance *obj);
+	void rememberObject(const CGObjectInstance *obj); //object is visible or its owner changed
+	void forgetObject(ObjectInstanceID id); //object was removed or hidden
 	void markObjectVisited (const CGObjectInstance *obj);
 	void reserveObject (HeroPtr h, const CGObjectInstance *obj); //TODO: reserve all objects that heroes attempt to visit
 	void unreserveObject (HeroPtr h, const CGObjectInstance *obj);
@@ -284,12 +370,13 @@ public:
 	void markHeroAbleToExplore (HeroPtr h);
 	bool isAbleToExplore (HeroPtr h);
 	void clearPathsInfo();
+	void armyChanged(const CArmedInstance * army); //speed of army and artifacts of hero affect his paths
 
 	void validateObject(const CGObjectInstance *obj); //checks if object is still visible and if not, removes references to it
 	void validateObject(ObjectIdRef obj); //checks if object is still visible and if not, removes references to it
 	void validateVisitableObjs();
 	void retreiveVisitableObjs(std::vector<const CGObjectInstance *> &out, bool includeOwned = false) const;
-	void retreiveVisitableObjs();
+	void retreiveVisitableObjs(); //scans the map, needed only when AI starts
 	std::vector<const CGObjectInstance *> getFlaggedObjects() const;
 
 	const CGObjectInstance *lookForArt(int aid) const;
@@ -298,6 +385,8 @@ public:
 
 	const CGObjectInstance *getUnvisitedObj(const std::function<bool(const CGObjectInstance *)> &predicate);
 	bool isAccessibleForHero(const int3 & pos, HeroPtr h, bool includeAllies = false) const;
+	//paths of hero are computed once and reused until something that may affect them changes
+	std::shared_ptr<const CPathsInfo> getPathsInfo(const CGHeroInstance * h);
 	//optimization - use one SM for every hero call
 	std::shared_ptr<SectorMap> getCachedSectorMap(HeroPtr h);
 
@@ -390,5 +479,12 @@ public:
 	}
 };
 
+/// Makes given AI and its callback current for this thread while in scope
+struct SetGlobalState
+{
+	SetGlobalState(VCAI * AI);
+	~SetGlobalState();
+};
+
 void makePossibleUpgrades(const CArmedInstance *obj);
 
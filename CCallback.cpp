@@ -296,7 +296,7 @@ int3 CCallback::getGuardingCreaturePosition(int3 tile)
 	if (!gs->map->isInTheMap(tile))
 		return int3(-1,-1,-1);
 
-	return gs->map->guardingCreaturePositions[tile.x][tile.y][tile.z];
+	return gs->map->getGuardingCreaturePosition(tile);
 }
 
 void CCallback::calculatePaths( const CGHeroInstance *hero, CPathsInfo &out)
@@ -115,6 +115,7 @@ static_assert(sizeof(bool) == 1, "Bool needs to be 1 byte in size.");
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <climits>
 #include <cmath>
@@ -515,6 +516,19 @@ namespace vstd
 		}
 	}
 
+	template<typename Elem, typename Predicate>
+	void erase_if(std::unordered_set<Elem> &setContainer, Predicate pred)
+	{
+		auto itr = setContainer.begin();
+		while(itr != setContainer.end())
+		{
+			if(pred(*itr))
+				itr = setContainer.erase(itr);
+			else
+				++itr;
+		}
+	}
+
 	//works for map and std::map, maybe something else
 	template<typename Key, typename Val, typename Predicate>
 	void erase_if(std::map<Key, Val> &container, Predicate pred)
@@ -529,6 +543,19 @@ namespace vstd
 		}
 	}
 
+	template<typename Key, typename Val, typename Predicate>
+	void erase_if(std::unordered_map<Key, Val> &container, Predicate pred)
+	{
+		auto itr = container.begin();
+		while(itr != container.end())
+		{
+			if(pred(*itr))
+				itr = container.erase(itr);
+			else
+				++itr;
+		}
+	}
+
 	template<typename InputRange, typename OutputIterator, typename Predicate>
 	OutputIterator copy_if(const InputRange &input, OutputIterator result, Predicate pred)
 	{
@@ -645,6 +672,12 @@ namespace vstd
 		return false;
 	}
 
+	template <typename Item, typename Item2>
+	bool erase_if_present(std::unordered_set<Item> & c, const Item2 &item)
+	{
+		return c.erase(item) > 0;
+	}
+
 	template <typename V, typename Item, typename Item2>
 	bool erase_if_present(std::map<Item,V> & c, const Item2 &item)
 	{
@@ -0,0 +1,276 @@
+/*
+ * CBenchmarkRunner.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CBenchmarkRunner.h"
+
+#include "Client.h"
+#include "../lib/CGameState.h"
+#include "../lib/JsonNode.h"
+#include "../lib/NetPacks.h"
+#include "../lib/StartInfo.h"
+#include "../lib/StringConstants.h"
+#include "../lib/VCMI_Lib.h"
+#include "../lib/mapping/CMap.h"
+#include "../lib/mapping/CMapService.h"
+#include "../lib/rmg/CMapGenOptions.h"
+#include "../lib/rmg/CRmgTemplate.h"
+#include "../lib/rmg/CRmgTemplateStorage.h"
+
+#ifndef VCMI_WINDOWS
+#include <sys/resource.h>
+#endif
+
+CBenchmarkRunner * benchmarkRunner = nullptr;
+
+CBenchmarkRunner::Options::Options():
+	seed(0), days(28)
+{
+}
+
+CBenchmarkRunner::CBenchmarkRunner(const Options & Options):
+	options(Options), startTime(TClock::now()), battles(0), finished(false)
+{
+}
+
+StartInfo * CBenchmarkRunner::makeStartInfo()
+{
+	startTime = TClock::now();
+
+	auto si = new StartInfo();
+	si->mode = StartInfo::NEW_GAME;
+	si->difficulty = 1;
+	si->seedToBeUsed = options.seed;
+
+	if(!options.rmgTemplate.empty())
+	{
+		auto & templates = VLC->tplh->getTemplates();
+		if(!vstd::contains(templates, options.rmgTemplate))
+		{
+			logGlobal->errorStream() << "Benchmark: unknown random map template " << options.rmgTemplate;
+			delete si;
+			return nullptr;
+		}
+
+		const CRmgTemplate * tpl = templates.at(options.rmgTemplate);
+		const int playersCount = *tpl->getPlayers().getNumbers().begin();
+
+		si->mapGenOptions = std::make_shared<CMapGenOptions>();
+		si->mapGenOptions->setWidth(tpl->getMinSize().getWidth());
+		si->mapGenOptions->setHeight(tpl->getMinSize().getHeight());
+		si->mapGenOptions->setHasTwoLevels(tpl->getMinSize().getUnder());
+		si->mapGenOptions->setPlayerCount(playersCount);
+		si->mapGenOptions->setMapTemplate(tpl);
+
+		for(int i = 0; i < playersCount; i++)
+		{
+			PlayerSettings & pset = si->playerInfos[PlayerColor(i)];
+			pset.color = PlayerColor(i);
+			pset.team = TeamID(i);
+			pset.castle = PlayerSettings::RANDOM;
+		}
+	}
+	else
+	{
+		std::unique_ptr<CMapHeader> header;
+		try
+		{
+			header = CMapService::loadMapHeader(options.map);
+		}
+		catch(std::exception & e)
+		{
+			logGlobal->errorStream() << "Benchmark: cannot open map " << options.map << ": " << e.what();
+			delete si;
+			return nullptr;
+		}
+
+		si->mapname = options.map;
+		for(int i = 0; i < header->players.size(); i++)
+		{
+			const PlayerInfo & pinfo = header->players[i];
+			if(!pinfo.canAnyonePlay())
+				continue;
+
+			PlayerSettings & pset = si->playerInfos[PlayerColor(i)];
+			pset.color = PlayerColor(i);
+			pset.team = pinfo.team;
+			pset.compOnly = !pinfo.canHumanPlay;
+			pset.castle = pinfo.defaultCastle();
+			pset.hero = pinfo.defaultHero();
+			if(pset.hero != PlayerSettings::RANDOM && pinfo.hasCustomMainHero())
+			{
+				pset.hero = pinfo.mainCustomHeroId;
+				pset.heroName = pinfo.mainCustomHeroName;
+				pset.heroPortrait = pinfo.mainCustomHeroPortrait;
+			}
+		}
+	}
+
+	if(!options.ais.empty())
+	{
+		size_t aiIndex = 0;
+		for(auto & elem : si->playerInfos)
+		{
+			elem.second.name = options.ais[aiIndex]; //player name is used by client to choose AI library
+			aiIndex = std::min(aiIndex + 1, options.ais.size() - 1);
+		}
+	}
+	return si;
+}
+
+void CBenchmarkRunner::finishTurn(PlayerColor player, TClock::time_point now)
+{
+	auto it = runningTurns.find(player);
+	if(it == runningTurns.end())
+		return;
+
+	auto & stats = players[player];
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.start).count();
+	stats.turnTime.add(elapsed);
+	if(!it->second.ended) //player did not end its turn by itself (e.g. was defeated)
+		stats.decisionTime.add(elapsed);
+
+	runningTurns.erase(it);
+}
+
+void CBenchmarkRunner::playerTurnStarted(PlayerColor player)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	const auto now = TClock::now();
+	//turns that were ended wait for turn of next player, the others may run concurrently with this one
+	std::vector<PlayerColor> finishing(1, player);
+	for(auto & elem : runningTurns)
+		if(elem.second.ended)
+			finishing.push_back(elem.first);
+	for(auto color : finishing)
+		finishTurn(color, now);
+
+	runningTurns[player] = {now, false};
+}
+
+void CBenchmarkRunner::requestSent(const CPack * request, PlayerColor player)
+{
+	if(!dynamic_cast<const EndTurn *>(request))
+		return;
+
+	boost::unique_lock<boost::mutex> lock(mx);
+	auto it = runningTurns.find(player);
+	if(it == runningTurns.end() || it->second.ended)
+		return;
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(TClock::now() - it->second.start).count();
+	players[player].decisionTime.add(elapsed);
+	it->second.ended = true;
+}
+
+void CBenchmarkRunner::battleStarted()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	battles++;
+}
+
+void CBenchmarkRunner::dayStarted(CClient * cl)
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		const auto now = TClock::now();
+		while(!runningTurns.empty())
+			finishTurn(runningTurns.begin()->first, now);
+		if(finished || cl->gameState()->day <= options.days)
+			return;
+	}
+	finish(cl);
+}
+
+void CBenchmarkRunner::playerEndedGame(CClient * cl)
+{
+	const CGameState * gs = cl->gameState();
+	for(auto & elem : gs->players)
+		if(elem.second.status == EPlayerStatus::INGAME)
+			return;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		const auto now = TClock::now();
+		while(!runningTurns.empty())
+			finishTurn(runningTurns.begin()->first, now);
+		if(finished)
+			return;
+	}
+	logGlobal->infoStream() << "Benchmark: game ended before day " << options.days;
+	finish(cl);
+}
+
+void CBenchmarkRunner::finish(CClient * cl)
+{
+	const CGameState * gs = cl->gameState();
+	const ui32 checksum = gs->calculateChecksum();
+
+	boost::unique_lock<boost::mutex> lock(mx);
+
+	auto toJson = [](const CTimingHistogram & histogram) -> JsonNode
+	{
+		JsonNode ret;
+		ret["samples"].Float() = histogram.samples;
+		ret["total"].Float() = histogram.totalTime / 1000.0;
+		ret["average"].Float() = histogram.average() / 1000.0;
+		ret["max"].Float() = histogram.maxTime / 1000.0;
+		return ret;
+	};
+
+	JsonNode report;
+	report["map"].String() = options.rmgTemplate.empty() ? options.map : "random:" + options.rmgTemplate;
+	report["seed"].Float() = gs->scenarioOps->seedToBeUsed;
+	report["days"].Float() = gs->day - 1;
+	report["wallTime"].Float() = std::chrono::duration_cast<std::chrono::milliseconds>(TClock::now() - startTime).count() / 1000.0;
+	report["battles"].Float() = battles;
+	report["peakMemory"].Float() = peakMemoryUsage();
+	report["checksum"].String() = boost::str(boost::format("%08x") % checksum);
+
+	for(auto & elem : players)
+	{
+		JsonNode & player = report["players"][GameConstants::PLAYER_COLOR_NAMES[elem.first.getNum()]];
+		player["ai"].String() = cl->aiNameForPlayer(gs->scenarioOps->getIthPlayersSettings(elem.first), false);
+		player["turnTime"] = toJson(elem.second.turnTime);
+		player["decisionTime"] = toJson(elem.second.decisionTime);
+	}
+
+	logGlobal->infoStream() << "Benchmark finished (times in milliseconds, memory in kilobytes):\n" << report;
+	if(!options.reportFile.empty())
+	{
+		boost::filesystem::ofstream out(options.reportFile);
+		out << report;
+	}
+
+	finished = true;
+	cond.notify_all();
+}
+
+void CBenchmarkRunner::waitTillFinished()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	while(!finished)
+		cond.wait(lock);
+}
+
+ui64 CBenchmarkRunner::peakMemoryUsage()
+{
+#ifdef VCMI_WINDOWS
+	return 0; //not tracked
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef VCMI_APPLE
+	return usage.ru_maxrss / 1024; //reported in bytes
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
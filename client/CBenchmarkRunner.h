@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+ * CBenchmarkRunner.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "../lib/GameConstants.h"
+#include "../lib/CNetworkStatistics.h"
+
+struct StartInfo;
+struct CPack;
+class CClient;
+
+/// Plays a headless game between AIs for a fixed number of days and reports its performance.
+/// Measurements are fed from the client network thread by NetPacksClient and CClient::sendRequest.
+class CBenchmarkRunner : boost::noncopyable
+{
+public:
+	struct Options
+	{
+		std::string map; //map to be played, ignored if rmgTemplate is set
+		std::string rmgTemplate; //name of random map template
+		ui32 seed; //0 - let server choose
+		int days;
+		boost::filesystem::path reportFile; //empty - report only to log
+		std::vector<std::string> ais; //AIs of consecutive players, last one leads the remaining players; empty - use settings
+
+		Options();
+	};
+
+	CBenchmarkRunner(const Options & Options);
+
+	/// Prepares start options for the benchmarked game; nullptr if map or template cannot be found
+	StartInfo * makeStartInfo();
+
+	void playerTurnStarted(PlayerColor player);
+	void requestSent(const CPack * request, PlayerColor player);
+	void battleStarted();
+	/// Finishes the benchmark if the configured number of days has passed
+	void dayStarted(CClient * cl);
+	/// Finishes the benchmark if no player is in game anymore
+	void playerEndedGame(CClient * cl);
+
+	/// Blocks until benchmark is finished and report is written
+	void waitTillFinished();
+
+private:
+	typedef CNetworkStatistics::TClock TClock;
+
+	struct PlayerStats
+	{
+		std::string ai;
+		CTimingHistogram turnTime; //from YourTurn till turn of next player
+		CTimingHistogram decisionTime; //from YourTurn till EndTurn request
+	};
+
+	struct RunningTurn
+	{
+		TClock::time_point start;
+		bool ended; //player has sent EndTurn
+	};
+
+	void finishTurn(PlayerColor player, TClock::time_point now);
+	void finish(CClient * cl);
+	static ui64 peakMemoryUsage(); //in kilobytes
+
+	Options options;
+	TClock::time_point startTime;
+	int battles;
+
+	std::map<PlayerColor, RunningTurn> runningTurns; //more AIs may take turns concurrently if server allows
+	std::map<PlayerColor, PlayerStats> players;
+
+	boost::mutex mx;
+	boost::condition_variable cond;
+	bool finished;
+};
+
+extern CBenchmarkRunner * benchmarkRunner; //nullptr if game is not benchmarked
@@ -48,6 +48,7 @@
 #endif
 #include "../lib/UnlockGuard.h"
 #include "CMT.h"
+#include "CBenchmarkRunner.h"
 
 #if __MINGW32__
 #undef main
@@ -247,7 +248,13 @@ int main(int argc, char** argv)
         ("loadserverip",po::value<std::string>(),"IP for loaded game server")
 		("loadserverport",po::value<std::string>(),"port for loaded game server")
 		("testingport",po::value<std::string>(),"port for testing, override specified in config file")
-		("testingfileprefix",po::value<std::string>(),"prefix for auto save files");
+		("testingfileprefix",po::value<std::string>(),"prefix for auto save files")
+		("benchmark", po::value<std::string>(), "plays given map between AIs without GUI and exits with performance report, implies --noGUI")
+		("benchmarkTemplate", po::value<std::string>(), "benchmark on random map generated from given template instead of a map file")
+		("benchmarkSeed", po::value<ui32>(), "random seed for the benchmarked game")
+		("benchmarkDays", po::value<int>(), "number of days to play in benchmark, default is 28")
+		("benchmarkReport", po::value<bfs::path>(), "file to write benchmark report (JSON) to")
+		("benchmarkAI", po::value<std::vector<std::string>>()->multitoken(), "AIs leading consecutive players in benchmark, the last one leads all remaining players");
 
 	if(argc > 1)
 	{
@@ -272,6 +279,26 @@ int main(int argc, char** argv)
 		prog_version();
 		return 0;
 	}
+	if(vm.count("benchmark") || vm.count("benchmarkTemplate"))
+	{
+		CBenchmarkRunner::Options benchmarkOptions;
+		if(vm.count("benchmark"))
+			benchmarkOptions.map = vm["benchmark"].as<std::string>();
+		if(vm.count("benchmarkTemplate"))
+			benchmarkOptions.rmgTemplate = vm["benchmarkTemplate"].as<std::string>();
+		if(vm.count("benchmarkSeed"))
+			benchmarkOptions.seed = vm["benchmarkSeed"].as<ui32>();
+		if(vm.count("benchmarkDays"))
+			benchmarkOptions.days = vm["benchmarkDays"].as<int>();
+		if(vm.count("benchmarkReport"))
+			benchmarkOptions.reportFile = vm["benchmarkReport"].as<bfs::path>();
+		if(vm.count("benchmarkAI"))
+			benchmarkOptions.ais = vm["benchmarkAI"].as<std::vector<std::string>>();
+
+		benchmarkRunner = new CBenchmarkRunner(benchmarkOptions);
+		vm.insert(std::pair<std::string, po::variable_value>("noGUI", po::variable_value()));
+		vm.insert(std::pair<std::string, po::variable_value>("nointro", po::variable_value()));
+	}
 	if(vm.count("noGUI"))
 	{
 		gNoGUI = true;
@@ -466,7 +493,19 @@ int main(int argc, char** argv)
 #endif
 	logGlobal->infoStream()<<"Initialization of VCMI (together): "<<total.getDiff();
 
-	if(!vm.count("battle"))
+	if(benchmarkRunner)
+	{
+		Settings session = settings.write["session"];
+		session["autoSkip"].Bool() = false;
+		session["oneGoodAI"].Bool() = false;
+		session["aiSolo"].Bool() = false;
+
+		StartInfo * si = benchmarkRunner->makeStartInfo();
+		if(!si)
+			exit(EXIT_FAILURE);
+		startGame(si);
+	}
+	else if(!vm.count("battle"))
 	{
 		Settings session = settings.write["session"];
 		session["autoSkip"].Bool()  = vm.count("autoSkip");
@@ -503,6 +542,11 @@ int main(int argc, char** argv)
 	{
 		mainLoop();
 	}
+	else if(benchmarkRunner)
+	{
+		benchmarkRunner->waitTillFinished();
+		handleQuit(false);
+	}
 	else
 	{
 		while(true)
@@ -785,6 +829,15 @@ void processCommand(const std::string &message)
 		else
 			logGlobal->errorStream() << "File not found!";
 	}
+	else if(cn == "netstats")
+	{
+		std::string what;
+		readed >> what;
+		if(what == "reset")
+			CNetworkStatistics::get().reset();
+		else
+			CNetworkStatistics::get().report(std::cout);
+	}
 	else if(cn == "setBattleAI")
 	{
 		std::string fname;
@@ -37,6 +37,7 @@
 #include "../lib/registerTypes/RegisterTypes.h"
 #include "gui/CGuiHandler.h"
 #include "CMT.h"
+#include "CBenchmarkRunner.h"
 
 extern std::string NAME;
 #ifndef VCMI_ANDROID
@@ -176,6 +177,7 @@ void CClient::run()
 			}
 
 			handlePack(pack);
+			CNetworkStatistics::get().dumpIfDue();
 		}
 	}
 	//catch only asio exceptions
@@ -656,13 +658,22 @@ void CClient::handlePack( CPack * pack )
 	CBaseForCLApply *apply = applier->apps[typeList.getTypeID(pack)]; //find the applier
 	if(apply)
 	{
+		auto & stats = CNetworkStatistics::get();
+		auto received = CNetworkStatistics::TClock::now();
 		boost::unique_lock<boost::recursive_mutex> guiLock(*LOCPLINT->pim);
+		auto applyStarted = CNetworkStatistics::TClock::now();
+		stats.recordTime(pack, CNetworkStatistics::QUEUE_WAIT, applyStarted - received);
+
 		apply->applyOnClBefore(this,pack);
 		logNetwork->traceStream() << "\tMade first apply on cl";
+		auto gsApplyStarted = CNetworkStatistics::TClock::now();
 		gs->apply(pack);
+		auto gsApplyFinished = CNetworkStatistics::TClock::now();
 		logNetwork->traceStream() << "\tApplied on gs";
 		apply->applyOnClAfter(this,pack);
 		logNetwork->traceStream() << "\tMade second apply on cl";
+
+		stats.recordTime(pack, CNetworkStatistics::APPLY_CL, (gsApplyStarted - applyStarted) + (CNetworkStatistics::TClock::now() - gsApplyFinished));
 	}
 	else
 	{
@@ -839,6 +850,8 @@ int CClient::sendRequest(const CPack *request, PlayerColor player)
 
 	waitingRequest.pushBack(requestID);
 	serv->sendPackToServer(*request, player, requestID);
+	if(benchmarkRunner)
+		benchmarkRunner->requestSent(request, player);
 	if(vstd::contains(playerint, player))
 		playerint[player]->requestSent(dynamic_cast<const CPackForServer*>(request), requestID);
 
@@ -1008,7 +1021,10 @@ void CServerHandler::callServer()
 {
 	setThreadName("CServerHandler::callServer");
 	const std::string logName = (VCMIDirs::get().userCachePath() / "server_log.txt").string();
-	const std::string comm = VCMIDirs::get().serverPath().string() + " --port=" + port + " > \"" + logName + '\"';
+	std::string comm = VCMIDirs::get().serverPath().string() + " --port=" + port;
+	if(benchmarkRunner)
+		comm += " --sequentialTurns"; //concurrent turns would make results depend on timing
+	comm += " > \"" + logName + '\"';
 	int result = std::system(comm.c_str());
 	if (result == 0)
 		logNetwork->infoStream() << "Server closed correctly";
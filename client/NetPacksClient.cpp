@@ -30,6 +30,7 @@
 #include "widgets/MiscWidgets.h"
 #include "widgets/AdventureMapClasses.h"
 #include "CMT.h"
+#include "CBenchmarkRunner.h"
 
 //macros to avoid code duplication - calls given method with given arguments if interface for specific player is present
 //awaiting variadic templates...
@@ -167,6 +168,9 @@ void SetMovePoints::applyCl( CClient *cl )
 
 void FoWChange::applyCl( CClient *cl )
 {
+	std::unordered_set<int3, ShashInt3> tiles; //interfaces still expect tile sets
+	CFogOfWarMap::getTiles(spans, tiles);
+
 	for(auto &i : cl->playerint)
 	{
 		if(cl->getPlayerRelations(i.first, player) == PlayerRelations::SAME_PLAYER && waitForDialogs && LOCPLINT == i.second.get())
@@ -259,6 +263,8 @@ void HeroVisit::applyCl( CClient *cl )
 void NewTurn::applyCl( CClient *cl )
 {
 	cl->invalidatePaths();
+	if(benchmarkRunner)
+		benchmarkRunner->dayStarted(cl);
 }
 
 
@@ -300,6 +306,8 @@ void ChangeObjPos::applyCl( CClient *cl )
 void PlayerEndsGame::applyCl( CClient *cl )
 {
 	CALL_IN_ALL_INTERFACES(gameOver, player, victoryLossCheckResult);
+	if(benchmarkRunner)
+		benchmarkRunner->playerEndedGame(cl);
 }
 
 void RemoveBonus::applyCl( CClient *cl )
@@ -362,7 +370,7 @@ void TryMoveHero::applyFirstCl( CClient *cl )
 		if(i->first >= PlayerColor::PLAYER_LIMIT)
 			continue;
 		TeamState *t = GS(cl)->getPlayerTeam(i->first);
-		if((t->fogOfWarMap[start.x-1][start.y][start.z] || t->fogOfWarMap[end.x-1][end.y][end.z])
+		if((t->fogOfWarMap.isVisible(start - int3(1, 0, 0)) || t->fogOfWarMap.isVisible(end - int3(1, 0, 0)))
 				&& GS(cl)->getPlayer(i->first)->human)
 			humanKnows = true;
 	}
@@ -390,16 +398,18 @@ void TryMoveHero::applyCl( CClient *cl )
 
 	PlayerColor player = h->tempOwner;
 
+	std::unordered_set<int3, ShashInt3> revealedTiles; //interfaces still expect tile sets
+	CFogOfWarMap::getTiles(fowRevealed, revealedTiles);
 	for(auto &i : cl->playerint)
 		if(cl->getPlayerRelations(i.first, player) != PlayerRelations::ENEMIES)
-			i.second->tileRevealed(fowRevealed);
+			i.second->tileRevealed(revealedTiles);
 
 	//notify interfaces about move
 	for(auto i=cl->playerint.begin(); i!=cl->playerint.end(); i++)
 	{
 		if(i->first >= PlayerColor::PLAYER_LIMIT) continue;
 		TeamState *t = GS(cl)->getPlayerTeam(i->first);
-		if(t->fogOfWarMap[start.x-1][start.y][start.z] || t->fogOfWarMap[end.x-1][end.y][end.z])
+		if(t->fogOfWarMap.isVisible(start - int3(1, 0, 0)) || t->fogOfWarMap.isVisible(end - int3(1, 0, 0)))
 		{
 			i->second->heroMoved(*this);
 		}
@@ -610,6 +620,8 @@ void BattleStart::applyFirstCl( CClient *cl )
 
 void BattleStart::applyCl( CClient *cl )
 {
+	if(benchmarkRunner)
+		benchmarkRunner->battleStarted();
 	cl->battleStarted(info);
 }
 
@@ -798,6 +810,8 @@ void PlayerBlocked::applyCl( CClient *cl )
 
 void YourTurn::applyCl( CClient *cl )
 {
+	if(benchmarkRunner)
+		benchmarkRunner->playerTurnStarted(player);
 	CALL_IN_ALL_INTERFACES(playerStartsTurn, player);
 	CALL_ONLY_THAT_INTERFACE(player,yourTurn);
 }
@@ -0,0 +1,334 @@
+/*
+ * CFogOfWarMap.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CFogOfWarMap.h"
+
+namespace
+{
+	const int PRECOMPUTED_RADII = 64; //covers sight of all usual objects and spells
+
+	/// Half-widths of circle rows: tile (dx, dy) is in range r if |dx| <= halfWidths[r][|dy|]
+	/// Matches getTilesInRange: dist2d - 0.5 <= r, that is dx^2 + dy^2 <= r^2 + r for integer coordinates
+	std::vector<int> computeHalfWidths(int radius)
+	{
+		std::vector<int> ret(radius + 1);
+		const si64 limit = si64(radius) * radius + radius;
+		int dx = radius;
+		for(int dy = 0; dy <= radius; dy++)
+		{
+			while(si64(dx) * dx + si64(dy) * dy > limit)
+				dx--;
+			ret[dy] = dx;
+		}
+		return ret;
+	}
+
+	const std::vector<std::vector<int>> & precomputedHalfWidths()
+	{
+		static const std::vector<std::vector<int>> table = []()
+		{
+			std::vector<std::vector<int>> ret;
+			for(int radius = 0; radius < PRECOMPUTED_RADII; radius++)
+				ret.push_back(computeHalfWidths(radius));
+			return ret;
+		}();
+		return table;
+	}
+
+	int popcount(CFogOfWarMap::TWord word)
+	{
+		return std::bitset<CFogOfWarMap::WORD_BITS>(word).count();
+	}
+
+	/// Calls rowVisitor(y, z, minX, maxX) for each non-empty row of circle clipped to the map, radius -1 means whole map
+	template <typename RowVisitor>
+	void forEachCircleRow(const int3 & center, int radius, const int3 & sizes, const RowVisitor & rowVisitor)
+	{
+		if(radius < 0)
+		{
+			for(int z = 0; z < sizes.z; z++)
+				for(int y = 0; y < sizes.y; y++)
+					if(sizes.x)
+						rowVisitor(y, z, 0, sizes.x - 1);
+			return;
+		}
+		if(center.z < 0 || center.z >= sizes.z)
+			return;
+
+		std::vector<int> computed;
+		const std::vector<int> * halfWidths;
+		if(radius < PRECOMPUTED_RADII)
+			halfWidths = &precomputedHalfWidths()[radius];
+		else
+		{
+			computed = computeHalfWidths(radius);
+			halfWidths = &computed;
+		}
+
+		const int minY = std::max(center.y - radius, 0), maxY = std::min(center.y + radius, sizes.y - 1);
+		for(int y = minY; y <= maxY; y++)
+		{
+			const int halfWidth = (*halfWidths)[std::abs(y - center.y)];
+			const int minX = std::max(center.x - halfWidth, 0), maxX = std::min(center.x + halfWidth, sizes.x - 1);
+			if(minX <= maxX)
+				rowVisitor(y, center.z, minX, maxX);
+		}
+	}
+}
+
+TileSpan::TileSpan():
+	length(0)
+{
+}
+
+TileSpan::TileSpan(const int3 & Start, ui16 Length):
+	start(Start), length(Length)
+{
+}
+
+CFogOfWarMap::CFogOfWarMap():
+	sizes(0, 0, 0), rowWords(0)
+{
+}
+
+CFogOfWarMap::CFogOfWarMap(const int3 & Sizes):
+	sizes(Sizes), rowWords((Sizes.x + WORD_BITS - 1) / WORD_BITS)
+{
+	bits.resize(size_t(rowWords) * sizes.y * sizes.z, 0);
+}
+
+bool CFogOfWarMap::isInTheMap(const int3 & pos) const
+{
+	return pos.x >= 0 && pos.y >= 0 && pos.z >= 0 && pos.x < sizes.x && pos.y < sizes.y && pos.z < sizes.z;
+}
+
+void CFogOfWarMap::setVisible(const int3 & pos, bool visible)
+{
+	const TWord mask = TWord(1) << (pos.x % WORD_BITS);
+	if(visible)
+		bits[wordIndex(pos)] |= mask;
+	else
+		bits[wordIndex(pos)] &= ~mask;
+}
+
+void CFogOfWarMap::setRow(int y, int z, int fromX, int toX, bool visible)
+{
+	TWord * row = &bits[rowIndex(y, z)];
+	const int firstWord = fromX / WORD_BITS, lastWord = toX / WORD_BITS;
+	for(int word = firstWord; word <= lastWord; word++)
+	{
+		const int from = word == firstWord ? fromX % WORD_BITS : 0;
+		const int to = word == lastWord ? toX % WORD_BITS : WORD_BITS - 1;
+		const TWord upper = to == WORD_BITS - 1 ? ~TWord(0) : (TWord(1) << (to + 1)) - 1;
+		const TWord mask = upper & ~((TWord(1) << from) - 1);
+		if(visible)
+			row[word] |= mask;
+		else
+			row[word] &= ~mask;
+	}
+}
+
+void CFogOfWarMap::setSpan(const TileSpan & span, bool visible)
+{
+	if(span.length)
+		setRow(span.start.y, span.start.z, span.start.x, span.start.x + span.length - 1, visible);
+}
+
+void CFogOfWarMap::setSpans(const std::vector<TileSpan> & spans, bool visible)
+{
+	for(auto & span : spans)
+		setSpan(span, visible);
+}
+
+void CFogOfWarMap::setCircle(const int3 & center, int radius, bool visible)
+{
+	if(radius < 0)
+	{
+		setAll(visible);
+		return;
+	}
+
+	forEachCircleRow(center, radius, sizes, [&](int y, int z, int minX, int maxX)
+	{
+		setRow(y, z, minX, maxX, visible);
+	});
+}
+
+void CFogOfWarMap::setAll(bool visible)
+{
+	if(!visible)
+	{
+		boost::fill(bits, 0);
+		return;
+	}
+
+	for(int z = 0; z < sizes.z; z++)
+		for(int y = 0; y < sizes.y; y++)
+			if(sizes.x)
+				setRow(y, z, 0, sizes.x - 1, true); //padding bits stay clear, so count() is exact
+}
+
+void CFogOfWarMap::unite(const CFogOfWarMap & other)
+{
+	assert(bits.size() == other.bits.size());
+	for(size_t i = 0; i < bits.size(); i++)
+		bits[i] |= other.bits[i];
+}
+
+void CFogOfWarMap::subtract(const CFogOfWarMap & other)
+{
+	assert(bits.size() == other.bits.size());
+	for(size_t i = 0; i < bits.size(); i++)
+		bits[i] &= ~other.bits[i];
+}
+
+ui32 CFogOfWarMap::count() const
+{
+	ui32 ret = 0;
+	for(TWord word : bits)
+		ret += popcount(word);
+	return ret;
+}
+
+ui32 CFogOfWarMap::count(int level) const
+{
+	ui32 ret = 0;
+	const size_t begin = rowIndex(0, level), end = rowIndex(0, level + 1);
+	for(size_t i = begin; i < end; i++)
+		ret += popcount(bits[i]);
+	return ret;
+}
+
+std::vector<TileSpan> CFogOfWarMap::toSpans() const
+{
+	std::vector<TileSpan> ret;
+	for(int z = 0; z < sizes.z; z++)
+	{
+		for(int y = 0; y < sizes.y; y++)
+			getRowSpans(ret, y, z, 0, sizes.x - 1, true);
+	}
+	return ret;
+}
+
+void CFogOfWarMap::getCircleSpans(std::vector<TileSpan> & out, const int3 & center, int radius, const int3 & sizes)
+{
+	forEachCircleRow(center, radius, sizes, [&](int y, int z, int minX, int maxX)
+	{
+		out.push_back(TileSpan(int3(minX, y, z), maxX - minX + 1));
+	});
+}
+
+void CFogOfWarMap::getCircleSpans(std::vector<TileSpan> & out, const int3 & center, int radius, bool visible) const
+{
+	forEachCircleRow(center, radius, sizes, [&](int y, int z, int minX, int maxX)
+	{
+		getRowSpans(out, y, z, minX, maxX, visible);
+	});
+}
+
+ui32 CFogOfWarMap::countCircle(const int3 & center, int radius, bool visible) const
+{
+	ui32 ret = 0;
+	forEachCircleRow(center, radius, sizes, [&](int y, int z, int minX, int maxX)
+	{
+		const ui32 count = countRow(y, z, minX, maxX);
+		ret += visible ? count : maxX - minX + 1 - count;
+	});
+	return ret;
+}
+
+ui32 CFogOfWarMap::countRow(int y, int z, int fromX, int toX) const
+{
+	const TWord * row = &bits[rowIndex(y, z)];
+	const int firstWord = fromX / WORD_BITS, lastWord = toX / WORD_BITS;
+	ui32 ret = 0;
+	for(int word = firstWord; word <= lastWord; word++)
+	{
+		const int from = word == firstWord ? fromX % WORD_BITS : 0;
+		const int to = word == lastWord ? toX % WORD_BITS : WORD_BITS - 1;
+		const TWord upper = to == WORD_BITS - 1 ? ~TWord(0) : (TWord(1) << (to + 1)) - 1;
+		ret += popcount(row[word] & upper & ~((TWord(1) << from) - 1));
+	}
+	return ret;
+}
+
+void CFogOfWarMap::getRowSpans(std::vector<TileSpan> & out, int y, int z, int fromX, int toX, bool visible) const
+{
+	const TWord * row = &bits[rowIndex(y, z)];
+	const TWord flip = visible ? 0 : ~TWord(0); //looked for tiles are set bits of flipped words
+	int x = fromX;
+	while(x <= toX)
+	{
+		const TWord word = (row[x / WORD_BITS] ^ flip) >> (x % WORD_BITS);
+		if(!word) //nothing more in this word
+		{
+			x = (x / WORD_BITS + 1) * WORD_BITS;
+			continue;
+		}
+		if(!(word & 1))
+		{
+			x++;
+			continue;
+		}
+
+		const int start = x;
+		while(x <= toX && (((row[x / WORD_BITS] ^ flip) >> (x % WORD_BITS)) & 1))
+			x++;
+		out.push_back(TileSpan(int3(start, y, z), x - start));
+	}
+}
+
+std::vector<TileSpan> CFogOfWarMap::toSpans(const std::unordered_set<int3, ShashInt3> & tiles)
+{
+	std::vector<int3> sorted(tiles.begin(), tiles.end());
+	boost::sort(sorted, [](const int3 & a, const int3 & b)
+	{
+		return std::tie(a.z, a.y, a.x) < std::tie(b.z, b.y, b.x);
+	});
+
+	std::vector<TileSpan> ret;
+	for(const int3 & tile : sorted)
+	{
+		if(!ret.empty())
+		{
+			TileSpan & last = ret.back();
+			if(last.start.z == tile.z && last.start.y == tile.y && last.start.x + last.length == tile.x
+				&& last.length < std::numeric_limits<ui16>::max())
+			{
+				last.length++;
+				continue;
+			}
+		}
+		ret.push_back(TileSpan(tile, 1));
+	}
+	return ret;
+}
+
+void CFogOfWarMap::getTiles(const std::vector<TileSpan> & spans, std::unordered_set<int3, ShashInt3> & out)
+{
+	for(auto & span : spans)
+		for(int i = 0; i < span.length; i++)
+			out.insert(span.start + int3(i, 0, 0));
+}
+
+void CFogOfWarMap::loadLegacy(const std::vector<std::vector<std::vector<ui8> > > & tiles)
+{
+	const int width = tiles.size();
+	const int height = width ? tiles[0].size() : 0;
+	const int levels = height ? tiles[0][0].size() : 0;
+	*this = CFogOfWarMap(int3(width, height, levels));
+
+	for(int x = 0; x < width; x++)
+		for(int y = 0; y < height; y++)
+			for(int z = 0; z < levels; z++)
+				if(tiles[x][y][z])
+					setVisible(int3(x, y, z), true);
+}
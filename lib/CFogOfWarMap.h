@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+ * CFogOfWarMap.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "int3.h"
+
+/// Horizontal run of tiles, starting at given tile and going towards increasing x
+struct DLL_LINKAGE TileSpan
+{
+	int3 start;
+	ui16 length;
+
+	TileSpan();
+	TileSpan(const int3 & Start, ui16 Length);
+
+	template <typename Handler> void serialize(Handler &h, const int version)
+	{
+		h & start & length;
+	}
+};
+
+/// Set of map tiles stored as one bit per tile: each level is a contiguous bit plane with rows padded to whole words.
+/// Used as fog of war of a team (set bit - tile is revealed) and for areas of tiles changed in bulk.
+class DLL_LINKAGE CFogOfWarMap
+{
+public:
+	typedef ui64 TWord;
+	static const int WORD_BITS = 64;
+
+	CFogOfWarMap();
+	CFogOfWarMap(const int3 & Sizes); //x - width, y - height, z - number of levels; all tiles are hidden
+
+	const int3 & getSizes() const { return sizes; }
+	bool isInTheMap(const int3 & pos) const;
+
+	bool isVisible(const int3 & pos) const
+	{
+		return (bits[wordIndex(pos)] >> (pos.x % WORD_BITS)) & 1;
+	}
+	void setVisible(const int3 & pos, bool visible);
+	void setSpan(const TileSpan & span, bool visible);
+	void setSpans(const std::vector<TileSpan> & spans, bool visible);
+	void setCircle(const int3 & center, int radius, bool visible); //radius -1 means whole map
+	void setAll(bool visible);
+
+	void unite(const CFogOfWarMap & other); //adds all tiles visible in other map, sizes have to match
+	void subtract(const CFogOfWarMap & other); //hides all tiles visible in other map, sizes have to match
+
+	ui32 count() const; //number of visible tiles
+	ui32 count(int level) const;
+
+	std::vector<TileSpan> toSpans() const; //runs of visible tiles
+
+	/// Appends spans of tiles within sight radius from center (same metric as getTilesInRange), clipped to map of given sizes.
+	/// Half-widths of rows for usual radii are precomputed. Radius -1 means whole map.
+	static void getCircleSpans(std::vector<TileSpan> & out, const int3 & center, int radius, const int3 & sizes);
+	/// As above, but only tiles of this map with given visibility
+	void getCircleSpans(std::vector<TileSpan> & out, const int3 & center, int radius, bool visible) const;
+	/// Number of tiles with given visibility within radius, counted by whole words of rows
+	ui32 countCircle(const int3 & center, int radius, bool visible) const;
+	static std::vector<TileSpan> toSpans(const std::unordered_set<int3, ShashInt3> & tiles);
+	static void getTiles(const std::vector<TileSpan> & spans, std::unordered_set<int3, ShashInt3> & out);
+
+	template <typename Handler> void serialize(Handler &h, const int version)
+	{
+		if(version >= 760)
+		{
+			h & sizes & rowWords & bits;
+		}
+		else //save format backward compatibility: one byte per tile
+		{
+			std::vector<std::vector<std::vector<ui8> > > tiles;
+			h & tiles;
+			if(!h.saving)
+				loadLegacy(tiles);
+		}
+	}
+
+private:
+	int3 sizes;
+	int rowWords; //words per row
+	std::vector<TWord> bits;
+
+	size_t rowIndex(int y, int z) const
+	{
+		return (size_t(z) * sizes.y + y) * rowWords;
+	}
+	size_t wordIndex(const int3 & pos) const
+	{
+		return rowIndex(pos.y, pos.z) + pos.x / WORD_BITS;
+	}
+	void setRow(int y, int z, int fromX, int toX, bool visible); //sets tiles fromX..toX (inclusive) of one row
+	void getRowSpans(std::vector<TileSpan> & out, int y, int z, int fromX, int toX, bool visible) const; //appends runs of tiles with given visibility
+	ui32 countRow(int y, int z, int fromX, int toX) const; //number of visible tiles fromX..toX (inclusive) of one row
+	void loadLegacy(const std::vector<std::vector<std::vector<ui8> > > & tiles);
+};
@@ -432,6 +432,58 @@ std::vector <const CGObjectInstance * > CGameInfoCallback::getVisitableObjs(int3
 
 	return ret;
 }
+
+std::vector <const CGObjectInstance * > CGameInfoCallback::getVisitableObjsInRange(int3 center, int radius) const
+{
+	std::vector<const CGObjectInstance *> ret;
+	const CObjectSpatialIndex & index = gs->map->getObjectsIndex();
+	auto filter = [this](const CGObjectInstance * obj)
+	{
+		if(!obj->isVisitable() || (!player && obj->ID == Obj::EVENT))
+			return false;
+
+		//same objects as getVisitableObjs returns for visible tiles: visitable at any of them
+		for(int fx = 0; fx < obj->getWidth(); ++fx)
+		{
+			for(int fy = 0; fy < obj->getHeight(); ++fy)
+			{
+				const int3 pos = obj->pos - int3(fx, fy, 0);
+				if(obj->visitableAt(pos.x, pos.y) && isVisible(pos))
+					return true;
+			}
+		}
+		return false;
+	};
+
+	if(radius < 0)
+		range::copy(index.getObjectsInRect(int3(0, 0, center.z), int3(gs->map->width - 1, gs->map->height - 1, center.z), filter), std::back_inserter(ret));
+	else
+		range::copy(index.getObjectsInRange(center, radius, filter), std::back_inserter(ret));
+	return ret;
+}
+
+std::vector <const CGObjectInstance * > CGameInfoCallback::getObjectsOfType(Obj type) const
+{
+	std::vector<const CGObjectInstance *> ret;
+	for(const CGObjectInstance * obj : gs->map->getObjectLookup().getObjectsOfType(type))
+	{
+		if(isVisible(obj, player) || obj->tempOwner == player)
+			ret.push_back(obj);
+	}
+	return ret;
+}
+
+std::vector <const CGObjectInstance * > CGameInfoCallback::getObjectsOwnedBy(PlayerColor owner) const
+{
+	std::vector<const CGObjectInstance *> ret;
+	for(const CGObjectInstance * obj : gs->map->getObjectLookup().getObjectsOwnedBy(owner))
+	{
+		if(isVisible(obj, player) || obj->tempOwner == player)
+			ret.push_back(obj);
+	}
+	return ret;
+}
+
 const CGObjectInstance * CGameInfoCallback::getTopObj (int3 pos) const
 {
 	return vstd::backOrNull(getVisitableObjs(pos));
@@ -495,7 +547,7 @@ std::shared_ptr<boost::multi_array<TerrainTile*, 3>> CGameInfoCallback::getAllVi
 		for (size_t y = 0; y < height; y++)
 			for (size_t z = 0; z < levels; z++)
 			{
-				if (team->fogOfWarMap[x][y][z])
+				if (team->fogOfWarMap.isVisible(int3(x, y, z)))
 					tileArray[x][y][z] = &gs->map->getTile(int3(x, y, z));
 				else
 					tileArray[x][y][z] = nullptr;
@@ -658,7 +710,7 @@ CGameInfoCallback::CGameInfoCallback(CGameState *GS, boost::optional<PlayerColor
 	player = Player;
 }
 
-const std::vector< std::vector< std::vector<ui8> > > & CPlayerSpecificInfoCallback::getVisibilityMap() const
+const CFogOfWarMap & CPlayerSpecificInfoCallback::getVisibilityMap() const
 {
 	//boost::shared_lock<boost::shared_mutex> lock(*gs->mx);
 	return gs->getPlayerTeam(*player)->fogOfWarMap;
@@ -744,11 +796,8 @@ int3 CPlayerSpecificInfoCallback::getGrailPos( double *outKnownRatio )
 std::vector < const CGObjectInstance * > CPlayerSpecificInfoCallback::getMyObjects() const
 {
 	std::vector < const CGObjectInstance * > ret;
-	for(const CGObjectInstance * obj : gs->map->objects)
-	{
-		if(obj && obj->tempOwner == player)
-			ret.push_back(obj);
-	}
+	if(player)
+		range::copy(gs->map->getObjectLookup().getObjectsOwnedBy(*player), std::back_inserter(ret));
 	return ret;
 }
 
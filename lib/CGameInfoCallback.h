@@ -30,6 +30,7 @@ class CMapHeader;
 struct TeamState;
 struct QuestInfo;
 class int3;
+class CFogOfWarMap;
 
 
 class DLL_LINKAGE CGameInfoCallback : public virtual CCallbackBase
@@ -80,6 +81,9 @@ public:
 	const CGObjectInstance* getObj(ObjectInstanceID objid, bool verbose = true) const;
 	std::vector <const CGObjectInstance * > getBlockingObjs(int3 pos)const;
 	std::vector <const CGObjectInstance * > getVisitableObjs(int3 pos, bool verbose = true)const;
+	std::vector <const CGObjectInstance * > getVisitableObjsInRange(int3 center, int radius) const; //visitable at a visible tile, range is measured from visitable position, radius -1 - whole level
+	std::vector <const CGObjectInstance * > getObjectsOfType(Obj type) const; //ones available by getObj, sorted by id
+	std::vector <const CGObjectInstance * > getObjectsOwnedBy(PlayerColor owner) const; //ones available by getObj, sorted by id
 	std::vector <const CGObjectInstance * > getFlaggableObjects(int3 pos) const;
 	const CGObjectInstance * getTopObj (int3 pos) const;
 	PlayerColor getOwner(ObjectInstanceID heroID) const;
@@ -139,7 +143,7 @@ public:
 
 	int getResourceAmount(Res::ERes type) const;
 	TResources getResourceAmount() const;
-	const std::vector< std::vector< std::vector<ui8> > > & getVisibilityMap()const; //returns visibility map
+	const CFogOfWarMap & getVisibilityMap()const; //returns visibility map
 	const PlayerSettings * getPlayerSettings(PlayerColor color) const;
 };
 
@@ -24,6 +24,8 @@
 #include "GameConstants.h"
 #include "rmg/CMapGenerator.h"
 #include "CStopWatch.h"
+#include "CThreadHelper.h"
+#include "CVictoryConditionWatcher.h"
 #include "mapping/CMapEditManager.h"
 
 #ifdef min
@@ -68,7 +70,18 @@ public:
 	}
 };
 
-static CApplier<CBaseForGSApply> *applierGs = nullptr;
+/// Shared by all game states, which may exist at once (e.g. replayed and live one); created on first use and never freed
+static CApplier<CBaseForGSApply> * getApplierGs()
+{
+	static CApplier<CBaseForGSApply> * applier = []()
+	{
+		auto ret = new CApplier<CBaseForGSApply>;
+		registerTypesClientPacks1(*ret);
+		registerTypesClientPacks2(*ret);
+		return ret;
+	}();
+	return applier;
+}
 
 // class IObjectCaller
 // {
@@ -701,13 +714,11 @@ int CGameState::getDate(Date::EDateType mode) const
 	return 0;
 }
 
-CGameState::CGameState()
+CGameState::CGameState():
+	victoryWatcher(make_unique<CVictoryConditionWatcher>())
 {
 	gs = this;
 	mx = new boost::shared_mutex();
-	applierGs = new CApplier<CBaseForGSApply>;
-	registerTypesClientPacks1(*applierGs);
-	registerTypesClientPacks2(*applierGs);
 	//objCaller = new CObjectCallersHandler;
 	globalEffects.setDescription("Global effects");
 	globalEffects.setNodeType(CBonusSystemNode::GLOBAL_EFFECTS);
@@ -720,7 +731,6 @@ CGameState::~CGameState()
 	curB.dellNull();
 	//delete scenarioOps; //TODO: fix for loading ind delete
 	//delete initialOpts;
-	delete applierGs;
 	//delete objCaller;
 
 	for(auto ptr : hpool.heroesPool) // clean hero pool
@@ -786,6 +796,7 @@ void CGameState::init(StartInfo * si)
 	buildBonusSystemTree();
 	initVisitingAndGarrisonedHeroes();
 	initFogOfWar();
+	map->rebuildObjectLookup(); //ids and owners of objects are final now
 
 	logGlobal->debug("\tChecking objectives");
 	map->checkForObjectives(); //needs to be run when all objects are properly placed
@@ -1613,33 +1624,34 @@ void CGameState::giveCampaignBonusToHero(CGHeroInstance * hero)
 void CGameState::initFogOfWar()
 {
 	logGlobal->debug("\tFog of war"); //FIXME: should be initialized after all bonuses are set
+	std::map<PlayerColor, TeamID> playerTeams;
 	for(auto & elem : teams)
-	{
-		elem.second.fogOfWarMap.resize(map->width);
-		for(int g=0; g<map->width; ++g)
-			elem.second.fogOfWarMap[g].resize(map->height);
+		for(PlayerColor player : elem.second.players)
+			playerTeams[player] = elem.first;
 
-		for(int g=-0; g<map->width; ++g)
-			for(int h=0; h<map->height; ++h)
-				elem.second.fogOfWarMap[g][h].resize(map->twoLevel ? 2 : 1, 0);
+	//sight radius of heroes is read from bonus system, which serializes its queries, so it's done here in one pass
+	std::map<TeamID, std::vector<std::pair<int3, int>>> teamSights;
+	for(CGObjectInstance *obj : map->objects)
+	{
+		if(!obj || !vstd::contains(playerTeams, obj->tempOwner)) continue; //not a flagged object
 
-		for(int g=0; g<map->width; ++g)
-			for(int h=0; h<map->height; ++h)
-				for(int v = 0; v < (map->twoLevel ? 2 : 1); ++v)
-					elem.second.fogOfWarMap[g][h][v] = 0;
+		teamSights[playerTeams[obj->tempOwner]].push_back(std::make_pair(obj->getSightCenter(), obj->getSightRadius()));
+	}
 
-		for(CGObjectInstance *obj : map->objects)
+	//teams have separate maps and revealing is order independent, so they are done in parallel
+	std::vector<Task> tasks;
+	for(auto & elem : teams)
+	{
+		TeamState * team = &elem.second;
+		const std::vector<std::pair<int3, int>> * sights = &teamSights[elem.first];
+		team->fogOfWarMap = CFogOfWarMap(int3(map->width, map->height, map->twoLevel ? 2 : 1));
+		tasks.push_back([team, sights]()
 		{
-			if(!obj || !vstd::contains(elem.second.players, obj->tempOwner)) continue; //not a flagged object
-
-			std::unordered_set<int3, ShashInt3> tiles;
-			getTilesInRange(tiles, obj->getSightCenter(), obj->getSightRadius(), obj->tempOwner, 1);
-			for(int3 tile : tiles)
-			{
-				elem.second.fogOfWarMap[tile.x][tile.y][tile.z] = 1;
-			}
-		}
+			for(auto & sight : *sights)
+				team->fogOfWarMap.setCircle(sight.first, sight.second, true);
+		});
 	}
+	CThreadHelper::runTasks(tasks, 1);
 }
 
 void CGameState::initStartingBonus()
@@ -2061,7 +2073,14 @@ PlayerRelations::PlayerRelations CGameState::getPlayerRelations( PlayerColor col
 void CGameState::apply(CPack *pack)
 {
 	ui16 typ = typeList.getTypeID(pack);
-	applierGs->apps[typ]->applyOnGS(this,pack);
+	CNetworkStatistics::Timer timer(pack, CNetworkStatistics::APPLY_GS);
+	getApplierGs()->apps[typ]->applyOnGS(this,pack);
+	victoryWatcher->packApplied(typ);
+}
+
+ui32 CGameState::calculateChecksum() const
+{
+	return CChecksumSerializer::calculate(*this);
 }
 
 void CGameState::calculatePaths(const CGHeroInstance *hero, CPathsInfo &out)
@@ -2079,55 +2098,12 @@ void CGameState::calculatePaths(const CGHeroInstance *hero, CPathsInfo &out)
  */
 std::vector<CGObjectInstance*> CGameState::guardingCreatures (int3 pos) const
 {
-	std::vector<CGObjectInstance*> guards;
-	const int3 originalPos = pos;
-	if (!map->isInTheMap(pos))
-		return guards;
-
-	const TerrainTile &posTile = map->getTile(pos);
-	if (posTile.visitable)
-	{
-		for (CGObjectInstance* obj : posTile.visitableObjects)
-		{
-			if(obj->blockVisit)
-			{
-				if (obj->ID == Obj::MONSTER) // Monster
-					guards.push_back(obj);
-			}
-		}
-	}
-	pos -= int3(1, 1, 0); // Start with top left.
-	for (int dx = 0; dx < 3; dx++)
-	{
-		for (int dy = 0; dy < 3; dy++)
-		{
-			if (map->isInTheMap(pos))
-			{
-				const auto & tile = map->getTile(pos);
-				if (tile.visitable && (tile.isWater() == posTile.isWater()))
-				{
-					for (CGObjectInstance* obj : tile.visitableObjects)
-					{
-						if (obj->ID == Obj::MONSTER  &&  map->checkForVisitableDir(pos, &map->getTile(originalPos), originalPos)) // Monster being able to attack investigated tile
-						{
-							guards.push_back(obj);
-						}
-					}
-				}
-			}
-
-			pos.y++;
-		}
-		pos.y -= 3;
-		pos.x++;
-	}
-	return guards;
-
+	return map->guardingCreatures(pos);
 }
 
 int3 CGameState::guardingCreaturePosition (int3 pos) const
 {
-	return gs->map->guardingCreaturePositions[pos.x][pos.y][pos.z];
+	return gs->map->getGuardingCreaturePosition(pos);
 }
 
 void CGameState::updateRumor()
@@ -2204,7 +2180,7 @@ bool CGameState::isVisible(int3 pos, PlayerColor player)
 {
 	if(player == PlayerColor::NEUTRAL)
 		return false;
-	return getPlayerTeam(player)->fogOfWarMap[pos.x][pos.y][pos.z];
+	return getPlayerTeam(player)->fogOfWarMap.isVisible(pos);
 }
 
 bool CGameState::isVisible( const CGObjectInstance *obj, boost::optional<PlayerColor> player )
@@ -2241,6 +2217,22 @@ bool CGameState::checkForVisitableDir(const int3 & src, const int3 & dst) const
 }
 
 EVictoryLossCheckResult CGameState::checkForVictoryAndLoss(PlayerColor player) const
+{
+	EVictoryLossCheckResult ret;
+	if(!victoryWatcher->getResult(player, map->triggeredEvents, ret))
+	{
+		ret = evaluateVictoryAndLoss(player);
+		victoryWatcher->setResult(player, ret);
+	}
+	return ret;
+}
+
+void CGameState::victoryLossStateChanged()
+{
+	victoryWatcher->stateChanged();
+}
+
+EVictoryLossCheckResult CGameState::evaluateVictoryAndLoss(PlayerColor player) const
 {
 	const std::string & messageWonSelf = VLC->generaltexth->allTexts[659];
 	const std::string & messageWonOther = VLC->generaltexth->allTexts[5];
@@ -2300,12 +2292,9 @@ bool CGameState::checkForVictory(PlayerColor player, const EventCondition & cond
 		{
 			//check if in players armies there is enough creatures
 			int total = 0; //creature counter
-			for(size_t i = 0; i < map->objects.size(); i++)
+			for(const CGObjectInstance * obj : map->getObjectLookup().getObjectsOwnedBy(player)) //objects controlled by player
 			{
-				const CArmedInstance *ai = nullptr;
-				if(map->objects[i]
-					&& map->objects[i]->tempOwner == player //object controlled by player
-					&&  (ai = dynamic_cast<const CArmedInstance*>(map->objects[i].get()))) //contains army
+				if(auto ai = dynamic_cast<const CArmedInstance*>(obj)) //contains army
 				{
 					for(auto & elem : ai->Slots()) //iterate through army
 						if(elem.second->type->idNumber == condition.objectType) //it's searched creature
@@ -2346,12 +2335,8 @@ bool CGameState::checkForVictory(PlayerColor player, const EventCondition & cond
 			}
 			else
 			{
-				for(auto & elem : map->objects) // mode B - destroy all objects of this type
-				{
-					if(elem && elem->ID == condition.objectType)
-						return false;
-				}
-				return true;
+				// mode B - destroy all objects of this type
+				return map->getObjectLookup().getObjectsOfType(Obj(condition.objectType)).empty();
 			}
 		}
 		case EventCondition::CONTROL:
@@ -2366,10 +2351,10 @@ bool CGameState::checkForVictory(PlayerColor player, const EventCondition & cond
 			}
 			else
 			{
-				for(auto & elem : map->objects) // mode B - flag all objects of this type
+				for(const CGObjectInstance * elem : map->getObjectLookup().getObjectsOfType(Obj(condition.objectType))) // mode B - flag all objects of this type
 				{
 					 //check not flagged objs
-					if ( elem && elem->ID == condition.objectType && team.count(elem->tempOwner) == 0 )
+					if (team.count(elem->tempOwner) == 0)
 						return false;
 				}
 				return true;
@@ -56,6 +56,7 @@ class CQuest;
 class CCampaignScenario;
 struct EventCondition;
 class CScenarioTravel;
+class CVictoryConditionWatcher;
 
 namespace boost
 {
@@ -226,6 +227,7 @@ public:
 	int3 guardingCreaturePosition (int3 pos) const;
 	std::vector<CGObjectInstance*> guardingCreatures (int3 pos) const;
 	void updateRumor();
+	ui32 calculateChecksum() const; //CRC of serialized state, equal for games that went the same way
 
 	// ----- victory, loss condition checks -----
 
@@ -233,6 +235,7 @@ public:
 	bool checkForVictory(PlayerColor player, const EventCondition & condition) const; //checks if given player is winner
 	PlayerColor checkForStandardWin() const; //returns color of player that accomplished standard victory conditions or 255 (NEUTRAL) if no winner
 	bool checkForStandardLoss(PlayerColor player) const; //checks if given player lost the game
+	void victoryLossStateChanged(); //drops cached checks; needed only when state read by conditions is modified other than by netpack
 
 	void obtainPlayersStats(SThievesGuildInfo & tgi, int level); //fills tgi with info about other players that is available at given level of thieves' guild
 	std::map<ui32, ConstTransitivePtr<CGHeroInstance> > unusedHeroesFromPool(); //heroes pool without heroes that are available in taverns
@@ -321,9 +324,11 @@ private:
 	std::pair<Obj,int> pickObject(CGObjectInstance *obj); //chooses type of object to be randomized, returns <type, subtype>
 	int pickUnusedHeroTypeRandomly(PlayerColor owner); // picks a unused hero type randomly
 	int pickNextHeroType(PlayerColor owner); // picks next free hero type of the H3 hero init sequence -> chosen starting hero, then unused hero type randomly
+	EVictoryLossCheckResult evaluateVictoryAndLoss(PlayerColor player) const;
 
 	// ---- data -----
 	CRandomGenerator rand;
+	std::unique_ptr<CVictoryConditionWatcher> victoryWatcher; //not serialized, results of victory / loss checks
 
 	friend class CCallback;
 	friend class CClient;
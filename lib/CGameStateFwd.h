@@ -14,6 +14,7 @@
 
 class CQuest;
 class CGObjectInstance;
+class CGTownInstance;
 class CHeroClass;
 class CTown;
 
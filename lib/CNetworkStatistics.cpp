@@ -0,0 +1,195 @@
+/*
+ * CNetworkStatistics.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CNetworkStatistics.h"
+
+#include "Connection.h"
+#include "NetPacksBase.h"
+#include "CConfigHandler.h"
+
+CTimingHistogram::CTimingHistogram():
+	samples(0), totalTime(0), maxTime(0)
+{
+	buckets.fill(0);
+}
+
+void CTimingHistogram::add(ui64 microseconds)
+{
+	int bucket = 0;
+	while(bucket < BUCKETS_COUNT - 1 && (ui64(1) << bucket) <= microseconds)
+		bucket++;
+
+	buckets[bucket]++;
+	samples++;
+	totalTime += microseconds;
+	vstd::amax(maxTime, microseconds);
+}
+
+ui64 CTimingHistogram::average() const
+{
+	return samples ? totalTime / samples : 0;
+}
+
+ui64 CTimingHistogram::percentile(double fraction) const
+{
+	const ui64 needed = std::ceil(samples * fraction);
+	ui64 counted = 0;
+	for(int bucket = 0; bucket < BUCKETS_COUNT; bucket++)
+	{
+		counted += buckets[bucket];
+		if(counted >= needed && counted > 0)
+			return std::min(ui64(1) << bucket, maxTime);
+	}
+	return maxTime;
+}
+
+CNetworkStatistics::PackTypeStats::PackTypeStats():
+	sent(0), received(0), bytesSent(0), bytesReceived(0)
+{
+}
+
+CNetworkStatistics::Timer::Timer(const CPack * Pack, EPhase Phase):
+	pack(Pack), phase(Phase), start(TClock::now())
+{
+}
+
+CNetworkStatistics::Timer::~Timer()
+{
+	CNetworkStatistics::get().recordTime(pack, phase, TClock::now() - start);
+}
+
+CNetworkStatistics::CNetworkStatistics():
+	lastDump(TClock::now())
+{
+}
+
+CNetworkStatistics & CNetworkStatistics::get()
+{
+	static CNetworkStatistics instance;
+	return instance;
+}
+
+const char * CNetworkStatistics::phaseName(EPhase phase)
+{
+	static const char * names[PHASES_COUNT] = {"serialize", "send", "receive", "queue", "applyGh", "applyGs", "applyCl"};
+	return names[phase];
+}
+
+CNetworkStatistics::PackTypeStats & CNetworkStatistics::statsFor(const CPack * pack)
+{
+	PackTypeStats & ret = stats[typeList.getTypeID(pack)];
+	if(ret.name.empty())
+		ret.name = typeid(*pack).name();
+	return ret;
+}
+
+void CNetworkStatistics::recordTime(const CPack * pack, EPhase phase, TClock::duration time)
+{
+	if(!pack)
+		return;
+
+	const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+	boost::unique_lock<boost::mutex> lock(mx);
+	statsFor(pack).phases[phase].add(std::max<si64>(microseconds, 0));
+}
+
+void CNetworkStatistics::recordSent(const CPack * pack, ui64 bytes)
+{
+	if(!pack)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(mx);
+	auto & packStats = statsFor(pack);
+	packStats.sent++;
+	packStats.bytesSent += bytes;
+}
+
+void CNetworkStatistics::recordReceived(const CPack * pack, ui64 bytes)
+{
+	if(!pack)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(mx);
+	auto & packStats = statsFor(pack);
+	packStats.received++;
+	packStats.bytesReceived += bytes;
+}
+
+std::map<ui16, CNetworkStatistics::PackTypeStats> CNetworkStatistics::getStats() const
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	return stats;
+}
+
+void CNetworkStatistics::reset()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	stats.clear();
+}
+
+void CNetworkStatistics::report(std::ostream & out) const
+{
+	auto snapshot = getStats();
+
+	auto totalTime = [](const PackTypeStats & packStats) -> ui64
+	{
+		ui64 ret = 0;
+		for(auto & phase : packStats.phases)
+			ret += phase.totalTime;
+		return ret;
+	};
+
+	std::vector<const PackTypeStats *> sorted;
+	for(auto & elem : snapshot)
+		sorted.push_back(&elem.second);
+	boost::sort(sorted, [&](const PackTypeStats * a, const PackTypeStats * b)
+	{
+		return totalTime(*a) > totalTime(*b);
+	});
+
+	out << "Network statistics (times in microseconds: total / avg / p50 / p95 / max)\n";
+	for(auto packStats : sorted)
+	{
+		out << boost::format("%s: sent %d (%d B), received %d (%d B), total time %d\n")
+			% packStats->name % packStats->sent % packStats->bytesSent
+			% packStats->received % packStats->bytesReceived % totalTime(*packStats);
+
+		for(int phase = 0; phase < PHASES_COUNT; phase++)
+		{
+			const CTimingHistogram & histogram = packStats->phases[phase];
+			if(!histogram.samples)
+				continue;
+
+			out << boost::format("\t%-10s x%-7d %10d / %8d / %8d / %8d / %8d\n")
+				% phaseName(static_cast<EPhase>(phase)) % histogram.samples % histogram.totalTime % histogram.average()
+				% histogram.percentile(0.5) % histogram.percentile(0.95) % histogram.maxTime;
+		}
+	}
+}
+
+void CNetworkStatistics::dumpIfDue()
+{
+	const double interval = settings["logging"]["netStatsInterval"].Float();
+	if(interval <= 0)
+		return;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		const auto now = TClock::now();
+		if(now - lastDump < std::chrono::duration<double>(interval))
+			return;
+		lastDump = now;
+	}
+
+	std::ostringstream out;
+	report(out);
+	logNetwork->infoStream() << out.str();
+}
@@ -0,0 +1,99 @@
+/*
+ * CNetworkStatistics.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+
+struct CPack;
+
+/// Histogram of durations with power-of-two microsecond buckets.
+/// Bucket i holds samples in range [2^(i-1), 2^i) us, bucket 0 holds samples below 1 us.
+struct DLL_LINKAGE CTimingHistogram
+{
+	static const int BUCKETS_COUNT = 26; //last bucket covers everything above ~16 seconds
+
+	ui64 samples;
+	ui64 totalTime; //in microseconds
+	ui64 maxTime; //in microseconds
+	std::array<ui64, BUCKETS_COUNT> buckets;
+
+	CTimingHistogram();
+
+	void add(ui64 microseconds);
+	ui64 average() const;
+	/// Returns upper bound (in microseconds) of bucket containing given percentile (0..1)
+	ui64 percentile(double fraction) const;
+};
+
+/// Collects per-pack-type counters and timings of network and apply phases.
+/// One instance exists per process (server or client), all methods are thread safe.
+class DLL_LINKAGE CNetworkStatistics : boost::noncopyable
+{
+public:
+	typedef std::chrono::steady_clock TClock;
+
+	enum EPhase
+	{
+		SERIALIZE, //writing pack into the stream, excluding time spent in socket
+		SEND, //time spent in socket writes
+		RECEIVE, //from arrival of the first byte till the pack is deserialized
+		QUEUE_WAIT, //from receiving the pack till its application started (on server only requests deferred by concurrent turns wait)
+		APPLY_GH, //server-side handling of CPackForServer
+		APPLY_GS, //CGameState::apply
+		APPLY_CL, //client-side applyCl (before and after gamestate application)
+		PHASES_COUNT
+	};
+
+	struct DLL_LINKAGE PackTypeStats
+	{
+		std::string name;
+		ui64 sent, received;
+		ui64 bytesSent, bytesReceived;
+		std::array<CTimingHistogram, PHASES_COUNT> phases;
+
+		PackTypeStats();
+	};
+
+	/// Records time between its construction and destruction as given phase of given pack
+	class DLL_LINKAGE Timer : boost::noncopyable
+	{
+		const CPack * pack;
+		EPhase phase;
+		TClock::time_point start;
+	public:
+		Timer(const CPack * Pack, EPhase Phase);
+		~Timer();
+	};
+
+	static CNetworkStatistics & get();
+	static const char * phaseName(EPhase phase);
+
+	void recordTime(const CPack * pack, EPhase phase, TClock::duration time);
+	void recordSent(const CPack * pack, ui64 bytes);
+	void recordReceived(const CPack * pack, ui64 bytes);
+
+	std::map<ui16, PackTypeStats> getStats() const;
+	void reset();
+
+	/// Prints table with statistics of all pack types seen so far, sorted by total time
+	void report(std::ostream & out) const;
+	/// Logs report to network logger if interval from settings ("logging"/"netStatsInterval", in seconds) has passed
+	void dumpIfDue();
+
+private:
+	CNetworkStatistics();
+
+	PackTypeStats & statsFor(const CPack * pack); //requires locked mx
+
+	mutable boost::mutex mx;
+	std::map<ui16, PackTypeStats> stats;
+	TClock::time_point lastDump;
+};
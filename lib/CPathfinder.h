@@ -22,6 +22,7 @@ class CGObjectInstance;
 struct TerrainTile;
 class CPathfinderHelper;
 class CMap;
+class CFogOfWarMap;
 class CGWhirlpool;
 
 struct DLL_LINKAGE CGPathNode
@@ -161,7 +162,7 @@ private:
 
 	CPathsInfo & out;
 	const CGHeroInstance * hero;
-	const std::vector<std::vector<std::vector<ui8> > > &FoW;
+	const CFogOfWarMap &FoW;
 	std::unique_ptr<CPathfinderHelper> hlp;
 
 	enum EPatrolState {
@@ -11,6 +11,7 @@
  */
 
 #include "HeroBonus.h"
+#include "CFogOfWarMap.h"
 
 class CGHeroInstance;
 class CGTownInstance;
@@ -53,7 +54,7 @@ struct DLL_LINKAGE TeamState : public CBonusSystemNode
 public:
 	TeamID id; //position in gameState::teams
 	std::set<PlayerColor> players; // members of this team
-	std::vector<std::vector<std::vector<ui8> > >  fogOfWarMap; //true - visible, false - hidden
+	CFogOfWarMap fogOfWarMap; //set bit - visible, clear bit - hidden
 
 	TeamState();
 
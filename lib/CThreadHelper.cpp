@@ -29,6 +29,21 @@ void CThreadHelper::run()
 		grupa.create_thread(std::bind(&CThreadHelper::processTasks,this));
 	grupa.join_all();
 }
+void CThreadHelper::runTasks(std::vector<Task> & tasks, int tasksPerThread)
+{
+	const int threads = std::min<int>(tasks.size() / tasksPerThread, boost::thread::hardware_concurrency());
+	if(threads > 1)
+	{
+		CThreadHelper helper(&tasks, threads);
+		helper.run();
+	}
+	else
+	{
+		for(auto & task : tasks)
+			task();
+	}
+}
+
 void CThreadHelper::processTasks()
 {
 	while(true)
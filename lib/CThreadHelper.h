@@ -27,6 +27,10 @@ class DLL_LINKAGE CThreadHelper
 public:
 	CThreadHelper(std::vector<std::function<void()> > *Tasks, int Threads);
 	void run();
+
+	/// Runs tasks on as many threads as cores are available, but at least tasksPerThread tasks per thread;
+	/// if there are too few tasks they are run in order on the calling thread
+	static void runTasks(std::vector<Task> & tasks, int tasksPerThread);
 };
 
 template <typename T> inline void setData(T * data, std::function<T()> func)
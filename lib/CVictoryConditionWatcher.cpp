@@ -0,0 +1,180 @@
+/*
+ * CVictoryConditionWatcher.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CVictoryConditionWatcher.h"
+
+#include "Connection.h"
+#include "NetPacks.h"
+#include "mapping/CMap.h"
+
+CVictoryConditionWatcher::CVictoryConditionWatcher():
+	readStateKnown(false),
+	readState(EVERYTHING)
+{
+}
+
+bool CVictoryConditionWatcher::getResult(PlayerColor player, const std::vector<TriggeredEvent> & events, EVictoryLossCheckResult & out)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(!readStateKnown)
+	{
+		readState = getReadState(events);
+		readStateKnown = true;
+	}
+
+	auto it = results.find(player);
+	if(it == results.end())
+		return false;
+
+	out = it->second;
+	return true;
+}
+
+void CVictoryConditionWatcher::setResult(PlayerColor player, const EVictoryLossCheckResult & result)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	results[player] = result;
+}
+
+void CVictoryConditionWatcher::packApplied(ui16 packType)
+{
+	stateChanged(getModifiedState(packType));
+}
+
+void CVictoryConditionWatcher::stateChanged(ui32 kinds)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(kinds & OBJECTS) //events may refer to removed objects and are modified then
+		readStateKnown = false;
+	if(kinds & readState)
+		results.clear();
+}
+
+ui32 CVictoryConditionWatcher::getReadState(const EventCondition & condition)
+{
+	switch(condition.condition)
+	{
+	case EventCondition::STANDARD_WIN:
+	case EventCondition::IS_HUMAN:
+		return PLAYERS;
+	case EventCondition::HAVE_ARTIFACT:
+		return ARTIFACTS | OBJECTS;
+	case EventCondition::HAVE_CREATURES:
+		return ARMIES | OBJECTS;
+	case EventCondition::HAVE_RESOURCES:
+		return RESOURCES;
+	case EventCondition::HAVE_BUILDING:
+		return BUILDINGS | OBJECTS;
+	case EventCondition::DESTROY:
+	case EventCondition::CONTROL:
+		return OBJECTS;
+	case EventCondition::TRANSPORT:
+		return ARTIFACTS | TOWN_HEROES;
+	case EventCondition::DAYS_PASSED:
+		return DATE;
+	case EventCondition::DAYS_WITHOUT_TOWN:
+		return DATE | OBJECTS;
+	case EventCondition::CONST_VALUE:
+		return NOTHING;
+	}
+	return EVERYTHING;
+}
+
+ui32 CVictoryConditionWatcher::getReadState(const std::vector<TriggeredEvent> & events)
+{
+	ui32 ret = PLAYERS | OBJECTS; //cheat codes, standard loss
+	for(const TriggeredEvent & event : events)
+	{
+		event.trigger.morph([&](const EventCondition & condition)
+		{
+			ret |= getReadState(condition);
+			return EventExpression::Variant(condition);
+		});
+	}
+	return ret;
+}
+
+ui32 CVictoryConditionWatcher::getModifiedState(ui16 packType)
+{
+	static const std::map<ui16, ui32> modifiedState = []()
+	{
+		std::map<ui16, ui32> ret;
+		auto add = [&](ui16 type, ui32 kinds)
+		{
+			ret[type] = kinds;
+		};
+
+		add(typeList.getTypeID<SetResource>(), RESOURCES);
+		add(typeList.getTypeID<SetResources>(), RESOURCES);
+
+		add(typeList.getTypeID<PutArtifact>(), ARTIFACTS);
+		add(typeList.getTypeID<EraseArtifact>(), ARTIFACTS);
+		add(typeList.getTypeID<MoveArtifact>(), ARTIFACTS);
+		add(typeList.getTypeID<AssembledArtifact>(), ARTIFACTS);
+		add(typeList.getTypeID<DisassembledArtifact>(), ARTIFACTS);
+		add(typeList.getTypeID<NewArtifact>(), ARTIFACTS);
+
+		add(typeList.getTypeID<ChangeStackCount>(), ARMIES);
+		add(typeList.getTypeID<SetStackType>(), ARMIES);
+		add(typeList.getTypeID<EraseStack>(), ARMIES);
+		add(typeList.getTypeID<SwapStacks>(), ARMIES);
+		add(typeList.getTypeID<InsertNewStack>(), ARMIES);
+		add(typeList.getTypeID<RebalanceStacks>(), ARMIES);
+
+		add(typeList.getTypeID<NewStructures>(), BUILDINGS);
+		add(typeList.getTypeID<RazeStructures>(), BUILDINGS);
+
+		add(typeList.getTypeID<HeroVisitCastle>(), TOWN_HEROES);
+		add(typeList.getTypeID<SetHeroesInTown>(), TOWN_HEROES);
+
+		add(typeList.getTypeID<YourTurn>(), DATE);
+
+		//packs that do not modify anything conditions read
+		for(ui16 type : {
+			typeList.getTypeID<TryMoveHero>(),
+			typeList.getTypeID<SetMovePoints>(),
+			typeList.getTypeID<SetMana>(),
+			typeList.getTypeID<SetPrimSkill>(),
+			typeList.getTypeID<SetSecSkill>(),
+			typeList.getTypeID<ChangeSpells>(),
+			typeList.getTypeID<HeroLevelUp>(),
+			typeList.getTypeID<CommanderLevelUp>(),
+			typeList.getTypeID<SetCommanderProperty>(),
+			typeList.getTypeID<GiveBonus>(),
+			typeList.getTypeID<RemoveBonus>(),
+			typeList.getTypeID<FoWChange>(),
+			typeList.getTypeID<HeroVisit>(),
+			typeList.getTypeID<ChangeObjectVisitors>(),
+			typeList.getTypeID<AddQuest>(),
+			typeList.getTypeID<SetAvailableHeroes>(),
+			typeList.getTypeID<SetAvailableCreatures>(),
+			typeList.getTypeID<SetAvailableArtifacts>(),
+			typeList.getTypeID<InfoWindow>(),
+			typeList.getTypeID<ShowInInfobox>(),
+			typeList.getTypeID<SystemMessage>(),
+			typeList.getTypeID<PlayerMessage>(),
+			typeList.getTypeID<PlayerBlocked>(),
+			typeList.getTypeID<CenterView>(),
+			typeList.getTypeID<OpenWindow>(),
+			typeList.getTypeID<PackageApplied>(),
+			typeList.getTypeID<BlockingDialog>(),
+			typeList.getTypeID<GarrisonDialog>(),
+			typeList.getTypeID<ExchangeDialog>(),
+			typeList.getTypeID<TeleportDialog>()})
+		{
+			add(type, NOTHING);
+		}
+		return ret;
+	}();
+
+	auto it = modifiedState.find(packType);
+	return it == modifiedState.end() ? EVERYTHING : it->second; //unknown packs may modify anything
+}
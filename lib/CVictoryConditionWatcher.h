@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * CVictoryConditionWatcher.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "int3.h"
+#include "CGameStateFwd.h"
+
+struct EventCondition;
+struct TriggeredEvent;
+
+/// Keeps results of victory / loss checks until state read by conditions of the map changes.
+/// Each condition is compiled to set of state kinds it reads; each applied netpack type is mapped to state kinds it can modify.
+/// Results are dropped only if both sets intersect, so e.g. hero movement does not cause any condition evaluation.
+class DLL_LINKAGE CVictoryConditionWatcher
+{
+public:
+	enum EStateKind : ui32
+	{
+		NOTHING = 0,
+		PLAYERS = 1 << 0, //status of players, cheat codes
+		DATE = 1 << 1, //current day, days without town
+		RESOURCES = 1 << 2,
+		ARTIFACTS = 1 << 3,
+		ARMIES = 1 << 4,
+		BUILDINGS = 1 << 5,
+		TOWN_HEROES = 1 << 6, //visiting and garrisoned heroes of towns
+		OBJECTS = 1 << 7, //existence and owners of objects, map events
+		EVERYTHING = 0xFFFFFFFF
+	};
+
+	CVictoryConditionWatcher();
+
+	/// Returns false if result for given player has to be evaluated
+	bool getResult(PlayerColor player, const std::vector<TriggeredEvent> & events, EVictoryLossCheckResult & out);
+	void setResult(PlayerColor player, const EVictoryLossCheckResult & result);
+
+	void packApplied(ui16 packType); //type ID of netpack, as assigned by typeList
+	void stateChanged(ui32 kinds = EVERYTHING); //for changes made outside of netpacks
+
+	static ui32 getReadState(const EventCondition & condition);
+	static ui32 getReadState(const std::vector<TriggeredEvent> & events); //including cheat codes and standard loss
+	static ui32 getModifiedState(ui16 packType);
+
+private:
+	boost::mutex mx;
+	bool readStateKnown;
+	ui32 readState;
+	std::map<PlayerColor, EVictoryLossCheckResult> results;
+};
@@ -5,6 +5,7 @@
 #include "mapping/CMap.h"
 #include "CGameState.h"
 #include "filesystem/FileStream.h"
+#include "ScopeGuard.h"
 
 #include <boost/asio.hpp>
 
@@ -40,6 +41,9 @@ CTypeList typeList;
 
 void CConnection::init()
 {
+	measuringIO = receivedFirstByte = false;
+	ioBytes = 0;
+
 	boost::asio::ip::tcp::no_delay option(true);
 	socket->set_option(option);
 
@@ -146,8 +150,13 @@ int CConnection::write(const void * data, unsigned size)
 	//LOG("Sending " << size << " byte(s) of data" <<std::endl);
 	try
 	{
-		int ret;
-		ret = boost::asio::write(*socket,boost::asio::const_buffers_1(boost::asio::const_buffer(data,size)));
+		if(!measuringIO)
+			return boost::asio::write(*socket,boost::asio::const_buffers_1(boost::asio::const_buffer(data,size)));
+
+		auto start = CNetworkStatistics::TClock::now();
+		int ret = boost::asio::write(*socket,boost::asio::const_buffers_1(boost::asio::const_buffer(data,size)));
+		ioTime += CNetworkStatistics::TClock::now() - start;
+		ioBytes += ret;
 		return ret;
 	}
 	catch(...)
@@ -163,6 +172,16 @@ int CConnection::read(void * data, unsigned size)
 	try
 	{
 		int ret = boost::asio::read(*socket,boost::asio::mutable_buffers_1(boost::asio::mutable_buffer(data,size)));
+		if(measuringIO)
+		{
+			if(!receivedFirstByte)
+			{
+				//time spent waiting for the pack to arrive is not a part of receiving it
+				firstByteTime = CNetworkStatistics::TClock::now();
+				receivedFirstByte = true;
+			}
+			ioBytes += ret;
+		}
 		return ret;
 	}
 	catch(...)
@@ -219,21 +238,88 @@ void CConnection::reportState(CLogger * out)
 	}
 }
 
+void CConnection::startMeasuringIO()
+{
+	measuringIO = true;
+	receivedFirstByte = false;
+	ioBytes = 0;
+	ioTime = CNetworkStatistics::TClock::duration::zero();
+}
+
+void CConnection::stopMeasuringIO()
+{
+	measuringIO = false;
+}
+
+void CConnection::sendMeasured(const CPack * pack, const std::function<void()> & writer)
+{
+	auto & stats = CNetworkStatistics::get();
+	auto start = CNetworkStatistics::TClock::now();
+
+	startMeasuringIO();
+	auto guard = vstd::makeScopeGuard([&]{ stopMeasuringIO(); });
+	writer();
+
+	stats.recordTime(pack, CNetworkStatistics::SEND, ioTime);
+	stats.recordTime(pack, CNetworkStatistics::SERIALIZE, CNetworkStatistics::TClock::now() - start - ioTime);
+	stats.recordSent(pack, ioBytes);
+}
+
+CPack * CConnection::retreiveMeasured(const std::function<CPack *()> & reader)
+{
+	startMeasuringIO();
+	auto guard = vstd::makeScopeGuard([&]{ stopMeasuringIO(); });
+	CPack * ret = reader();
+
+	auto & stats = CNetworkStatistics::get();
+	if(receivedFirstByte)
+		stats.recordTime(ret, CNetworkStatistics::RECEIVE, CNetworkStatistics::TClock::now() - firstByteTime);
+	stats.recordReceived(ret, ioBytes);
+	return ret;
+}
+
 CPack * CConnection::retreivePack()
 {
-	CPack *ret = nullptr;
 	boost::unique_lock<boost::mutex> lock(*rmx);
 	logNetwork->traceStream() << "Listening... ";
-	iser >> ret;
+	CPack *ret = retreiveMeasured([&]() -> CPack *
+	{
+		CPack *pack = nullptr;
+		iser >> pack;
+		return pack;
+	});
 	logNetwork->traceStream() << "\treceived server message of type " << typeid(*ret).name() << ", data: " << ret;
 	return ret;
 }
 
+CPack * CConnection::retreivePackFromClient(PlayerColor &player, si32 &requestID)
+{
+	boost::unique_lock<boost::mutex> lock(*rmx);
+	return retreiveMeasured([&]() -> CPack *
+	{
+		CPack *pack = nullptr;
+		iser >> player >> requestID >> pack;
+		return pack;
+	});
+}
+
 void CConnection::sendPackToServer(const CPack &pack, PlayerColor player, ui32 requestID)
 {
 	boost::unique_lock<boost::mutex> lock(*wmx);
 	logNetwork->traceStream() << "Sending to server a pack of type " << typeid(pack).name();
-	oser << player << requestID << &pack; //packs has to be sent as polymorphic pointers!
+	sendMeasured(&pack, [&]
+	{
+		oser << player << requestID << &pack; //packs has to be sent as polymorphic pointers!
+	});
+}
+
+void CConnection::sendPack(const CPack * pack)
+{
+	boost::unique_lock<boost::mutex> lock(*wmx);
+	sendMeasured(pack, [&]
+	{
+		oser << pack;
+	});
 }
 
 void CConnection::disableStackSendingByID()
@@ -645,3 +731,19 @@ CMemorySerializer::CMemorySerializer(): iser(this), oser(this)
 	registerTypes(iser);
 	registerTypes(oser);
 }
+
+int CChecksumSerializer::write(const void * data, unsigned size)
+{
+	crc.process_bytes(data, size);
+	return size;
+}
+
+CChecksumSerializer::CChecksumSerializer(): oser(this)
+{
+	registerTypes(oser);
+}
+
+ui32 CChecksumSerializer::checksum() const
+{
+	return crc.checksum();
+}
@@ -22,12 +22,13 @@
 #include <boost/any.hpp>
 
 #include "ConstTransitivePtr.h"
+#include "CNetworkStatistics.h"
 #include "CCreatureSet.h" //for CStackInstance
 #include "mapObjects/CGHeroInstance.h"
 #include "mapping/CCampaignHandler.h" //for CCampaignState
 #include "rmg/CMapGenerator.h" // for CMapGenOptions
 
-const ui32 version = 759;
+const ui32 version = 760;
 const ui32 minSupportedVersion = 753;
 
 class CISer;
@@ -1626,6 +1627,17 @@ class DLL_LINKAGE CConnection
 
 	void init();
     void reportState(CLogger * out) override;
+
+	//measuring of socket activity of currently processed pack, see CNetworkStatistics
+	bool measuringIO, receivedFirstByte;
+	ui64 ioBytes;
+	CNetworkStatistics::TClock::duration ioTime;
+	CNetworkStatistics::TClock::time_point firstByteTime;
+
+	void startMeasuringIO();
+	void stopMeasuringIO();
+	void sendMeasured(const CPack * pack, const std::function<void()> & writer);
+	CPack * retreiveMeasured(const std::function<CPack *()> & reader);
 public:
 	CISer iser;
 	COSer oser;
@@ -1656,7 +1668,9 @@ public:
 	virtual ~CConnection(void);
 
 	CPack *retreivePack(); //gets from server next pack (allocates it with new)
+	CPack *retreivePackFromClient(PlayerColor &player, si32 &requestID); //gets from client next request (allocates it with new)
 	void sendPackToServer(const CPack &pack, PlayerColor player, ui32 requestID);
+	void sendPack(const CPack * pack); //sends pack as polymorphic pointer, locks write mutex
 
 	void disableStackSendingByID();
 	void enableStackSendingByID();
@@ -1714,6 +1728,29 @@ public:
 	}
 };
 
+// Serializer that only calculates checksum of written data. Allows comparing states of two games.
+class DLL_LINKAGE CChecksumSerializer
+	: public IBinaryWriter
+{
+	boost::crc_32_type crc;
+public:
+	COSer oser;
+
+	int write(const void * data, unsigned size) override;
+
+	CChecksumSerializer();
+
+	ui32 checksum() const;
+
+	template <typename T>
+	static ui32 calculate(const T &data)
+	{
+		CChecksumSerializer serializer;
+		serializer.oser << data;
+		return serializer.checksum();
+	}
+};
+
 template<typename T>
 class CApplier
 {
@@ -222,6 +222,17 @@ class ObjectInstanceID : public BaseForID<ObjectInstanceID, si32>
 	friend class CNonConstInfoCallback;
 };
 
+namespace std
+{
+	template <> struct hash<ObjectInstanceID>
+	{
+		size_t operator()(const ObjectInstanceID & id) const
+		{
+			return std::hash<si32>()(id.getNum());
+		}
+	};
+}
+
 
 class HeroTypeID : public BaseForID<HeroTypeID, si32>
 {
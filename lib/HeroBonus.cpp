@@ -81,7 +81,7 @@ const std::map<std::string, TPropagatorPtr> bonusPropagatorMap =
 
 #define BONUS_LOG_LINE(x) logBonus->traceStream() << x
 
-int CBonusSystemNode::treeChanged = 1;
+std::atomic<int> CBonusSystemNode::treeChanged(1);
 const bool CBonusSystemNode::cachingEnabled = true;
 
 BonusList::BonusList(bool BelongsToTree /* =false */) : belongsToTree(BelongsToTree)
@@ -623,7 +623,8 @@ const TBonusListPtr CBonusSystemNode::getAllBonuses(const CSelector &selector, c
 
 		// If the bonus system tree changes(state of a single node or the relations to each other) then
 		// cache all bonus objects. Selector objects doesn't matter.
-		if (cachedLast != treeChanged)
+		const int currentTree = treeChanged;
+		if (cachedLast != currentTree)
 		{
 			cachedBonuses.clear();
 			cachedRequests.clear();
@@ -633,7 +634,7 @@ const TBonusListPtr CBonusSystemNode::getAllBonuses(const CSelector &selector, c
 			allBonuses.eliminateDuplicates();
 			limitBonuses(allBonuses, cachedBonuses);
 
-			cachedLast = treeChanged;
+			cachedLast = currentTree;
 		}
 
 		// If a bonus system request comes with a caching string then look up in the map if there are any
@@ -635,7 +635,7 @@ private:
 	static const bool cachingEnabled;
 	mutable BonusList cachedBonuses;
 	mutable int cachedLast;
-	static int treeChanged;
+	static std::atomic<int> treeChanged; //shared by all game states, read by concurrent threads
 
 	// Setting a value to cachingStr before getting any bonuses caches the result for later requests.
 	// This string needs to be unique, that's why it has to be setted in the following manner:
@@ -56,6 +56,15 @@ void CPrivilagedInfoCallback::getTilesInRange( std::unordered_set<int3, ShashInt
 	}
 	if (radious == -1) //reveal entire map
 		getAllTiles (tiles, player, -1, 0);
+	else if (!patrolDistance)
+	{
+		if(!!player && mode == 0)
+			return;
+
+		std::vector<TileSpan> spans;
+		getTileSpansInRange(spans, pos, radious, player, mode);
+		CFogOfWarMap::getTiles(spans, tiles);
+	}
 	else
 	{
 		const TeamState * team = !player ? nullptr : gs->getPlayerTeam(*player);
@@ -64,17 +73,11 @@ void CPrivilagedInfoCallback::getTilesInRange( std::unordered_set<int3, ShashInt
 			for (int yd = std::max<int>(pos.y - radious, 0); yd <= std::min<int>(pos.y + radious, gs->map->height - 1); yd++)
 			{
 				int3 tilePos(xd,yd,pos.z);
-				double distance;
-				if(patrolDistance)
-					distance = pos.mandist2d(tilePos);
-				else
-					distance = pos.dist2d(tilePos) - 0.5;
-
-				if(distance <= radious)
+				if(pos.mandist2d(tilePos) <= radious)
 				{
 					if(!player
-						|| (mode == 1  && team->fogOfWarMap[xd][yd][pos.z]==0)
-						|| (mode == -1 && team->fogOfWarMap[xd][yd][pos.z]==1)
+						|| (mode == 1  && !team->fogOfWarMap.isVisible(tilePos))
+						|| (mode == -1 && team->fogOfWarMap.isVisible(tilePos))
 					)
 						tiles.insert(int3(xd,yd,pos.z));
 				}
@@ -83,6 +86,21 @@ void CPrivilagedInfoCallback::getTilesInRange( std::unordered_set<int3, ShashInt
 	}
 }
 
+void CPrivilagedInfoCallback::getTileSpansInRange(std::vector<TileSpan> &spans, int3 pos, int radious, boost::optional<PlayerColor> player/*=uninit*/, int mode/*=0*/) const
+{
+	if(!!player && *player >= PlayerColor::PLAYER_LIMIT)
+	{
+		logGlobal->errorStream() << "Illegal call to getTileSpansInRange!";
+		return;
+	}
+	if (radious == -1) //entire map, regardless of mode as in getTilesInRange
+		getAllTileSpans(spans, -1, 0);
+	else if (!player || mode == 0)
+		CFogOfWarMap::getCircleSpans(spans, pos, radious, int3(gs->map->width, gs->map->height, gs->map->twoLevel ? 2 : 1));
+	else
+		gs->getPlayerTeam(*player)->fogOfWarMap.getCircleSpans(spans, pos, radious, mode == -1);
+}
+
 void CPrivilagedInfoCallback::getAllTiles (std::unordered_set<int3, ShashInt3> &tiles, boost::optional<PlayerColor> Player/*=uninit*/, int level, int surface ) const
 {
 	if(!!Player && *Player >= PlayerColor::PLAYER_LIMIT)
@@ -119,6 +137,38 @@ void CPrivilagedInfoCallback::getAllTiles (std::unordered_set<int3, ShashInt3> &
 	}
 }
 
+void CPrivilagedInfoCallback::getAllTileSpans(std::vector<TileSpan> &spans, int level, int surface) const
+{
+	const bool water = surface == 0 || surface == 2,
+		land = surface == 0 || surface == 1;
+	const int levels = gs->map->twoLevel ? 2 : 1;
+
+	for (int zd = level == -1 ? 0 : level; zd < (level == -1 ? levels : level + 1); zd++)
+	{
+		for (int yd = 0; yd < gs->map->height; yd++)
+		{
+			int start = -1; //first tile of current span
+			for (int xd = 0; xd <= gs->map->width; xd++)
+			{
+				bool matches = false;
+				if (xd < gs->map->width)
+				{
+					const bool isWater = gs->map->getTile(int3(xd, yd, zd)).terType == ETerrainType::WATER;
+					matches = isWater ? water : land;
+				}
+
+				if (matches && start < 0)
+					start = xd;
+				else if (!matches && start >= 0)
+				{
+					spans.push_back(TileSpan(int3(start, yd, zd), xd - start));
+					start = -1;
+				}
+			}
+		}
+	}
+}
+
 void CPrivilagedInfoCallback::pickAllowedArtsSet(std::vector<const CArtifact*> &out)
 {
 	for (int j = 0; j < 3 ; j++)
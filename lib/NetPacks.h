@@ -10,6 +10,7 @@
 //#include "StartInfo.h"
 #include "ConstTransitivePtr.h"
 #include "int3.h"
+#include "CFogOfWarMap.h"
 #include "ResourceSet.h"
 //#include "CObstacleInstance.h"
 #include "CGameStateFwd.h"
@@ -313,13 +314,13 @@ struct FoWChange : public CPackForClient //112
 	void applyCl(CClient *cl);
 	DLL_LINKAGE void applyGs(CGameState *gs);
 
-	std::unordered_set<int3, struct ShashInt3 > tiles;
+	std::vector<TileSpan> spans; //changed tiles, see CFogOfWarMap::toSpans
 	PlayerColor player;
 	ui8 mode; //mode==0 - hide, mode==1 - reveal
 	bool waitForDialogs;
 	template <typename Handler> void serialize(Handler &h, const int version)
 	{
-		h & tiles & player & mode & waitForDialogs;
+		h & spans & player & mode & waitForDialogs;
 	}
 };
 
@@ -566,7 +567,7 @@ struct TryMoveHero : public CPackForClient //501
 	ui32 movePoints;
 	EResult result; //uses EResult
 	int3 start, end; //h3m format
-	std::unordered_set<int3, ShashInt3> fowRevealed; //revealed tiles
+	std::vector<TileSpan> fowRevealed; //revealed tiles
 	boost::optional<int3> attackedFrom; // Set when stepping into endangered tile.
 
 	bool humanKnows; //used locally during applying to client
@@ -206,11 +206,9 @@ DLL_LINKAGE void SetMovePoints::applyGs( CGameState *gs )
 DLL_LINKAGE void FoWChange::applyGs( CGameState *gs )
 {
 	TeamState * team = gs->getPlayerTeam(player);
-	for(int3 t : tiles)
-		team->fogOfWarMap[t.x][t.y][t.z] = mode;
+	team->fogOfWarMap.setSpans(spans, mode);
 	if (mode == 0) //do not hide too much
 	{
-		std::unordered_set<int3, ShashInt3> tilesRevealed;
 		for (auto & elem : gs->map->objects)
 		{
 			const CGObjectInstance *o = elem;
@@ -223,13 +221,11 @@ DLL_LINKAGE void FoWChange::applyGs( CGameState *gs )
 				case Obj::TOWN:
 				case Obj::ABANDONED_MINE:
 					if(vstd::contains(team->players, o->tempOwner)) //check owned observators
-						gs->getTilesInRange(tilesRevealed, o->getSightCenter(), o->getSightRadius(), o->tempOwner, 1);
+						team->fogOfWarMap.setCircle(o->getSightCenter(), o->getSightRadius(), true);
 					break;
 				}
 			}
 		}
-		for(int3 t : tilesRevealed) //probably not the most optimal solution ever
-			team->fogOfWarMap[t.x][t.y][t.z] = 1;
 	}
 }
 DLL_LINKAGE void SetAvailableHeroes::applyGs( CGameState *gs )
@@ -381,12 +377,14 @@ DLL_LINKAGE void RemoveObject::applyGs( CGameState *gs )
 		if(!vstd::contains(gs->hpool.pavailable, h->subID))
 			gs->hpool.pavailable[h->subID] = 0xff;
 
+		gs->map->removeFromObjectLookup(h);
 		gs->map->objects[id.getNum()] = nullptr;
 
 		//If hero on Boat is removed, the Boat disappears
 		if(h->boat)
 		{
 			gs->map->instanceNames.erase(h->boat->instanceName);
+			gs->map->removeFromObjectLookup(h->boat);
 			gs->map->objects[h->boat->id.getNum()].dellNull();
 			h->boat = nullptr;
 		}
@@ -432,8 +430,8 @@ DLL_LINKAGE void RemoveObject::applyGs( CGameState *gs )
 		event.trigger = event.trigger.morph(patcher);
 	}
 	gs->map->instanceNames.erase(obj->instanceName);
+	gs->map->removeFromObjectLookup(obj);
 	gs->map->objects[id.getNum()].dellNull();
-	gs->map->calculateGuardingGreaturePositions();
 }
 
 static int getDir(int3 src, int3 dst)
@@ -522,8 +520,7 @@ void TryMoveHero::applyGs( CGameState *gs )
 		gs->map->addBlockVisTiles(h);
 	}
 
-	for(int3 t : fowRevealed)
-		gs->getPlayerTeam(h->getOwner())->fogOfWarMap[t.x][t.y][t.z] = 1;
+	gs->getPlayerTeam(h->getOwner())->fogOfWarMap.setSpans(fowRevealed, true);
 }
 
 DLL_LINKAGE void NewStructures::applyGs( CGameState *gs )
@@ -613,6 +610,7 @@ DLL_LINKAGE void HeroRecruited::applyGs( CGameState *gs )
 	}
 	else
 		gs->map->objects[h->id.getNum()] = h;
+	gs->map->updateObjectLookup(h);
 
 	gs->map->heroesOnMap.push_back(h);
 	p->heroes.push_back(h);
@@ -640,6 +638,7 @@ DLL_LINKAGE void GiveHero::applyGs( CGameState *gs )
 
 	gs->map->removeBlockVisTiles(h,true);
 	h->setOwner(player);
+	gs->map->updateObjectLookup(h);
 	h->movement =  h->maxMovePoints(true);
 	gs->map->heroesOnMap.push_back(h);
 	gs->getPlayer(h->getOwner())->heroes.push_back(h);
@@ -685,7 +684,8 @@ DLL_LINKAGE void NewObject::applyGs( CGameState *gs )
 	gs->map->objects.push_back(o);
 	gs->map->addBlockVisTiles(o);
 	o->initObj();
-	gs->map->calculateGuardingGreaturePositions();
+	gs->map->updateGuardingCreatures(o); //blockvis flag is set on init
+	gs->map->updateObjectLookup(o);
 
 	logGlobal->debugStream() << "added object id=" << id << "; address=" << (intptr_t)o << "; name=" << o->getObjectName();
 }
@@ -1155,6 +1155,9 @@ DLL_LINKAGE void SetObjectProperty::applyGs( CGameState *gs )
 	{
 		obj->setProperty(what,val);
 	}
+
+	if(what == ObjProperty::OWNER || what == ObjProperty::ID)
+		gs->map->updateObjectLookup(obj);
 }
 
 DLL_LINKAGE void HeroLevelUp::applyGs( CGameState *gs )
@@ -1566,7 +1566,7 @@ void CGObservatory::onHeroVisit( const CGHeroInstance * h ) const
 		FoWChange fw;
 		fw.player = h->tempOwner;
 		fw.mode = 1;
-		cb->getTilesInRange (fw.tiles, pos, 20, h->tempOwner, 1);
+		cb->getTileSpansInRange (fw.spans, pos, 20, h->tempOwner, 1);
 		cb->sendAndApply (&fw);
 		break;
 	}
@@ -1903,7 +1903,8 @@ void CGMagi::onHeroVisit(const CGHeroInstance * h) const
 			{
 				const CGObjectInstance *eye = cb->getObj(it);
 
-				cb->getTilesInRange (fw.tiles, eye->pos, 10, h->tempOwner, 1);
+				fw.spans.clear(); //tiles revealed by previous eyes are already visible
+				cb->getTileSpansInRange (fw.spans, eye->pos, 10, h->tempOwner, 1);
 				cb->sendAndApply(&fw);
 				cv.pos = eye->pos;
 
@@ -2068,7 +2069,7 @@ void CCartographer::blockingDialogAnswered(const CGHeroInstance *hero, ui32 answ
 
 		//subIDs of different types of cartographers:
 		//water = 0; land = 1; underground = 2;
-		cb->getAllTiles (fw.tiles, hero->tempOwner, subID - 1, !subID + 1); //reveal appropriate tiles
+		cb->getAllTileSpans (fw.spans, subID - 1, !subID + 1); //reveal appropriate tiles
 		cb->sendAndApply (&fw);
 		cb->setObjProperty (id, CCartographer::OBJPROP_VISITED, hero->tempOwner.getNum());
 	}
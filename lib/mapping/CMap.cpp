@@ -11,6 +11,7 @@
 #include "../CGeneralTextHandler.h"
 #include "../spells/CSpellHandler.h"
 #include "CMapEditManager.h"
+#include "../CThreadHelper.h"
 
 SHeroName::SHeroName() : heroId(-1)
 {
@@ -217,7 +218,7 @@ CMapHeader::~CMapHeader()
 
 }
 
-CMap::CMap() : checksum(0), grailPos(-1, -1, -1), grailRadius(0), terrain(nullptr)
+CMap::CMap() : checksum(0), grailPos(-1, -1, -1), grailRadius(0)
 {
 	allHeroes.resize(allowedHeroes.size());
 	allowedAbilities = VLC->heroh->getDefaultAllowedAbilities();
@@ -227,28 +228,13 @@ CMap::CMap() : checksum(0), grailPos(-1, -1, -1), grailRadius(0), terrain(nullpt
 
 CMap::~CMap()
 {
-	if(terrain)
-	{
-		for (int i=0; i<width; i++)
-		{
-			for(int j=0; j<height; j++)
-			{
-				delete [] terrain[i][j];
-				delete [] guardingCreaturePositions[i][j];
-			}
-			delete [] terrain[i];
-			delete [] guardingCreaturePositions[i];
-		}
-		delete [] terrain;
-		delete [] guardingCreaturePositions;
-	}
-
 	for(auto obj : objects)
 		obj.dellNull();
 }
 
 void CMap::removeBlockVisTiles(CGObjectInstance * obj, bool total)
 {
+	objectsIndex.remove(obj);
 	for(int fx=0; fx<obj->getWidth(); ++fx)
 	{
 		for(int fy=0; fy<obj->getHeight(); ++fy)
@@ -258,7 +244,7 @@ void CMap::removeBlockVisTiles(CGObjectInstance * obj, bool total)
 			int zVal = obj->pos.z;
 			if(xVal>=0 && xVal<width && yVal>=0 && yVal<height)
 			{
-				TerrainTile & curt = terrain[xVal][yVal][zVal];
+				TerrainTile & curt = getTile(int3(xVal, yVal, zVal));
 				if(total || obj->visitableAt(xVal, yVal))
 				{
 					curt.visitableObjects -= obj;
@@ -272,10 +258,12 @@ void CMap::removeBlockVisTiles(CGObjectInstance * obj, bool total)
 			}
 		}
 	}
+	updateGuardingCreatures(obj);
 }
 
 void CMap::addBlockVisTiles(CGObjectInstance * obj)
 {
+	objectsIndex.add(obj);
 	for(int fx=0; fx<obj->getWidth(); ++fx)
 	{
 		for(int fy=0; fy<obj->getHeight(); ++fy)
@@ -285,7 +273,7 @@ void CMap::addBlockVisTiles(CGObjectInstance * obj)
 			int zVal = obj->pos.z;
 			if(xVal>=0 && xVal<width && yVal>=0 && yVal<height)
 			{
-				TerrainTile & curt = terrain[xVal][yVal][zVal];
+				TerrainTile & curt = getTile(int3(xVal, yVal, zVal));
 				if( obj->visitableAt(xVal, yVal))
 				{
 					curt.visitableObjects.push_back(obj);
@@ -299,17 +287,52 @@ void CMap::addBlockVisTiles(CGObjectInstance * obj)
 			}
 		}
 	}
+	updateGuardingCreatures(obj);
 }
 
 void CMap::calculateGuardingGreaturePositions()
 {
+	static const int ROWS_PER_TASK = 16;
+
+	//every tile is computed from its neighbourhood only, so bands of rows can be done in parallel
+	std::vector<Task> tasks;
 	int levels = twoLevel ? 2 : 1;
-	for (int i=0; i<width; i++)
+	for (int k = 0; k < levels; k++)
+	{
+		for (int j = 0; j < height; j += ROWS_PER_TASK)
+		{
+			tasks.push_back([=]()
+			{
+				updateGuardingCreatures(int3(0, j, k), int3(width - 1, j + ROWS_PER_TASK - 1, k));
+			});
+		}
+	}
+	CThreadHelper::runTasks(tasks, 4);
+}
+
+void CMap::updateGuardingCreatures(const CGObjectInstance * obj)
+{
+	// object changes monsters on its tiles and blockvis objects checked for tiles around them
+	updateGuardingCreatures(obj->pos - int3(obj->getWidth(), obj->getHeight(), 0), obj->pos + int3(1, 1, 0));
+}
+
+void CMap::updateGuardingCreatures(int3 from, int3 to)
+{
+	if(guardingCreaturePositions.empty() || from.z < 0 || from.z >= (twoLevel ? 2 : 1))
+		return;
+
+	from.x = std::max(from.x, 0);
+	from.y = std::max(from.y, 0);
+	to.x = std::min(to.x, width - 1);
+	to.y = std::min(to.y, height - 1);
+	for(int y = from.y; y <= to.y; y++)
 	{
-		for(int j=0; j<height; j++)
+		for(int x = from.x; x <= to.x; x++)
 		{
-			for (int k = 0; k < levels; k++)
-				guardingCreaturePositions[i][j][k] = guardingCreaturePosition(int3(i,j,k));
+			const int3 pos(x, y, from.z);
+			const size_t index = getTileIndex(pos);
+			guardingCreaturesMasks[index] = calculateGuardingCreaturesMask(pos);
+			guardingCreaturePositions[index] = guardingCreaturePosition(pos);
 		}
 	}
 }
@@ -364,18 +387,6 @@ bool CMap::isInTheMap(const int3 & pos) const
 	}
 }
 
-TerrainTile & CMap::getTile(const int3 & tile)
-{
-	assert(isInTheMap(tile));
-	return terrain[tile.x][tile.y][tile.z];
-}
-
-const TerrainTile & CMap::getTile(const int3 & tile) const
-{
-	assert(isInTheMap(tile));
-	return terrain[tile.x][tile.y][tile.z];
-}
-
 bool CMap::isWaterTile(const int3 &pos) const
 {
 	return isInTheMap(pos) && getTile(pos).isWater();
@@ -418,36 +429,72 @@ int3 CMap::guardingCreaturePosition (int3 pos) const
 		}
 	}
 
-	// See if there are any monsters adjacent.
-	bool water = posTile.isWater();
+	// See if there are any monsters adjacent, first one in the mask order guards the tile.
+	const ui16 mask = calculateGuardingCreaturesMask(originalPos);
+	for (int i = 0; i < 9; i++)
+	{
+		if (mask & (1 << i))
+			return originalPos + int3(i / 3 - 1, i % 3 - 1, 0);
+	}
+
+	return int3(-1, -1, -1);
+}
 
-	pos -= int3(1, 1, 0); // Start with top left.
-	for (int dx = 0; dx < 3; dx++)
+ui16 CMap::calculateGuardingCreaturesMask(const int3 & pos) const
+{
+	ui16 mask = 0;
+	const TerrainTile & posTile = getTile(pos);
+	const bool water = posTile.isWater();
+	for (int dx = -1; dx <= 1; dx++)
 	{
-		for (int dy = 0; dy < 3; dy++)
+		for (int dy = -1; dy <= 1; dy++)
 		{
-			if (isInTheMap(pos))
+			const int3 guardPos = pos + int3(dx, dy, 0);
+			if (!isInTheMap(guardPos))
+				continue;
+
+			const auto & tile = getTile(guardPos);
+			if (tile.visitable && tile.isWater() == water)
 			{
-				const auto & tile = getTile(pos);
-                if (tile.visitable && (tile.isWater() == water))
+				for (CGObjectInstance * obj : tile.visitableObjects)
 				{
-					for (CGObjectInstance* obj : tile.visitableObjects)
+					if (obj->ID == Obj::MONSTER && checkForVisitableDir(guardPos, &posTile, pos)) // Monster being able to attack investigated tile
 					{
-						if (obj->ID == Obj::MONSTER  &&  checkForVisitableDir(pos, &posTile, originalPos)) // Monster being able to attack investigated tile
-						{
-							return pos;
-						}
+						mask |= 1 << (3 * (dx + 1) + dy + 1);
+						break;
 					}
 				}
 			}
-
-			pos.y++;
 		}
-		pos.y -= 3;
-		pos.x++;
 	}
+	return mask;
+}
 
-	return int3(-1, -1, -1);
+std::vector<CGObjectInstance *> CMap::guardingCreatures(const int3 & pos) const
+{
+	std::vector<CGObjectInstance *> guards;
+	if (!isInTheMap(pos))
+		return guards;
+
+	for (CGObjectInstance * obj : getTile(pos).visitableObjects)
+	{
+		if (obj->blockVisit && obj->ID == Obj::MONSTER)
+			guards.push_back(obj);
+	}
+
+	const ui16 mask = getGuardingCreaturesMask(pos);
+	for (int i = 0; i < 9; i++)
+	{
+		if (!(mask & (1 << i)))
+			continue;
+
+		for (CGObjectInstance * obj : getTile(pos + int3(i / 3 - 1, i % 3 - 1, 0)).visitableObjects)
+		{
+			if (obj->ID == Obj::MONSTER)
+				guards.push_back(obj);
+		}
+	}
+	return guards;
 }
 
 const CGObjectInstance * CMap::getObjectiveObjectFrom(int3 pos, Obj::EObj type)
@@ -578,6 +625,7 @@ void CMap::addNewObject(CGObjectInstance * obj)
     objects.push_back(obj);
     instanceNames[obj->instanceName] = obj;
     addBlockVisTiles(obj);
+	objectLookup.update(obj);
 
 	if(obj->ID == Obj::TOWN)
 	{
@@ -591,18 +639,46 @@ void CMap::addNewObject(CGObjectInstance * obj)
 
 void CMap::initTerrain()
 {
-	int level = twoLevel ? 2 : 1;
-	terrain = new TerrainTile**[width];
-	guardingCreaturePositions = new int3**[width];
-	for (int i = 0; i < width; ++i)
+	const size_t tilesCount = size_t(width) * height * (twoLevel ? 2 : 1);
+	terrain.assign(tilesCount, TerrainTile());
+	guardingCreaturePositions.assign(tilesCount, int3());
+	guardingCreaturesMasks.assign(tilesCount, 0);
+	objectsIndex.resize(int3(width, height, twoLevel ? 2 : 1));
+}
+
+void CMap::rebuildObjectsIndex()
+{
+	objectsIndex.resize(int3(width, height, twoLevel ? 2 : 1));
+	//objects cover many tiles, each is added once
+	std::unordered_set<const CGObjectInstance *> added;
+	for(auto & tile : terrain)
 	{
-		terrain[i] = new TerrainTile*[height];
-		guardingCreaturePositions[i] = new int3*[height];
-		for (int j = 0; j < height; ++j)
-		{
-			terrain[i][j] = new TerrainTile[level];
-			guardingCreaturePositions[i][j] = new int3[level];
-		}
+		for(CGObjectInstance * obj : tile.blockingObjects)
+			if(added.insert(obj).second)
+				objectsIndex.add(obj);
+		for(CGObjectInstance * obj : tile.visitableObjects)
+			if(added.insert(obj).second)
+				objectsIndex.add(obj);
+	}
+}
+
+void CMap::updateObjectLookup(CGObjectInstance * obj)
+{
+	objectLookup.update(obj);
+}
+
+void CMap::removeFromObjectLookup(const CGObjectInstance * obj)
+{
+	objectLookup.remove(obj);
+}
+
+void CMap::rebuildObjectLookup()
+{
+	objectLookup.clear();
+	for(auto & obj : objects)
+	{
+		if(obj)
+			objectLookup.update(obj);
 	}
 }
 
@@ -20,6 +20,8 @@
 #include "../GameConstants.h"
 #include "../LogicalExpression.h"
 #include "CMapDefines.h"
+#include "CObjectSpatialIndex.h"
+#include "CObjectLookupIndex.h"
 
 class CArtifactInstance;
 class CGObjectInstance;
@@ -298,18 +300,54 @@ public:
 	void initTerrain();
 
 	CMapEditManager * getEditManager();
-	TerrainTile & getTile(const int3 & tile);
-	const TerrainTile & getTile(const int3 & tile) const;
+
+	/// Index of tile in terrain storage, tiles are stored row by row and level by level
+	size_t getTileIndex(const int3 & tile) const
+	{
+		return (size_t(tile.z) * height + tile.y) * width + tile.x;
+	}
+	TerrainTile & getTile(const int3 & tile)
+	{
+		assert(isInTheMap(tile));
+		return terrain[getTileIndex(tile)];
+	}
+	const TerrainTile & getTile(const int3 & tile) const
+	{
+		assert(isInTheMap(tile));
+		return terrain[getTileIndex(tile)];
+	}
+	/// Position of creature guarding given tile, kept up to date together with blocked and visitable tiles
+	const int3 & getGuardingCreaturePosition(const int3 & tile) const
+	{
+		return guardingCreaturePositions[getTileIndex(tile)];
+	}
+	/// Tiles around given one with monsters able to attack it, bit 3*(dx+1)+(dy+1) is set for neighbour tile+(dx,dy)
+	ui16 getGuardingCreaturesMask(const int3 & tile) const
+	{
+		return guardingCreaturesMasks[getTileIndex(tile)];
+	}
 	bool isCoastalTile(const int3 & pos) const;
 	bool isInTheMap(const int3 & pos) const;
 	bool isWaterTile(const int3 & pos) const;
 
 	bool checkForVisitableDir( const int3 & src, const TerrainTile *pom, const int3 & dst ) const;
 	int3 guardingCreaturePosition (int3 pos) const;
+	std::vector<CGObjectInstance *> guardingCreatures(const int3 & pos) const; //blockvis monster on tile and all monsters able to attack it
 
 	void addBlockVisTiles(CGObjectInstance * obj);
 	void removeBlockVisTiles(CGObjectInstance * obj, bool total = false);
 	void calculateGuardingGreaturePositions();
+	void updateGuardingCreatures(const CGObjectInstance * obj); //recalculates guards of tiles that obj may affect, done by add/removeBlockVisTiles
+
+	/// Spatial index of objects placed on the map, updated together with blocked and visitable tiles
+	const CObjectSpatialIndex & getObjectsIndex() const { return objectsIndex; }
+
+	/// Objects grouped by type and owner. Netpacks adding, removing or changing objects keep it up to date,
+	/// map loading and game state initialization rebuild it when objects are final.
+	const CObjectLookupIndex & getObjectLookup() const { return objectLookup; }
+	void updateObjectLookup(CGObjectInstance * obj); //after obj was added to objects or its ID or owner changed
+	void removeFromObjectLookup(const CGObjectInstance * obj);
+	void rebuildObjectLookup();
 
 	void addNewArtifactInstance(CArtifactInstance * art);
 	void eraseArtifactInstance(CArtifactInstance * art);
@@ -350,13 +388,21 @@ public:
 
 	std::unique_ptr<CMapEditManager> editManager;
 
-	int3 ***guardingCreaturePositions;
-
 	std::map<std::string, ConstTransitivePtr<CGObjectInstance> > instanceNames;
 
 private:
-	/// a 3-dimensional array of terrain tiles, access is as follows: x, y, level. where level=1 is underground
-	TerrainTile*** terrain;
+	/// terrain tiles, positions of their guards and masks of their guards in one contiguous buffer each, see getTileIndex
+	std::vector<TerrainTile> terrain;
+	std::vector<int3> guardingCreaturePositions;
+	std::vector<ui16> guardingCreaturesMasks; //not serialized, recalculated on load
+
+	ui16 calculateGuardingCreaturesMask(const int3 & pos) const;
+	void updateGuardingCreatures(int3 from, int3 to); //recalculates guards of tiles in rectangle
+
+	CObjectSpatialIndex objectsIndex;
+	CObjectLookupIndex objectLookup;
+
+	void rebuildObjectsIndex();
 
 public:
 	template <typename Handler>
@@ -369,45 +415,19 @@ public:
 
 		//TODO: viccondetails
 		int level = twoLevel ? 2 : 1;
-		if(h.saving)
+		if(!h.saving)
+			initTerrain();
+
+		// tiles are serialized in x, y, level order, as in the old jagged layout
+		for(int i = 0; i < width ; ++i)
 		{
-			// Save terrain
-			for(int i = 0; i < width ; ++i)
+			for(int j = 0; j < height ; ++j)
 			{
-				for(int j = 0; j < height ; ++j)
+				for(int k = 0; k < level; ++k)
 				{
-					for(int k = 0; k < level; ++k)
-					{
-						h & terrain[i][j][k];
-						h & guardingCreaturePositions[i][j][k];
-					}
-				}
-			}
-		}
-		else
-		{
-			// Load terrain
-			terrain = new TerrainTile**[width];
-			guardingCreaturePositions = new int3**[width];
-			for(int i = 0; i < width; ++i)
-			{
-				terrain[i] = new TerrainTile*[height];
-				guardingCreaturePositions[i] = new int3*[height];
-				for(int j = 0; j < height; ++j)
-				{
-					terrain[i][j] = new TerrainTile[level];
-					guardingCreaturePositions[i][j] = new int3[level];
-				}
-			}
-			for(int i = 0; i < width ; ++i)
-			{
-				for(int j = 0; j < height ; ++j)
-				{
-					for(int k = 0; k < level; ++k)
-					{
-						h & terrain[i][j][k];
-						h & guardingCreaturePositions[i][j][k];
-					}
+					const size_t index = getTileIndex(int3(i, j, k));
+					h & terrain[index];
+					h & guardingCreaturePositions[index];
 				}
 			}
 		}
@@ -415,6 +435,13 @@ public:
 		h & objects;
 		h & heroesOnMap & teleportChannels & towns & artInstances;
 
+		if(!h.saving)
+		{
+			rebuildObjectsIndex();
+			rebuildObjectLookup();
+			calculateGuardingGreaturePositions();
+		}
+
 		// static members
 		h & CGKeys::playerKeyMap;
 		h & CGMagi::eyelist;
@@ -0,0 +1,87 @@
+/*
+ * CObjectLookupIndex.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CObjectLookupIndex.h"
+
+#include "../mapObjects/CObjectHandler.h"
+
+namespace
+{
+	const CObjectLookupIndex::TObjects noObjects;
+
+	bool idLess(const CGObjectInstance * a, const CGObjectInstance * b)
+	{
+		return a->id < b->id;
+	}
+}
+
+void CObjectLookupIndex::clear()
+{
+	entries.clear();
+	byType.clear();
+	byOwner.clear();
+}
+
+void CObjectLookupIndex::update(CGObjectInstance * obj)
+{
+	auto it = entries.find(obj);
+	if(it != entries.end())
+	{
+		if(it->second.type == obj->ID && it->second.owner == obj->tempOwner)
+			return;
+		remove(obj);
+	}
+
+	Entry entry;
+	entry.type = obj->ID;
+	entry.owner = obj->tempOwner;
+	entries[obj] = entry;
+	insertSorted(byType[entry.type], obj);
+	insertSorted(byOwner[entry.owner], obj);
+}
+
+void CObjectLookupIndex::remove(const CGObjectInstance * obj)
+{
+	auto it = entries.find(obj);
+	if(it == entries.end())
+		return;
+
+	erase(byType[it->second.type], obj);
+	erase(byOwner[it->second.owner], obj);
+	entries.erase(it);
+}
+
+bool CObjectLookupIndex::contains(const CGObjectInstance * obj) const
+{
+	return vstd::contains(entries, obj);
+}
+
+const CObjectLookupIndex::TObjects & CObjectLookupIndex::getObjectsOfType(Obj type) const
+{
+	auto it = byType.find(type);
+	return it == byType.end() ? noObjects : it->second;
+}
+
+const CObjectLookupIndex::TObjects & CObjectLookupIndex::getObjectsOwnedBy(PlayerColor owner) const
+{
+	auto it = byOwner.find(owner);
+	return it == byOwner.end() ? noObjects : it->second;
+}
+
+void CObjectLookupIndex::insertSorted(TObjects & group, CGObjectInstance * obj)
+{
+	group.insert(std::upper_bound(group.begin(), group.end(), obj, idLess), obj);
+}
+
+void CObjectLookupIndex::erase(TObjects & group, const CGObjectInstance * obj)
+{
+	group.erase(std::find(group.begin(), group.end(), obj));
+}
@@ -0,0 +1,46 @@
+/*
+ * CObjectLookupIndex.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#pragma once
+
+#include "../GameConstants.h"
+
+class CGObjectInstance;
+
+/// Objects present in CMap::objects grouped by type and by owner.
+/// Every group is sorted by object id, so iterating it gives the same order as scanning CMap::objects.
+/// Objects are indexed under ID and owner they had when last updated, see CMap::updateObjectLookup.
+class DLL_LINKAGE CObjectLookupIndex
+{
+public:
+	typedef std::vector<CGObjectInstance *> TObjects;
+
+	void clear();
+	void update(CGObjectInstance * obj); //adds object or moves it to groups of its current ID and owner
+	void remove(const CGObjectInstance * obj);
+	bool contains(const CGObjectInstance * obj) const;
+
+	const TObjects & getObjectsOfType(Obj type) const;
+	const TObjects & getObjectsOwnedBy(PlayerColor owner) const;
+
+private:
+	struct Entry
+	{
+		Obj type;
+		PlayerColor owner;
+	};
+
+	std::unordered_map<const CGObjectInstance *, Entry> entries;
+	std::map<Obj, TObjects> byType;
+	std::map<PlayerColor, TObjects> byOwner;
+
+	static void insertSorted(TObjects & group, CGObjectInstance * obj);
+	static void erase(TObjects & group, const CGObjectInstance * obj);
+};
@@ -0,0 +1,198 @@
+/*
+ * CObjectSpatialIndex.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CObjectSpatialIndex.h"
+
+#include "../mapObjects/CObjectHandler.h"
+
+namespace
+{
+	si64 distance2(const int3 & a, const int3 & b)
+	{
+		const si64 dx = a.x - b.x, dy = a.y - b.y;
+		return dx * dx + dy * dy;
+	}
+
+	int clampCell(int cell, int cellsCount)
+	{
+		return std::max(0, std::min(cell, cellsCount - 1));
+	}
+}
+
+CObjectSpatialIndex::CObjectSpatialIndex():
+	cellsCount(0, 0, 0)
+{
+}
+
+void CObjectSpatialIndex::resize(const int3 & mapSizes)
+{
+	cellsCount = int3((mapSizes.x + CELL_SIZE - 1) / CELL_SIZE, (mapSizes.y + CELL_SIZE - 1) / CELL_SIZE, mapSizes.z);
+	cells.clear();
+	cells.resize(size_t(cellsCount.x) * cellsCount.y * cellsCount.z);
+	positions.clear();
+}
+
+size_t CObjectSpatialIndex::cellIndex(const int3 & pos) const
+{
+	//objects partially outside of the map are kept in border cells
+	const int x = clampCell(pos.x / CELL_SIZE, cellsCount.x);
+	const int y = clampCell(pos.y / CELL_SIZE, cellsCount.y);
+	const int z = clampCell(pos.z, cellsCount.z);
+	return (size_t(z) * cellsCount.y + y) * cellsCount.x + x;
+}
+
+void CObjectSpatialIndex::add(CGObjectInstance * obj)
+{
+	if(cells.empty())
+		return;
+
+	remove(obj);
+	const int3 pos = obj->visitablePos();
+	positions[obj] = pos;
+	cells[cellIndex(pos)].push_back(obj);
+}
+
+void CObjectSpatialIndex::remove(const CGObjectInstance * obj)
+{
+	auto it = positions.find(obj);
+	if(it == positions.end())
+		return;
+
+	auto & cell = cells[cellIndex(it->second)];
+	cell.erase(std::find(cell.begin(), cell.end(), obj));
+	positions.erase(it);
+}
+
+bool CObjectSpatialIndex::contains(const CGObjectInstance * obj) const
+{
+	return vstd::contains(positions, obj);
+}
+
+size_t CObjectSpatialIndex::size() const
+{
+	return positions.size();
+}
+
+template <typename Visitor>
+void CObjectSpatialIndex::forEachInCells(int level, int minX, int minY, int maxX, int maxY, const TFilter & filter, const Visitor & visitor) const
+{
+	if(level < 0 || level >= cellsCount.z)
+		return;
+
+	minX = std::max(minX, 0);
+	minY = std::max(minY, 0);
+	maxX = std::min(maxX, cellsCount.x - 1);
+	maxY = std::min(maxY, cellsCount.y - 1);
+	for(int y = minY; y <= maxY; y++)
+	{
+		for(int x = minX; x <= maxX; x++)
+		{
+			for(CGObjectInstance * obj : cells[(size_t(level) * cellsCount.y + y) * cellsCount.x + x])
+			{
+				if(!filter || filter(obj))
+					visitor(obj, positions.at(obj));
+			}
+		}
+	}
+}
+
+std::vector<CGObjectInstance *> CObjectSpatialIndex::getObjectsInRect(const int3 & from, const int3 & to, const TFilter & filter) const
+{
+	std::vector<CGObjectInstance *> ret;
+	const int minX = std::min(from.x, to.x), maxX = std::max(from.x, to.x);
+	const int minY = std::min(from.y, to.y), maxY = std::max(from.y, to.y);
+
+	forEachInCells(from.z, minX / CELL_SIZE, minY / CELL_SIZE, maxX / CELL_SIZE, maxY / CELL_SIZE, filter,
+		[&](CGObjectInstance * obj, const int3 & pos)
+	{
+		if(pos.x >= minX && pos.x <= maxX && pos.y >= minY && pos.y <= maxY)
+			ret.push_back(obj);
+	});
+	return ret;
+}
+
+std::vector<CGObjectInstance *> CObjectSpatialIndex::getObjectsInRange(const int3 & center, int radius, const TFilter & filter) const
+{
+	std::vector<CGObjectInstance *> ret;
+	const si64 limit = si64(radius) * radius + radius;
+
+	forEachInCells(center.z, (center.x - radius) / CELL_SIZE, (center.y - radius) / CELL_SIZE,
+		(center.x + radius) / CELL_SIZE, (center.y + radius) / CELL_SIZE, filter,
+		[&](CGObjectInstance * obj, const int3 & pos)
+	{
+		if(distance2(pos, center) <= limit)
+			ret.push_back(obj);
+	});
+	return ret;
+}
+
+std::vector<CGObjectInstance *> CObjectSpatialIndex::getNearestObjects(const int3 & pos, size_t count, const TFilter & filter) const
+{
+	std::vector<std::pair<si64, CGObjectInstance *>> found;
+	if(!count || pos.z < 0 || pos.z >= cellsCount.z)
+		return std::vector<CGObjectInstance *>();
+
+	const int3 center(clampCell(pos.x / CELL_SIZE, cellsCount.x), clampCell(pos.y / CELL_SIZE, cellsCount.y), pos.z);
+	const int maxRing = std::max(cellsCount.x, cellsCount.y);
+	auto visitor = [&](CGObjectInstance * obj, const int3 & objPos)
+	{
+		found.push_back(std::make_pair(distance2(objPos, pos), obj));
+	};
+	auto closer = [](const std::pair<si64, CGObjectInstance *> & a, const std::pair<si64, CGObjectInstance *> & b)
+	{
+		//ties are resolved by object id, so result does not depend on memory layout
+		return std::make_pair(a.first, a.second->id.getNum()) < std::make_pair(b.first, b.second->id.getNum());
+	};
+
+	//search square rings of cells around the cell of pos, until no unvisited cell can contain anything closer
+	for(int ring = 0; ring <= maxRing; ring++)
+	{
+		if(ring == 0)
+			forEachInCells(pos.z, center.x, center.y, center.x, center.y, filter, visitor);
+		else
+		{
+			forEachInCells(pos.z, center.x - ring, center.y - ring, center.x + ring, center.y - ring, filter, visitor);
+			forEachInCells(pos.z, center.x - ring, center.y + ring, center.x + ring, center.y + ring, filter, visitor);
+			forEachInCells(pos.z, center.x - ring, center.y - ring + 1, center.x - ring, center.y + ring - 1, filter, visitor);
+			forEachInCells(pos.z, center.x + ring, center.y - ring + 1, center.x + ring, center.y + ring - 1, filter, visitor);
+		}
+
+		if(found.size() >= count)
+		{
+			std::nth_element(found.begin(), found.begin() + count - 1, found.end(), closer);
+			const si64 reach = si64(ring) * CELL_SIZE; //objects in next rings are at least that far away
+			if(found[count - 1].first <= reach * reach)
+				break;
+		}
+	}
+
+	std::sort(found.begin(), found.end(), closer);
+	std::vector<CGObjectInstance *> ret;
+	for(size_t i = 0; i < found.size() && i < count; i++)
+		ret.push_back(found[i].second);
+	return ret;
+}
+
+CObjectSpatialIndex::TFilter CObjectSpatialIndex::ofType(Obj type)
+{
+	return [type](const CGObjectInstance * obj)
+	{
+		return obj->ID == type;
+	};
+}
+
+CObjectSpatialIndex::TFilter CObjectSpatialIndex::ownedBy(PlayerColor owner)
+{
+	return [owner](const CGObjectInstance * obj)
+	{
+		return obj->tempOwner == owner;
+	};
+}
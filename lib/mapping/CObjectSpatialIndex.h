@@ -0,0 +1,53 @@
+/*
+ * CObjectSpatialIndex.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#pragma once
+
+#include "../int3.h"
+#include "../GameConstants.h"
+
+class CGObjectInstance;
+
+/// Uniform grid over map objects present on the map, bucketed by their visitable position.
+/// Kept in sync by CMap::addBlockVisTiles / removeBlockVisTiles, so it contains exactly the objects placed on tiles
+/// (e.g. heroes in garrison or boats carried by heroes are not indexed).
+class DLL_LINKAGE CObjectSpatialIndex
+{
+public:
+	typedef std::function<bool(const CGObjectInstance *)> TFilter;
+
+	static const int CELL_SIZE = 8; //in tiles
+
+	CObjectSpatialIndex();
+
+	void resize(const int3 & mapSizes); //clears the index
+	void add(CGObjectInstance * obj); //updates position if object is already indexed
+	void remove(const CGObjectInstance * obj);
+	bool contains(const CGObjectInstance * obj) const;
+	size_t size() const;
+
+	/// Objects with visitable position inside rectangle between corners (inclusive) on level of first corner
+	std::vector<CGObjectInstance *> getObjectsInRect(const int3 & from, const int3 & to, const TFilter & filter = nullptr) const;
+	/// Objects with visitable position in range of given tile, same metric as getTilesInRange uses
+	std::vector<CGObjectInstance *> getObjectsInRange(const int3 & center, int radius, const TFilter & filter = nullptr) const;
+	/// Up to count objects on level of pos closest to it, sorted by distance
+	std::vector<CGObjectInstance *> getNearestObjects(const int3 & pos, size_t count, const TFilter & filter = nullptr) const;
+
+	static TFilter ofType(Obj type);
+	static TFilter ownedBy(PlayerColor owner);
+
+private:
+	int3 cellsCount; //x, y - cells per row and column, z - levels
+	std::vector<std::vector<CGObjectInstance *>> cells;
+	std::unordered_map<const CGObjectInstance *, int3> positions; //position under which object is indexed
+
+	size_t cellIndex(const int3 & pos) const;
+	template <typename Visitor> void forEachInCells(int level, int minX, int minY, int maxX, int maxY, const TFilter & filter, const Visitor & visitor) const;
+};
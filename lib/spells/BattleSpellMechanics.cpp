@@ -428,7 +428,7 @@ void ObstacleMechanics::applyBattleEffects(const SpellCastEnvironment * env, con
 				if(hex.getX() > 2 && hex.getX() < 14 && !(parameters.cb->battleGetStackByPos(hex, false)) && !(parameters.cb->battleGetObstacleOnPos(hex, false)))
 					availableTiles.push_back(hex);
 			}
-			boost::range::random_shuffle(availableTiles);
+			std::shuffle(availableTiles.begin(), availableTiles.end(), env->getRandomGenerator().getStdGenerator());
 
 			const int patchesForSkill[] = {4, 4, 6, 8};
 			const int patchesToPut = std::min<int>(patchesForSkill[parameters.spellLvl], availableTiles.size());
@@ -0,0 +1,325 @@
+/*
+ * CConcurrentTurns.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CConcurrentTurns.h"
+
+#include "../lib/CGameState.h"
+#include "../lib/CPlayerState.h"
+#include "../lib/Connection.h"
+#include "../lib/NetPacks.h"
+#include "../lib/mapObjects/CGHeroInstance.h"
+#include "../lib/mapObjects/CGTownInstance.h"
+#include "../lib/mapObjects/MiscObjects.h"
+#include "../lib/mapping/CMap.h"
+#include "../lib/spells/CSpellHandler.h"
+
+CConcurrentTurns::CConcurrentTurns(const CGameState * gs):
+	gs(gs), regionsOutdated(false), exclusive(PlayerColor::CANNOT_DETERMINE)
+{
+	computeRegions();
+}
+
+void CConcurrentTurns::packApplied(ui16 packType)
+{
+	//other packs don't change blocked tiles: heroes, boats and monsters stand on tiles that can be visited
+	static const std::set<ui16> changingBlockedTiles =
+	{
+		typeList.getTypeID<NewObject>(),
+		typeList.getTypeID<RemoveObject>(),
+		typeList.getTypeID<ChangeObjPos>()
+	};
+	if(vstd::contains(changingBlockedTiles, packType))
+		regionsOutdated = true;
+}
+
+void CConcurrentTurns::updateRegions() const
+{
+	if(!regionsOutdated)
+		return;
+
+	boost::unique_lock<boost::mutex> lock(regionsMx);
+	if(regionsOutdated.exchange(false))
+		computeRegions();
+}
+
+void CConcurrentTurns::computeRegions() const
+{
+	const CMap * map = gs->map;
+	const int3 sizes(map->width, map->height, map->twoLevel ? 2 : 1);
+	regions.assign(sizes.x * sizes.y * sizes.z, -1);
+
+	//union-find over tile indices; blocked tiles are passable only if something can be visited there (monsters, gates...),
+	//land and water are joined since boats can be taken or built almost anywhere
+	std::vector<si32> parent(regions.size());
+	for(size_t i = 0; i < parent.size(); i++)
+		parent[i] = i;
+
+	auto findRoot = [&](si32 i) -> si32
+	{
+		while(parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+	auto join = [&](si32 a, si32 b)
+	{
+		a = findRoot(a);
+		b = findRoot(b);
+		if(a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	};
+	auto passable = [&](const int3 & pos)
+	{
+		const TerrainTile & tile = map->getTile(pos);
+		return tile.terType != ETerrainType::ROCK && (!tile.blocked || tile.visitable);
+	};
+
+	static const int3 forward[] = {int3(1, 0, 0), int3(-1, 1, 0), int3(0, 1, 0), int3(1, 1, 0)}; //each pair of neighbours once
+	for(int z = 0; z < sizes.z; z++)
+	{
+		for(int y = 0; y < sizes.y; y++)
+		{
+			for(int x = 0; x < sizes.x; x++)
+			{
+				const int3 pos(x, y, z);
+				if(!passable(pos))
+					continue;
+
+				for(const int3 & dir : forward)
+				{
+					const int3 neighbour = pos + dir;
+					if(map->isInTheMap(neighbour) && passable(neighbour))
+						join(map->getTileIndex(pos), map->getTileIndex(neighbour));
+				}
+			}
+		}
+	}
+
+	for(auto & channel : map->teleportChannels)
+	{
+		si32 first = -1;
+		for(auto list : {&channel.second->entrances, &channel.second->exits})
+		{
+			for(ObjectInstanceID id : *list)
+			{
+				const si32 index = map->getTileIndex(map->objects[id.getNum()]->visitablePos());
+				if(first < 0)
+					first = index;
+				else
+					join(first, index);
+			}
+		}
+	}
+
+	for(size_t i = 0; i < regions.size(); i++)
+	{
+		const int3 pos(i % sizes.x, (i / sizes.x) % sizes.y, i / (sizes.x * sizes.y));
+		if(passable(pos))
+			regions[i] = findRoot(i);
+	}
+}
+
+si32 CConcurrentTurns::getRegion(const int3 & pos) const
+{
+	updateRegions();
+	return regions[gs->map->getTileIndex(pos)];
+}
+
+const PlayerState * CConcurrentTurns::getPlayer(PlayerColor player) const
+{
+	auto it = gs->players.find(player);
+	return it == gs->players.end() ? nullptr : &it->second;
+}
+
+std::set<si32> CConcurrentTurns::playerRegions(PlayerColor player) const
+{
+	std::set<si32> ret;
+	const PlayerState * state = getPlayer(player);
+	if(!state)
+		return ret;
+
+	for(auto & hero : state->heroes)
+		ret.insert(getRegion(hero->visitablePos()));
+	for(auto & town : state->towns)
+		ret.insert(getRegion(town->visitablePos()));
+	return ret;
+}
+
+bool CConcurrentTurns::canLeaveRegions(PlayerColor player) const
+{
+	const PlayerState * state = getPlayer(player);
+	if(!state)
+		return false;
+
+	//town portal can take hero to allied town in other region
+	static const SpellID crossingSpells[] = {SpellID::FLY, SpellID::DIMENSION_DOOR, SpellID::TOWN_PORTAL};
+	for(auto & hero : state->heroes)
+	{
+		if(hero->hasBonusOfType(Bonus::FLYING_MOVEMENT))
+			return true;
+		for(SpellID spell : crossingSpells)
+			if(hero->canCastThisSpell(spell.toSpell()))
+				return true;
+	}
+	//heroes can learn spells in mage guild, which may be built up one more level today
+	for(auto & town : state->towns)
+	{
+		for(int level = 0; level <= town->mageGuildLevel() && level < (int)town->spells.size(); level++)
+			for(SpellID spell : crossingSpells)
+				if(vstd::contains(town->spells[level], spell))
+					return true;
+	}
+	return false;
+}
+
+bool CConcurrentTurns::canJoin(const std::vector<PlayerColor> & group, PlayerColor player) const
+{
+	auto isHuman = [this](PlayerColor color)
+	{
+		const PlayerState * state = getPlayer(color);
+		return state && state->human;
+	};
+
+	if(isHuman(player) || canLeaveRegions(player))
+		return false;
+
+	const auto regions = playerRegions(player);
+	for(PlayerColor member : group)
+	{
+		if(isHuman(member) || canLeaveRegions(member))
+			return false;
+
+		for(si32 region : playerRegions(member))
+			if(vstd::contains(regions, region))
+				return false;
+	}
+	return true;
+}
+
+void CConcurrentTurns::begin(const std::vector<PlayerColor> & players)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	group.clear();
+	group.insert(players.begin(), players.end());
+	finished.clear();
+	exclusive = PlayerColor::CANNOT_DETERMINE;
+}
+
+std::vector<CConcurrentTurns::Request> CConcurrentTurns::end()
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	group.clear();
+	finished.clear();
+	exclusive = PlayerColor::CANNOT_DETERMINE;
+	std::vector<Request> ret(requests.begin(), requests.end());
+	requests.clear();
+	return ret;
+}
+
+bool CConcurrentTurns::isTakingTurn(PlayerColor player) const
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	return vstd::contains(group, player);
+}
+
+bool CConcurrentTurns::defer(const Request & request)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(!vstd::contains(group, request.player))
+		return false;
+
+	requests.push_back(request);
+	cv.notify_one();
+	return true;
+}
+
+bool CConcurrentTurns::takeRequest(Request & out, boost::posix_time::time_duration timeout)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	auto findRequest = [this]()
+	{
+		if(exclusive == PlayerColor::CANNOT_DETERMINE)
+			return requests.begin();
+		return boost::find_if(requests, [this](const Request & request){ return request.player == exclusive; });
+	};
+
+	auto it = findRequest();
+	if(it == requests.end())
+	{
+		cv.timed_wait(lock, timeout);
+		it = findRequest();
+	}
+	if(it == requests.end())
+		return false;
+
+	out = *it;
+	requests.erase(it);
+	return true;
+}
+
+bool CConcurrentTurns::mustTakeTurnAlone(PlayerColor player) const
+{
+	if(canLeaveRegions(player))
+	{
+		logGlobal->debugStream() << "Player " << player.getNum() << " can leave its regions, other players wait till it ends turn";
+		return true;
+	}
+
+	const auto regions = playerRegions(player);
+	for(PlayerColor member : group)
+	{
+		if(member == player || vstd::contains(finished, member))
+			continue;
+
+		for(si32 region : playerRegions(member))
+		{
+			if(vstd::contains(regions, region))
+			{
+				logGlobal->debugStream() << "Players " << player.getNum() << " and " << member.getNum() << " can meet now, other players wait till "
+					<< player.getNum() << " ends turn";
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void CConcurrentTurns::requestApplied(PlayerColor player)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	if(exclusive == PlayerColor::CANNOT_DETERMINE && vstd::contains(group, player) && !vstd::contains(finished, player)
+		&& mustTakeTurnAlone(player))
+	{
+		exclusive = player;
+	}
+}
+
+void CConcurrentTurns::turnEnded(PlayerColor player)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	finished.insert(player);
+	if(exclusive != player)
+		return;
+
+	//other player may have got the ability meanwhile, in battle, or regions of others may have been joined
+	exclusive = PlayerColor::CANNOT_DETERMINE;
+	for(PlayerColor member : group)
+	{
+		if(!vstd::contains(finished, member) && mustTakeTurnAlone(member))
+		{
+			exclusive = member;
+			break;
+		}
+	}
+	cv.notify_one();
+}
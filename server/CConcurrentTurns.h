@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * CConcurrentTurns.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "../lib/GameConstants.h"
+#include "../lib/int3.h"
+#include "../lib/CNetworkStatistics.h"
+
+class CGameState;
+class CConnection;
+struct PlayerState;
+struct CPack;
+
+/// Opt-in mode ("server"/"concurrentAiTurns") in which AI players that can't meet each other take their turns at the same time.
+/// Map is split into regions of passable land and water tiles, joined by teleports. Players whose heroes and towns are
+/// in different regions and who can't fly or jump out of them can't interact during the day, so they get turns together.
+/// Their requests are still applied one by one by the thread running turns, and not while a battle is fought,
+/// since game state has room for a single battle; conflicting actions fall back to serialisation this way.
+/// Regions are computed again after packs that add, remove or move objects, since they change blocked tiles.
+/// Player whose heroes become able to leave their regions during the day (artifact or spell gained), or whose regions
+/// got joined with these of another member, stops the group: only its requests are taken until it ends its turn,
+/// then the others continue.
+/// YourTurn is applied for group members in reverse order, so gs->currentPlayer is the first of them during the turn.
+/// Order of requests of different players depends on timing, so shared random generator, tavern pool or object ids
+/// give different results each time: this mode is turned off when game is recorded and in benchmarks.
+class CConcurrentTurns : boost::noncopyable
+{
+public:
+	/// Request from client, applied later by thread running turns
+	struct Request
+	{
+		CPack * pack;
+		CConnection * c;
+		PlayerColor player;
+		si32 requestID;
+		CNetworkStatistics::TClock::time_point received;
+	};
+
+	boost::mutex applyMx; //held while request of player of the group is applied
+
+	/// Regions are computed from the map right away and again when it changes, gs has to be initialized
+	explicit CConcurrentTurns(const CGameState * gs);
+
+	void packApplied(ui16 packType); //type ID of netpack, as assigned by typeList; regions are outdated if it changes blocked tiles
+
+	/// Checks whether player can take turn together with the group
+	bool canJoin(const std::vector<PlayerColor> & group, PlayerColor player) const;
+	si32 getRegion(const int3 & pos) const; //-1 if no hero can stand there
+	bool canLeaveRegions(PlayerColor player) const; //heroes can fly or use dimension door or town portal, now or after visiting town
+
+	void begin(const std::vector<PlayerColor> & group);
+	std::vector<Request> end(); //returns requests that were not taken yet
+	bool isTakingTurn(PlayerColor player) const; //together with other players
+
+	/// Queues request of player taking turn; returns false if no group takes turns, then request has to be applied right away
+	bool defer(const Request & request);
+	/// Takes the oldest request (of the player that stopped the group, if any), waits for one at most given time
+	bool takeRequest(Request & out, boost::posix_time::time_duration timeout);
+	/// Called with applyMx held after request of player was applied, stops the group if the player can leave its regions
+	/// or if regions of members got joined
+	void requestApplied(PlayerColor player);
+	void turnEnded(PlayerColor player); //called with applyMx held, lets the group continue if player stopped it
+
+private:
+	const CGameState * gs;
+	mutable boost::mutex regionsMx; //held while regions are computed
+	mutable std::vector<si32> regions; //tile index -> region, -1 if no hero can stand there
+	mutable std::atomic<bool> regionsOutdated;
+
+	mutable boost::mutex mx;
+	boost::condition_variable cv;
+	std::set<PlayerColor> group, finished; //finished players ended their turns
+	PlayerColor exclusive; //player that stopped the group or CANNOT_DETERMINE
+	std::deque<Request> requests;
+
+	void computeRegions() const;
+	void updateRegions() const; //computes regions again if they are outdated
+	bool mustTakeTurnAlone(PlayerColor player) const; //called with mx held, for unfinished member of group
+	const PlayerState * getPlayer(PlayerColor player) const;
+	std::set<si32> playerRegions(PlayerColor player) const;
+};
@@ -25,6 +25,9 @@
 #include "../lib/CSoundBase.h"
 #include "CGameHandler.h"
 #include "CVCMIServer.h"
+#include "CGameRecorder.h"
+#include "CConcurrentTurns.h"
+#include "../lib/CConfigHandler.h"
 #include "../lib/CCreatureSet.h"
 #include "../lib/CThreadHelper.h"
 #include "../lib/GameConstants.h"
@@ -476,18 +479,7 @@ void CGameHandler::endBattle(int3 tile, const CGHeroInstance *hero1, const CGHer
 	const CArmedInstance *bEndArmy2 = gs->curB->sides.at(1).armyObject;
 	const BattleResult::EResult result = battleResult.get()->result;
 
-	auto findBattleQuery = [this]() -> std::shared_ptr<CBattleQuery>
-	{
-		for(auto &q : queries.allQueries())
-		{
-			if(auto bq = std::dynamic_pointer_cast<CBattleQuery>(q))
-				if(bq->bi == gs->curB)
-					return bq;
-		}
-		return std::shared_ptr<CBattleQuery>();
-	};
-
-	auto battleQuery = findBattleQuery();
+	auto battleQuery = queries.getBattleQuery(gs->curB);
 	if(!battleQuery)
 	{
 		logGlobal->errorStream() << "Cannot find battle query!";
@@ -502,7 +494,7 @@ void CGameHandler::endBattle(int3 tile, const CGHeroInstance *hero1, const CGHer
 	battleQuery->result = *battleResult.data;
 
 	//Check how many battle queries were created (number of players blocked by battle)
-	const int queriedPlayers = battleQuery ? boost::count(queries.allQueries(), battleQuery) : 0;
+	const int queriedPlayers = battleQuery ? queries.getStacksCount(battleQuery) : 0;
 	finishingBattle = make_unique<FinishingBattleHelper>(battleQuery, gs->initialOpts->mode == StartInfo::DUEL, queriedPlayers);
 
 
@@ -931,8 +923,7 @@ void CGameHandler::handleConnection(std::set<PlayerColor> players, CConnection &
 			int packType = 0;
 
 			{
-				boost::unique_lock<boost::mutex> lock(*c.rmx);
-				c >> player >> requestID >> pack; //get the package
+				pack = c.retreivePackFromClient(player, requestID); //get the package
 
 				if(!pack)
 				{
@@ -944,42 +935,26 @@ void CGameHandler::handleConnection(std::set<PlayerColor> players, CConnection &
 				logGlobal->traceStream() << boost::format("Received client message (request %d by player %d) of type with ID=%d (%s).\n")
 					% requestID % player.getNum() % packType % typeid(*pack).name();
 			}
-
-			//prepare struct informing that action was applied
-			auto sendPackageResponse = [&](bool succesfullyApplied)
+			if(concurrentTurns && concurrentTurns->isTakingTurn(player))
 			{
-				PackageApplied applied;
-				applied.player = player;
-				applied.result = succesfullyApplied;
-				applied.packType = packType;
-				applied.requestID = requestID;
-				boost::unique_lock<boost::mutex> lock(*c.wmx);
-				c << &applied;
-			};
-
-			CBaseForGHApply *apply = applier->apps[packType]; //and appropriate applier object
-			if(isBlockedByQueries(pack, player))
-			{
-				sendPackageResponse(false);
-			}
-			else if(apply)
-			{
-				const bool result = apply->applyOnGH(this,&c,pack, player);
-				if(!result)
+				//only here requests can wait before being applied, otherwise connection thread applies them right away
+				const auto received = CNetworkStatistics::TClock::now();
+				//battle of one player must not wait for requests of others, the rest is applied by thread running turns
+				boost::unique_lock<boost::mutex> lock(concurrentTurns->applyMx);
+				const bool immediate = dynamic_cast<MakeAction *>(pack) || dynamic_cast<MakeCustomAction *>(pack)
+					|| (gs->curB && (gs->curB->sides[0].color == player || gs->curB->sides[1].color == player));
+				if(immediate || !concurrentTurns->defer(CConcurrentTurns::Request{pack, &c, player, requestID, received}))
 				{
-					complain((boost::format("Got false in applying %s... that request must have been fishy!")
-						% typeid(*pack).name()).str());
+					CNetworkStatistics::get().recordTime(pack, CNetworkStatistics::QUEUE_WAIT, CNetworkStatistics::TClock::now() - received);
+					handlePack(pack, c, player, requestID);
+					concurrentTurns->requestApplied(player); //e.g. artifact won in battle
 				}
-				logGlobal->traceStream() << "Message successfully applied (result=" << result << ")!";
-				sendPackageResponse(true);
 			}
 			else
 			{
-				logGlobal->errorStream() << "Message cannot be applied, cannot find applier (unregistered type)!";
-				sendPackageResponse(false);
+				handlePack(pack, c, player, requestID);
 			}
-
-			vstd::clear_pointer(pack);
+			CNetworkStatistics::get().dumpIfDue();
 		}
 	}
 	catch(boost::system::system_error &e) //for boost errors just log, not crash - probably client shut down connection
@@ -996,6 +971,60 @@ void CGameHandler::handleConnection(std::set<PlayerColor> players, CConnection &
 	}
 
 	logGlobal->errorStream() << "Ended handling connection";
+	std::ostringstream netStats;
+	CNetworkStatistics::get().report(netStats);
+	logNetwork->debugStream() << netStats.str();
+}
+
+void CGameHandler::handlePack(CPack * pack, CConnection & c, PlayerColor player, si32 requestID)
+{
+	//prepare struct informing that action was applied
+	auto sendPackageResponse = [&](bool succesfullyApplied)
+	{
+		PackageApplied applied;
+		applied.player = player;
+		applied.result = succesfullyApplied;
+		applied.packType = typeList.getTypeID(pack);
+		applied.requestID = requestID;
+		c.sendPack(&applied);
+	};
+
+	if(isBlockedByQueries(pack, player))
+	{
+		sendPackageResponse(false);
+	}
+	else
+	{
+		sendPackageResponse(applyPackFromClient(pack, &c, player));
+	}
+
+	vstd::clear_pointer(pack);
+}
+
+bool CGameHandler::applyPackFromClient(CPack * pack, CConnection * c, PlayerColor player)
+{
+	CBaseForGHApply *apply = applier->apps[typeList.getTypeID(pack)]; //and appropriate applier object
+	if(!apply)
+	{
+		logGlobal->errorStream() << "Message cannot be applied, cannot find applier (unregistered type)!";
+		return false;
+	}
+
+	if(recorder)
+		recorder->recordPack(static_cast<CPackForServer *>(pack), player, appliedPacks);
+
+	bool result;
+	{
+		CNetworkStatistics::Timer timer(pack, CNetworkStatistics::APPLY_GH);
+		result = apply->applyOnGH(this, c, pack, player);
+	}
+	if(!result)
+	{
+		complain((boost::format("Got false in applying %s... that request must have been fishy!")
+			% typeid(*pack).name()).str());
+	}
+	logGlobal->traceStream() << "Message successfully applied (result=" << result << ")!";
+	return true;
 }
 
 int CGameHandler::moveStack(int stack, BattleHex dest)
@@ -1306,12 +1335,15 @@ int CGameHandler::moveStack(int stack, BattleHex dest)
 CGameHandler::CGameHandler(void)
 {
 	QID = 1;
+	appliedPacks = 0;
 	//gs = nullptr;
 	IObjectInterface::cb = this;
 	applier = new CApplier<CBaseForGHApply>;
 	registerTypesServerPacks(*applier);
 	visitObjectAfterVictory = false;
 	queries.gh = this;
+	//benchmarks have to be reproducible, see CConcurrentTurns
+	concurrentAiTurns = settings["server"]["concurrentAiTurns"].Bool() && !cmdLineOptions.count("sequentialTurns");
 
 	spellEnv = new ServerSpellCastEnvironment(this);
 }
@@ -1324,7 +1356,7 @@ CGameHandler::~CGameHandler(void)
 	delete gs;
 }
 
-void CGameHandler::init(StartInfo *si)
+void CGameHandler::init(StartInfo *si, int rngSeed)
 {
 	if(si->seedToBeUsed == 0)
 	{
@@ -1337,7 +1369,20 @@ void CGameHandler::init(StartInfo *si)
 	logGlobal->infoStream() << "Gamestate initialized!";
 
 	// reset seed, so that clients can't predict any following random values
-	gs->getRandomGenerator().resetSeed();
+	const bool replaying = rngSeed != 0;
+	if(!replaying)
+		rngSeed = CRandomGenerator::getDefault().nextInt(1, std::numeric_limits<int>::max());
+	gs->getRandomGenerator().setSeed(rngSeed);
+
+	if(!replaying)
+	{
+		recorder = CGameRecorder::createIfEnabled(gs, rngSeed);
+		if(recorder && concurrentAiTurns)
+		{
+			logGlobal->warnStream() << "Concurrent AI turns can't be replayed, players take turns one by one in recorded game";
+			concurrentAiTurns = false;
+		}
+	}
 
 	for(auto & elem : gs->players)
 	{
@@ -1345,6 +1390,8 @@ void CGameHandler::init(StartInfo *si)
 	}
 }
 
+static const int NEW_TURN_TASKS_PER_THREAD = 16; //heroes and towns handled by one thread in newTurn, smaller batches are not worth the threads
+
 static bool evntCmp(const CMapEvent &a, const CMapEvent &b)
 {
 	return a.earlierThan(b);
@@ -1407,12 +1454,10 @@ void CGameHandler::newTurn()
 
 	if (firstTurn)
 	{
-		for (auto obj : gs->map->objects)
+		for (auto obj : gs->map->getObjectLookup().getObjectsOfType(Obj::PRISON))
 		{
-			if (obj && obj->ID == Obj::PRISON) //give imprisoned hero 0 exp to level him up. easiest to do at this point
-			{
-				changePrimSkill (getHero(obj->id), PrimarySkill::EXPERIENCE, 0);
-			}
+			//give imprisoned hero 0 exp to level him up. easiest to do at this point
+			changePrimSkill (getHero(obj->id), PrimarySkill::EXPERIENCE, 0);
 		}
 	}
 
@@ -1495,6 +1540,7 @@ void CGameHandler::newTurn()
 		}
 	}
 
+	std::vector<CGHeroInstance *> playerHeroes;
 	for (auto & elem : gs->players)
 	{
 		if(elem.first == PlayerColor::NEUTRAL)
@@ -1537,112 +1583,180 @@ void CGameHandler::newTurn()
 			if(h->visitedTown)
 				giveSpells(h->visitedTown, h);
 
-			NewTurn::Hero hth;
-			hth.id = h->id;
-			auto ti = make_unique<TurnInfo>(h, 1);
-			// TODO: this code executed when bonuses of previous day not yet updated (this happen in NewTurn::applyGs). See issue 2356
-			hth.move = h->maxMovePoints(gs->map->getTile(h->getPosition(false)).terType != ETerrainType::WATER, ti.get());
-			hth.mana = h->getManaNewTurn();
-
-			n.heroes.insert(hth);
-
-			if(!firstTurn) //not first day
-			{
-				n.res[elem.first][Res::GOLD] += h->valOfBonuses(Selector::typeSubtype(Bonus::SECONDARY_SKILL_PREMY, SecondarySkill::ESTATES)); //estates
-
-				for (int k = 0; k < GameConstants::RESOURCE_QUANTITY; k++)
-				{
-					n.res[elem.first][k] += h->valOfBonuses(Bonus::GENERATE_RESOURCE, k);
-				}
-			}
+			playerHeroes.push_back(h);
 		}
 	}
+
+	//town events and portal of summoning change towns, so they have to be handled before growths are computed
 	for(CGTownInstance *t : gs->map->towns)
 	{
-		PlayerColor player = t->tempOwner;
 		handleTownEvents(t, n);
-		if(newWeek) //first day of week
+		if(newWeek)
 		{
 			if(t->hasBuilt(BuildingID::PORTAL_OF_SUMMON, ETownType::DUNGEON))
 				setPortalDwelling(t, true, (n.specialWeek == NewTurn::PLAGUE ? true : false)); //set creatures for Portal of Summoning
 
-			if(!firstTurn)
-				if (t->hasBuilt(BuildingID::TREASURY, ETownType::RAMPART) && player < PlayerColor::PLAYER_LIMIT)
-						n.res[player][Res::GOLD] += hadGold.at(player)/10; //give 10% of starting gold
-
 			if (!vstd::contains(n.cres, t->id))
 			{
 				n.cres[t->id].tid = t->id;
 				n.cres[t->id].creatures = t->creatures;
 			}
-			auto & sac = n.cres.at(t->id);
+		}
+	}
 
-			for (int k=0; k < GameConstants::CREATURES_PER_TOWN; k++) //creature growths
+	//movement, mana, creature growths and incomes depend only on their hero or town and are computed in parallel,
+	//every task writes only its own result; results are merged into NewTurn afterwards
+	struct HeroResult
+	{
+		NewTurn::Hero hth;
+		TResources income;
+	};
+	struct TownResult
+	{
+		TResources income;
+	};
+
+	std::vector<HeroResult> heroResults(playerHeroes.size());
+	std::vector<TownResult> townResults(gs->map->towns.size());
+	std::vector<Task> tasks;
+
+	for(size_t i = 0; i < playerHeroes.size(); i++)
+	{
+		tasks.push_back([&, i]()
+		{
+			const CGHeroInstance * h = playerHeroes[i];
+			HeroResult & result = heroResults[i];
+
+			result.hth.id = h->id;
+			TurnInfo ti(h, 1);
+			// TODO: this code executed when bonuses of previous day not yet updated (this happen in NewTurn::applyGs). See issue 2356
+			result.hth.move = h->maxMovePoints(gs->map->getTile(h->getPosition(false)).terType != ETerrainType::WATER, &ti);
+			result.hth.mana = h->getManaNewTurn();
+
+			if(!firstTurn) //not first day
 			{
-				if (!t->creatures.at(k).second.empty()) // there are creatures at this level
+				result.income[Res::GOLD] += h->valOfBonuses(Selector::typeSubtype(Bonus::SECONDARY_SKILL_PREMY, SecondarySkill::ESTATES)); //estates
+
+				for (int k = 0; k < GameConstants::RESOURCE_QUANTITY; k++)
 				{
-					ui32 &availableCount = sac.creatures.at(k).first;
-					const CCreature *cre = VLC->creh->creatures.at(t->creatures.at(k).second.back());
+					result.income[k] += h->valOfBonuses(Bonus::GENERATE_RESOURCE, k);
+				}
+			}
+		});
+	}
 
-					if (n.specialWeek == NewTurn::PLAGUE)
-						availableCount = t->creatures.at(k).first / 2; //halve their number, no growth
-					else
+	for(size_t i = 0; i < gs->map->towns.size(); i++)
+	{
+		tasks.push_back([&, i]()
+		{
+			const CGTownInstance * t = gs->map->towns[i];
+			TownResult & result = townResults[i];
+			const PlayerColor player = t->tempOwner;
+
+			if(newWeek) //first day of week
+			{
+				if(!firstTurn)
+					if (t->hasBuilt(BuildingID::TREASURY, ETownType::RAMPART) && player < PlayerColor::PLAYER_LIMIT)
+						result.income[Res::GOLD] += hadGold.at(player)/10; //give 10% of starting gold
+
+				auto & sac = n.cres.at(t->id); //entries were created before, so the map is not modified here
+
+				for (int k=0; k < GameConstants::CREATURES_PER_TOWN; k++) //creature growths
+				{
+					if (!t->creatures.at(k).second.empty()) // there are creatures at this level
 					{
-						if(firstTurn) //first day of game: use only basic growths
-							availableCount = cre->growth;
+						ui32 &availableCount = sac.creatures.at(k).first;
+						const CCreature *cre = VLC->creh->creatures.at(t->creatures.at(k).second.back());
+
+						if (n.specialWeek == NewTurn::PLAGUE)
+							availableCount = t->creatures.at(k).first / 2; //halve their number, no growth
 						else
-							availableCount += t->creatureGrowth(k);
+						{
+							if(firstTurn) //first day of game: use only basic growths
+								availableCount = cre->growth;
+							else
+								availableCount += t->creatureGrowth(k);
 
-						//Deity of fire week - upgrade both imps and upgrades
-						if (n.specialWeek == NewTurn::DEITYOFFIRE && vstd::contains(t->creatures.at(k).second, n.creatureid))
-							availableCount += 15;
+							//Deity of fire week - upgrade both imps and upgrades
+							if (n.specialWeek == NewTurn::DEITYOFFIRE && vstd::contains(t->creatures.at(k).second, n.creatureid))
+								availableCount += 15;
 
-						if( cre->idNumber == n.creatureid ) //bonus week, effect applies only to identical creatures
-						{
-							if(n.specialWeek == NewTurn::DOUBLE_GROWTH)
-								availableCount *= 2;
-							else if(n.specialWeek == NewTurn::BONUS_GROWTH)
-								availableCount += 5;
+							if( cre->idNumber == n.creatureid ) //bonus week, effect applies only to identical creatures
+							{
+								if(n.specialWeek == NewTurn::DOUBLE_GROWTH)
+									availableCount *= 2;
+								else if(n.specialWeek == NewTurn::BONUS_GROWTH)
+									availableCount += 5;
+							}
 						}
 					}
 				}
 			}
-		}
-		if(!firstTurn  &&  player < PlayerColor::PLAYER_LIMIT)//not the first day and town not neutral
-		{
-			n.res[player] = n.res[player] + t->dailyIncome();
-		}
-		if(t->hasBuilt(BuildingID::GRAIL, ETownType::TOWER))
-		{
-			// Skyship, probably easier to handle same as Veil of darkness
-			//do it every new day after veils apply
-			if (player != PlayerColor::NEUTRAL) //do not reveal fow for neutral player
+			if(!firstTurn  &&  player < PlayerColor::PLAYER_LIMIT)//not the first day and town not neutral
 			{
-				FoWChange fw;
-				fw.mode = 1;
-				fw.player = player;
-				// find all hidden tiles
-				const auto & fow = gs->getPlayerTeam(player)->fogOfWarMap;
-				for (size_t i=0; i<fow.size(); i++)
-					for (size_t j=0; j<fow.at(i).size(); j++)
-						for (size_t k=0; k<fow.at(i).at(j).size(); k++)
-							if (!fow.at(i).at(j).at(k))
-								fw.tiles.insert(int3(i,j,k));
-
-				sendAndApply (&fw);
+				result.income = result.income + t->dailyIncome();
 			}
+		});
+	}
+
+	CThreadHelper::runTasks(tasks, NEW_TURN_TASKS_PER_THREAD);
+
+	for(size_t i = 0; i < playerHeroes.size(); i++)
+	{
+		n.heroes.insert(heroResults[i].hth);
+		n.res[playerHeroes[i]->tempOwner] += heroResults[i].income;
+	}
+
+	//Cover of Darkness tiles are gathered to hide them with one FoWChange per player. Hiding commutes with hiding,
+	//but not with Skyship reveal, so gathered tiles are hidden before each reveal to keep results of per town order.
+	std::map<PlayerColor, std::vector<TileSpan>> darkenedTiles;
+	auto hideDarkenedTiles = [&]()
+	{
+		for(auto & elem : darkenedTiles)
+			hideTilesNotObserved(elem.second, elem.first);
+		darkenedTiles.clear();
+	};
+
+	for(size_t i = 0; i < gs->map->towns.size(); i++)
+	{
+		const CGTownInstance * t = gs->map->towns[i];
+		PlayerColor player = t->tempOwner;
+		if(player < PlayerColor::PLAYER_LIMIT)
+			n.res[player] += townResults[i].income;
+
+		// Skyship, probably easier to handle same as Veil of darkness
+		//do it every new day after veils apply
+		if(t->hasBuilt(BuildingID::GRAIL, ETownType::TOWER) && player != PlayerColor::NEUTRAL) //do not reveal fow for neutral player
+		{
+			hideDarkenedTiles();
+
+			FoWChange fw;
+			fw.mode = 1;
+			fw.player = player;
+			// find all hidden tiles
+			const auto & fow = gs->getPlayerTeam(player)->fogOfWarMap;
+			CFogOfWarMap hidden(fow.getSizes());
+			hidden.setAll(true);
+			hidden.subtract(fow);
+			fw.spans = hidden.toSpans();
+
+			if(!fw.spans.empty()) //another Skyship of the team may have already revealed everything
+				sendAndApply(&fw);
 		}
+
 		if (t->hasBonusOfType (Bonus::DARKNESS))
 		{
 			for (auto & player : gameState()->players)
 			{
 				if (getPlayerStatus(player.first) == EPlayerStatus::INGAME &&
 					getPlayerRelations(player.first, t->tempOwner) == PlayerRelations::ENEMIES)
-					changeFogOfWar(t->visitablePos(), t->getBonusLocalFirst(Selector::type(Bonus::DARKNESS))->val, player.first, true);
+					getTileSpansInRange(darkenedTiles[player.first], t->visitablePos(), t->getBonusLocalFirst(Selector::type(Bonus::DARKNESS))->val, player.first, -1);
 			}
 		}
 	}
 
+	hideDarkenedTiles();
+
 	if(newMonth)
 	{
 		SetAvailableArtifacts saa;
@@ -1750,6 +1864,9 @@ void CGameHandler::run(bool resume)
 		cc->disableSmartPointerSerialization();
 	}
 
+	if(concurrentAiTurns && gs->scenarioOps->mode != StartInfo::DUEL)
+		concurrentTurns = make_unique<CConcurrentTurns>(gs);
+
 	for(auto & elem : conns)
 	{
 		std::set<PlayerColor> pom;
@@ -1789,39 +1906,50 @@ void CGameHandler::run(bool resume)
 		}
 
 		resume = false;
-		for (; it != playerTurnOrder.end(); it++)
+		while(it != playerTurnOrder.end())
 		{
-			auto playerColor = *it;
+			//following players that can't meet this one take turns together with him
+			std::vector<PlayerColor> group(1, *it++);
+			while(concurrentTurns && it != playerTurnOrder.end() && concurrentTurns->canJoin(group, *it))
+				group.push_back(*it++);
 
-			PlayerState * playerState = &gs->players[playerColor]; //can't copy CBonusSystemNode by value
-			if (playerState->status == EPlayerStatus::INGAME)
-			{
-				//if player runs out of time, he shouldn't get the turn (especially AI)
-				checkVictoryLossConditionsForAll();
+			if(!vstd::contains_if(group, [this](PlayerColor playerColor){ return gs->players[playerColor].status == EPlayerStatus::INGAME; }))
+				continue;
 
-				if (gs->players[playerColor].status != EPlayerStatus::INGAME)
-				{ //player lost at the beginning of his turn
-					continue;
-				}
-				else //give normal turn
-				{
-					states.setFlag(playerColor, &PlayerStatus::makingTurn, true);
+			//if player runs out of time, he shouldn't get the turn (especially AI)
+			checkVictoryLossConditionsForAll();
 
-					YourTurn yt;
-					yt.player = playerColor;
-					//Change local daysWithoutCastle counter for local interface message //TODO: needed?
-					yt.daysWithoutCastle = playerState->daysWithoutCastle;
-					applyAndSend(&yt);
+			std::vector<PlayerColor> playing;
+			for(auto playerColor : group)
+			{
+				if(gs->players[playerColor].status == EPlayerStatus::INGAME) //player may lose at the beginning of his turn
+					playing.push_back(playerColor);
+			}
 
-					//wait till turn is done
-					boost::unique_lock<boost::mutex> lock(states.mx);
-					while (states.players.at(playerColor).makingTurn && !end2)
-					{
-						static time_duration p = milliseconds(100);
-						states.cv.timed_wait(lock, p);
-					}
+			if(playing.size() == 1) //give normal turn
+			{
+				auto playerColor = playing.front();
+				PlayerState * playerState = &gs->players[playerColor]; //can't copy CBonusSystemNode by value
+				states.setFlag(playerColor, &PlayerStatus::makingTurn, true);
+
+				YourTurn yt;
+				yt.player = playerColor;
+				//Change local daysWithoutCastle counter for local interface message //TODO: needed?
+				yt.daysWithoutCastle = playerState->daysWithoutCastle;
+				applyAndSend(&yt);
+
+				//wait till turn is done
+				boost::unique_lock<boost::mutex> lock(states.mx);
+				while (states.players.at(playerColor).makingTurn && !end2)
+				{
+					static time_duration p = milliseconds(100);
+					states.cv.timed_wait(lock, p);
 				}
 			}
+			else if(playing.size() > 1)
+			{
+				runConcurrentTurns(playing);
+			}
 		}
 		//additional check that game is not finished
 		bool activePlayer = false;
@@ -1837,6 +1965,83 @@ void CGameHandler::run(bool resume)
 		boost::this_thread::sleep(boost::posix_time::milliseconds(5)); //give time client to close socket
 }
 
+void CGameHandler::runConcurrentTurns(const std::vector<PlayerColor> & players)
+{
+	using namespace boost::posix_time;
+	logGlobal->debugStream() << "Players taking turns concurrently: " << players.size();
+
+	auto applyRequest = [this](CConcurrentTurns::Request & request)
+	{
+		boost::unique_lock<boost::mutex> lock(concurrentTurns->applyMx);
+		try
+		{
+			CNetworkStatistics::get().recordTime(request.pack, CNetworkStatistics::QUEUE_WAIT, CNetworkStatistics::TClock::now() - request.received);
+			handlePack(request.pack, *request.c, request.player, request.requestID);
+			concurrentTurns->requestApplied(request.player);
+		}
+		catch(boost::system::system_error & e) //connection was closed, its thread ends the game
+		{
+			logGlobal->errorStream() << e.what();
+		}
+	};
+
+	{
+		boost::unique_lock<boost::mutex> lock(concurrentTurns->applyMx);
+		concurrentTurns->begin(players);
+		//last applied YourTurn sets gs->currentPlayer, the first player of the group is current one as its turn was given first
+		for(auto playerColor : boost::adaptors::reverse(players))
+		{
+			states.setFlag(playerColor, &PlayerStatus::makingTurn, true);
+
+			YourTurn yt;
+			yt.player = playerColor;
+			yt.daysWithoutCastle = gs->players[playerColor].daysWithoutCastle;
+			applyAndSend(&yt);
+		}
+	}
+
+	auto isAnyMakingTurn = [&]() -> bool
+	{
+		for(auto playerColor : players)
+			if(states.checkFlag(playerColor, &PlayerStatus::makingTurn))
+				return true;
+		return false;
+	};
+
+	std::set<PlayerColor> ended;
+	auto updateEndedTurns = [&]()
+	{
+		for(auto playerColor : players)
+		{
+			if(!vstd::contains(ended, playerColor) && !states.checkFlag(playerColor, &PlayerStatus::makingTurn))
+			{
+				boost::unique_lock<boost::mutex> lock(concurrentTurns->applyMx);
+				concurrentTurns->turnEnded(playerColor);
+				ended.insert(playerColor);
+			}
+		}
+	};
+
+	//requests are applied one by one; battle has thread of its own and other players wait till it ends
+	while(isAnyMakingTurn() && !end2)
+	{
+		updateEndedTurns();
+		CConcurrentTurns::Request request;
+		if(gs->curB)
+			boost::this_thread::sleep(milliseconds(10));
+		else if(concurrentTurns->takeRequest(request, milliseconds(100)))
+			applyRequest(request);
+	}
+
+	for(auto & request : concurrentTurns->end())
+	{
+		if(end2)
+			delete request.pack;
+		else
+			applyRequest(request);
+	}
+}
+
 std::list<PlayerColor> CGameHandler::generatePlayerTurnOrder() const
 {
 	// Generate player turn order
@@ -1943,7 +2148,7 @@ bool CGameHandler::moveHero( ObjectInstanceID hid, int3 dst, ui8 teleporting, bo
 {
 	const CGHeroInstance *h = getHero(hid);
 
-	if(!h  || (asker != PlayerColor::NEUTRAL && (teleporting  ||   h->getOwner() != gs->currentPlayer)) //not turn of that hero or player can't simply teleport hero (at least not with this function)
+	if(!h  || (asker != PlayerColor::NEUTRAL && (teleporting  ||   !isTakingTurn(h->getOwner()))) //not turn of that hero or player can't simply teleport hero (at least not with this function)
 	  )
 	{
 		logGlobal->errorStream() << "Illegal call to move hero!";
@@ -2012,7 +2217,7 @@ bool CGameHandler::moveHero( ObjectInstanceID hid, int3 dst, ui8 teleporting, bo
 		{
 			obj->onHeroLeave(h);
 		}
-		this->getTilesInRange(tmh.fowRevealed, h->getSightCenter()+(tmh.end-tmh.start), h->getSightRadius(), h->tempOwner, 1);
+		this->getTileSpansInRange(tmh.fowRevealed, h->getSightCenter()+(tmh.end-tmh.start), h->getSightRadius(), h->tempOwner, 1);
 	};
 
 	auto doMove = [&](TryMoveHero::EResult result, EGuardLook lookForGuards,
@@ -2131,7 +2336,7 @@ bool CGameHandler::teleportHero(ObjectInstanceID hid, ObjectInstanceID dstid, ui
 	const CGHeroInstance *h = getHero(hid);
 	const CGTownInstance *t = getTown(dstid);
 
-	if ( !h || !t || h->getOwner() != gs->currentPlayer )
+	if ( !h || !t || !isTakingTurn(h->getOwner()) )
 		logGlobal->errorStream() << "Invalid call to teleportHero!";
 
 	const CGTownInstance *from = h->visitedTown;
@@ -2509,24 +2714,34 @@ void CGameHandler::sendToAllClients( CPackForClient * info )
 {
 	logGlobal->traceStream() << "Sending to all clients a package of type " << typeid(*info).name();
 	for(auto & elem : conns)
-	{
-		boost::unique_lock<boost::mutex> lock(*(elem)->wmx);
-		*elem << info;
-	}
+		elem->sendPack(info);
 }
 
 void CGameHandler::sendAndApply(CPackForClient * info)
 {
 	sendToAllClients(info);
 	gs->apply(info);
+	packApplied(info);
 }
 
 void CGameHandler::applyAndSend(CPackForClient * info)
 {
 	gs->apply(info);
+	packApplied(info);
 	sendToAllClients(info);
 }
 
+void CGameHandler::packApplied(CPackForClient * info)
+{
+	{
+		boost::unique_lock<boost::mutex> lock(appliedPacksMx);
+		appliedPacks++;
+	}
+	appliedPacksCv.notify_all();
+	if(concurrentTurns)
+		concurrentTurns->packApplied(typeList.getTypeID(info));
+}
+
 void CGameHandler::sendAndApply(CGarrisonOperationPack * info)
 {
 	sendAndApply(static_cast<CPackForClient*>(info));
@@ -2720,6 +2935,20 @@ PlayerColor CGameHandler::getPlayerAt( CConnection *c ) const
 	}
 }
 
+PlayerColor CGameHandler::getPlayerAt(CConnection *c, PlayerColor claimed) const
+{
+	//players taking turns together may share connection, then the one sending request is active
+	auto it = connections.find(claimed);
+	if(concurrentTurns && concurrentTurns->isTakingTurn(claimed) && it != connections.end() && it->second == c)
+		return claimed;
+	return getPlayerAt(c);
+}
+
+bool CGameHandler::isTakingTurn(PlayerColor player) const
+{
+	return player == gs->currentPlayer || (concurrentTurns && concurrentTurns->isTakingTurn(player));
+}
+
 bool CGameHandler::disbandCreature( ObjectInstanceID id, SlotID pos )
 {
 	CArmedInstance *s1 = static_cast<CArmedInstance*>(gs->getObjInstance(id));
@@ -2887,7 +3116,7 @@ bool CGameHandler::buildStructure( ObjectInstanceID tid, BuildingID requestedID,
 	FoWChange fw;
 	fw.player = t->tempOwner;
 	fw.mode = 1;
-	getTilesInRange(fw.tiles, t->getSightCenter(), t->getSightRadius(), t->tempOwner, 1);
+	getTileSpansInRange(fw.spans, t->getSightCenter(), t->getSightRadius(), t->tempOwner, 1);
 	sendAndApply(&fw);
 
 	if(t->visitingHero)
@@ -4330,24 +4559,22 @@ void CGameHandler::playerMessage( PlayerColor player, const std::string &message
 		FoWChange fc;
 		fc.mode = 1;
 		fc.player = player;
-		auto  hlp_tab = new int3[gs->map->width * gs->map->height * (gs->map->twoLevel ? 2 : 1)];
-		int lastUnc = 0;
-		for(int i=0;i<gs->map->width;i++)
-			for(int j=0;j<gs->map->height;j++)
-				for(int k = 0; k < (gs->map->twoLevel ? 2 : 1); k++)
-					if(!gs->getPlayerTeam(fc.player)->fogOfWarMap.at(i).at(j).at(k))
-						hlp_tab[lastUnc++] = int3(i,j,k);
-		fc.tiles.insert(hlp_tab, hlp_tab + lastUnc);
-		delete [] hlp_tab;
+		const auto & fow = gs->getPlayerTeam(fc.player)->fogOfWarMap;
+		CFogOfWarMap hidden(fow.getSizes());
+		hidden.setAll(true);
+		hidden.subtract(fow);
+		fc.spans = hidden.toSpans();
 		sendAndApply(&fc);
 	}
 	else if(message == "vcmisilmaril") //player wins
 	{
 		gs->getPlayer(player)->enteredWinningCheatCode = 1;
+		gs->victoryLossStateChanged();
 	}
 	else if(message == "vcmimelkor") //player looses
 	{
 		gs->getPlayer(player)->enteredLosingCheatCode = 1;
+		gs->victoryLossStateChanged();
 	}
 	else
 		cheated = false;
@@ -5093,11 +5320,10 @@ void CGameHandler::checkVictoryLossConditionsForPlayer(PlayerColor player)
 			}
 
 			//player lost -> all his objects become unflagged (neutral)
-			for (auto obj : gs->map->objects) //unflag objs
-			{
-				if(obj.get() && obj->tempOwner == player)
-					setOwner(obj, PlayerColor::NEUTRAL);
-			}
+			//copy, unflagging changes the index
+			auto playerObjects = gs->map->getObjectLookup().getObjectsOwnedBy(player);
+			for (auto obj : playerObjects) //unflag objs
+				setOwner(obj, PlayerColor::NEUTRAL);
 
 			//eliminating one player may cause victory of another:
 			std::set<PlayerColor> playerColors;
@@ -5123,12 +5349,11 @@ void CGameHandler::checkVictoryLossConditionsForPlayer(PlayerColor player)
 			checkVictoryLossConditions(playerColors);
 		}
 
-		auto playerInfo = gs->getPlayer(gs->currentPlayer, false);
-		// If we are called before the actual game start, there might be no current player
-		if (playerInfo && playerInfo->status != EPlayerStatus::INGAME)
+		// If player making turn has lost his turn must be over as well, there may be more of them taking turns concurrently
+		for(auto & elem : gs->players)
 		{
-			// If player making turn has lost his turn must be over as well
-			states.setFlag(gs->currentPlayer, &PlayerStatus::makingTurn, false);
+			if(elem.second.status != EPlayerStatus::INGAME && states.checkFlag(elem.first, &PlayerStatus::makingTurn))
+				states.setFlag(elem.first, &PlayerStatus::makingTurn, false);
 		}
 	}
 }
@@ -5147,9 +5372,9 @@ void CGameHandler::getVictoryLossMessage(PlayerColor player, const EVictoryLossC
 
 bool CGameHandler::dig( const CGHeroInstance *h )
 {
-	for (auto i = gs->map->objects.cbegin(); i != gs->map->objects.cend(); i++) //unflag objs
+	for (auto hole : gs->map->getObjectLookup().getObjectsOfType(Obj::HOLE))
 	{
-		if(*i && (*i)->ID == Obj::HOLE  &&  (*i)->pos == h->getPosition())
+		if(hole->pos == h->getPosition())
 		{
 			complain("Cannot dig - there is already a hole under the hero!");
 			return false;
@@ -5732,7 +5957,7 @@ void CGameHandler::runBattle()
 
 				if(!curOwner || curOwner->getSecSkillLevel(SecondarySkill::FIRST_AID) == 0) //no hero or hero has no first aid
 				{
-					range::random_shuffle(possibleStacks);
+					std::shuffle(possibleStacks.begin(), possibleStacks.end(), gs->getRandomGenerator().getStdGenerator());
 					const CStack * toBeHealed = possibleStacks.front();
 
 					BattleAction heal;
@@ -5935,14 +6160,14 @@ void CGameHandler::spawnWanderingMonsters(CreatureID creatureID)
 	std::vector<int3> tiles;
 	getFreeTiles(tiles);
 	ui32 amount = tiles.size() / 200; //Chance is 0.5% for each tile
-	std::random_shuffle(tiles.begin(), tiles.end());
+	std::shuffle(tiles.begin(), tiles.end(), gs->getRandomGenerator().getStdGenerator());
 	logGlobal->traceStream() << "Spawning wandering monsters. Found " << tiles.size() << " free tiles. Creature type: " << creatureID;
 	const CCreature *cre = VLC->creh->creatures.at(creatureID);
 	for (int i = 0; i < amount; ++i)
 	{
 		tile = tiles.begin();
 		logGlobal->traceStream() << "\tSpawning monster at " << *tile;
-		putNewMonster(creatureID, cre->getRandomAmount(std::rand), *tile);
+		putNewMonster(creatureID, cre->getRandomAmount(std::ref(gs->getRandomGenerator().getStdGenerator())), *tile);
 		tiles.erase(tile); //not use it again
 	}
 }
@@ -5987,17 +6212,11 @@ bool CGameHandler::isBlockedByQueries(const CPack *pack, PlayerColor player)
 void CGameHandler::removeAfterVisit(const CGObjectInstance *object)
 {
 	//If the object is being visited, there must be a matching query
-	for(const auto &query : queries.allQueries())
+	if(auto someVistQuery = queries.getVisitQuery(object))
 	{
-		if(auto someVistQuery = std::dynamic_pointer_cast<CObjectVisitQuery>(query))
-		{
-			if(someVistQuery->visitedObject == object)
-			{
-				someVistQuery->removeObjectAfterVisit = true;
-				return;
-			}
-		}
-	};
+		someVistQuery->removeObjectAfterVisit = true;
+		return;
+	}
 
 	//If we haven't returned so far, there is no query and no visit, call was wrong
 	assert("This function needs to be called during the object visit!");
@@ -6005,30 +6224,43 @@ void CGameHandler::removeAfterVisit(const CGObjectInstance *object)
 
 void CGameHandler::changeFogOfWar(int3 center, ui32 radius, PlayerColor player, bool hide)
 {
-	std::unordered_set<int3, ShashInt3> tiles;
-	getTilesInRange(tiles, center, radius, player, hide? -1 : 1);
+	std::vector<TileSpan> spans;
+	getTileSpansInRange(spans, center, radius, player, hide? -1 : 1);
 	if (hide)
+		hideTilesNotObserved(spans, player);
+	else
 	{
-		std::unordered_set<int3, ShashInt3> observedTiles; //do not hide tiles observed by heroes. May lead to disastrous AI problems
-		auto p = gs->getPlayer(player);
-		for (auto h : p->heroes)
-		{
-			getTilesInRange(observedTiles, h->getSightCenter(), h->getSightRadius(), h->tempOwner, -1);
-		}
-		for (auto t : p->towns)
-		{
-			getTilesInRange(observedTiles, t->getSightCenter(), t->getSightRadius(), t->tempOwner, -1);
-		}
-		for (auto tile : observedTiles)
-			vstd::erase_if_present (tiles, tile);
+		FoWChange fow;
+		fow.spans = std::move(spans);
+		fow.player = player;
+		fow.mode = 1;
+		sendAndApply(&fow);
 	}
-	changeFogOfWar(tiles, player, hide);
+}
+
+void CGameHandler::hideTilesNotObserved(const std::vector<TileSpan> &spans, PlayerColor player)
+{
+	CFogOfWarMap tiles(gs->getPlayerTeam(player)->fogOfWarMap.getSizes());
+	tiles.setSpans(spans, true);
+
+	//do not hide tiles observed by heroes. May lead to disastrous AI problems
+	auto p = gs->getPlayer(player);
+	for (auto h : p->heroes)
+		tiles.setCircle(h->getSightCenter(), h->getSightRadius(), false);
+	for (auto t : p->towns)
+		tiles.setCircle(t->getSightCenter(), t->getSightRadius(), false);
+
+	FoWChange fow;
+	fow.spans = tiles.toSpans();
+	fow.player = player;
+	fow.mode = 0;
+	sendAndApply(&fow);
 }
 
 void CGameHandler::changeFogOfWar(std::unordered_set<int3, ShashInt3> &tiles, PlayerColor player, bool hide)
 {
 	FoWChange fow;
-	fow.tiles = tiles;
+	fow.spans = CFogOfWarMap::toSpans(tiles);
 	fow.player = player;
 	fow.mode = hide? 0 : 1;
 	sendAndApply(&fow);
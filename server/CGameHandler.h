@@ -7,6 +7,8 @@
 #include "../lib/BattleAction.h"
 #include "CQuery.h"
 
+#include <atomic>
+
 
 /*
  * CGameHandler.h, part of VCMI engine
@@ -35,6 +37,8 @@ class CGHeroInstance;
 class IMarket;
 
 class ServerSpellCastEnvironment;
+class CGameRecorder;
+class CConcurrentTurns;
 
 extern std::map<ui32, CFunctionList<void(ui32)> > callbacks; //question id => callback functions - for selection dialogs
 extern boost::mutex gsm;
@@ -102,6 +106,13 @@ public:
 	//TODO get rid of cfunctionlist (or similar) and use serialziable callback structure
 	std::map<ui32, CFunctionList<void(ui32)> > callbacks; //query id => callback function - for selection and yes/no dialogs
 
+	std::atomic<ui64> appliedPacks; //number of packs applied to gamestate, used to synchronize replays
+	boost::mutex appliedPacksMx; //held while appliedPacks grows, so that waiting replayer can't miss it
+	boost::condition_variable appliedPacksCv; //notifies when appliedPacks grows
+	std::unique_ptr<CGameRecorder> recorder; //nullptr if game is not recorded
+	bool concurrentAiTurns; //AI players that can't meet may take turns together, see CConcurrentTurns
+	std::unique_ptr<CConcurrentTurns> concurrentTurns; //nullptr unless concurrentAiTurns and game has started
+
 	bool isValidObject(const CGObjectInstance *obj) const;
 	bool isBlockedByQueries(const CPack *pack, PlayerColor player); 
 	bool isAllowedExchange(ObjectInstanceID id1, ObjectInstanceID id2);
@@ -179,6 +190,7 @@ public:
 
 	void changeFogOfWar(int3 center, ui32 radius, PlayerColor player, bool hide) override;
 	void changeFogOfWar(std::unordered_set<int3, ShashInt3> &tiles, PlayerColor player, bool hide) override;
+	void hideTilesNotObserved(const std::vector<TileSpan> &spans, PlayerColor player); //hides given tiles except ones seen by heroes and towns of player
 
 	bool isVisitCoveredByAnotherQuery(const CGObjectInstance *obj, const CGHeroInstance *hero) override;
 
@@ -198,9 +210,13 @@ public:
 
 	void commitPackage(CPackForClient *pack) override;
 
-	void init(StartInfo *si);
+	void init(StartInfo *si, int rngSeed = 0); //rngSeed - seed of RNG used after initialization, 0 - random seed (and game is recorded if enabled in settings)
 	void handleConnection(std::set<PlayerColor> players, CConnection &c);
+	void handlePack(CPack * pack, CConnection & c, PlayerColor player, si32 requestID); //applies pack, responds and deletes it
+	bool applyPackFromClient(CPack * pack, CConnection * c, PlayerColor player); //c is nullptr when replaying; returns false if pack cannot be applied
 	PlayerColor getPlayerAt(CConnection *c) const;
+	PlayerColor getPlayerAt(CConnection *c, PlayerColor claimed) const; //claimed player if he takes turn concurrently with other players at that connection
+	bool isTakingTurn(PlayerColor player) const; //current player or member of group taking turns concurrently
 
 	void playerMessage( PlayerColor player, const std::string &message, ObjectInstanceID currObj);
 	void updateGateState();
@@ -254,6 +270,7 @@ public:
 	void sendToAllClients(CPackForClient * info);
 	void sendAndApply(CPackForClient * info) override;
 	void applyAndSend(CPackForClient * info);
+	void packApplied(CPackForClient * info); //counts applied packs, tells concurrent turns about changes of map
 	void sendAndApply(CGarrisonOperationPack * info);
 	void sendAndApply(SetResource * info);
 	void sendAndApply(SetResources * info);
@@ -282,6 +299,7 @@ public:
 	void battleAfterLevelUp(const BattleResult &result);
 
 	void run(bool resume);
+	void runConcurrentTurns(const std::vector<PlayerColor> & players); //gives turn to all players and applies their requests till they end it
 	void newTurn();
 	void handleAttackBeforeCasting (const BattleAttack & bat);
 	void handleAfterAttackCasting (const BattleAttack & bat);
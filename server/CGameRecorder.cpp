@@ -0,0 +1,183 @@
+/*
+ * CGameRecorder.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "CGameRecorder.h"
+
+#include "CGameHandler.h"
+#include "../lib/CArtHandler.h"
+#include "../lib/CConfigHandler.h"
+#include "../lib/CCreatureHandler.h"
+#include "../lib/CGameState.h"
+#include "../lib/CHeroHandler.h"
+#include "../lib/CNetworkStatistics.h"
+#include "../lib/NetPacks.h"
+#include "../lib/StartInfo.h"
+#include "../lib/CTownHandler.h"
+#include "../lib/VCMIDirs.h"
+#include "../lib/mapping/CMap.h"
+
+extern bool end2;
+
+const std::string CGameRecorder::MAGIC = "VCMIReplay";
+
+std::unique_ptr<CGameRecorder> CGameRecorder::createIfEnabled(CGameState * gs, int rngSeed)
+{
+	if(!settings["server"]["recordReplay"].Bool())
+		return nullptr;
+
+	const auto dir = VCMIDirs::get().userCachePath() / "Replays";
+	const auto fname = dir / boost::str(boost::format("Replay_%d_%d.vrpl") % gs->initialOpts->seedToBeUsed % std::time(nullptr));
+	try
+	{
+		boost::filesystem::create_directories(dir);
+		auto ret = make_unique<CGameRecorder>(fname, gs, rngSeed);
+		logGlobal->infoStream() << "Recording game to " << fname;
+		return ret;
+	}
+	catch(std::exception & e)
+	{
+		logGlobal->errorStream() << "Cannot record game to " << fname << ": " << e.what();
+		return nullptr;
+	}
+}
+
+CGameRecorder::CGameRecorder(const boost::filesystem::path & fname, CGameState * gs, int rngSeed):
+	file(make_unique<CSaveFile>(fname))
+{
+	file->putMagicBytes(MAGIC);
+	*file << *gs->initialOpts << rngSeed;
+	file->addStdVecItems(gs);
+	file->sfile->flush();
+}
+
+CGameRecorder::~CGameRecorder()
+{
+}
+
+void CGameRecorder::recordPack(const CPackForServer * pack, PlayerColor player, ui64 appliedPacks)
+{
+	boost::unique_lock<boost::mutex> lock(mx);
+	try
+	{
+		const CPack * polymorphicPack = pack; //packs has to be saved as polymorphic pointers!
+		*file << appliedPacks << player << polymorphicPack;
+		file->sfile->flush(); //keep recording usable even if server crashes
+	}
+	catch(std::exception & e)
+	{
+		logGlobal->errorStream() << "Failed to record pack: " << e.what();
+	}
+}
+
+CGameReplayer::CGameReplayer(const boost::filesystem::path & fname):
+	file(make_unique<CLoadFile>(fname))
+{
+	file->checkMagicBytes(CGameRecorder::MAGIC);
+}
+
+CGameReplayer::~CGameReplayer()
+{
+	//battle thread may still wait for actions that were never recorded, it has to keep its game handler
+	if(gh && gh->gameState() && gh->gameState()->curB)
+		gh.release();
+}
+
+bool CGameReplayer::waitForServer(ui64 appliedPacks) const
+{
+	typedef CNetworkStatistics::TClock TClock;
+
+	boost::unique_lock<boost::mutex> lock(gh->appliedPacksMx);
+	ui64 lastApplied = gh->appliedPacks;
+	auto lastProgress = TClock::now();
+	while(lastApplied < appliedPacks)
+	{
+		if(end2)
+			return false;
+
+		//woken up by every applied pack, timeout only lets us notice end of game
+		gh->appliedPacksCv.timed_wait(lock, boost::posix_time::milliseconds(100));
+		const ui64 applied = gh->appliedPacks;
+		const auto now = TClock::now();
+		if(applied != lastApplied)
+		{
+			lastApplied = applied;
+			lastProgress = now;
+		}
+		else if(now - lastProgress > std::chrono::seconds(DESYNC_TIMEOUT))
+			return false;
+	}
+	return true;
+}
+
+bool CGameReplayer::run()
+{
+	StartInfo si;
+	int rngSeed;
+	*file >> si >> rngSeed;
+
+	CNetworkStatistics::get().reset();
+	const auto startTime = CNetworkStatistics::TClock::now();
+
+	gh = make_unique<CGameHandler>();
+	gh->concurrentAiTurns = false; //games are recorded with turns taken one by one
+	gh->init(&si, rngSeed);
+	file->addStdVecItems(gh->gameState());
+
+	//all players are handled by one "connection", as if they were played by AIs of a single client
+	for(auto & elem : gh->states.players)
+		gh->connections[elem.first] = nullptr;
+
+	const auto initTime = CNetworkStatistics::TClock::now();
+	boost::thread runThread([this]{ gh->run(false); });
+
+	ui64 packsCount = 0;
+	bool synchronized = true;
+	while(file->sfile->peek() != EOF)
+	{
+		ui64 appliedPacks;
+		PlayerColor player;
+		CPack * pack = nullptr;
+		*file >> appliedPacks >> player >> pack;
+
+		if(!waitForServer(appliedPacks))
+		{
+			logGlobal->errorStream() << boost::format("Replay desynchronized at pack %d (%s): server applied %d packs, %d expected")
+				% packsCount % typeid(*pack).name() % gh->appliedPacks % appliedPacks;
+			synchronized = false;
+			vstd::clear_pointer(pack);
+			break;
+		}
+		if(gh->appliedPacks != appliedPacks)
+			logGlobal->warnStream() << boost::format("Pack %d (%s) is replayed after %d server packs, %d expected")
+				% packsCount % typeid(*pack).name() % gh->appliedPacks % appliedPacks;
+
+		gh->applyPackFromClient(pack, nullptr, player);
+		vstd::clear_pointer(pack);
+		packsCount++;
+	}
+
+	const auto endTime = CNetworkStatistics::TClock::now();
+	auto seconds = [](CNetworkStatistics::TClock::duration duration)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() / 1000.0;
+	};
+
+	std::ostringstream report;
+	report << boost::format("Replay finished after %d packs from clients and %d server packs, day %d\n")
+		% packsCount % gh->appliedPacks % gh->gameState()->day;
+	report << boost::format("Initialization: %.3f s, game: %.3f s\n") % seconds(initTime - startTime) % seconds(endTime - initTime);
+	CNetworkStatistics::get().report(report);
+	logGlobal->infoStream() << report.str();
+
+	end2 = true;
+	runThread.join();
+	return synchronized;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * CGameRecorder.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "../lib/GameConstants.h"
+
+class CGameHandler;
+class CGameState;
+class CSaveFile;
+class CLoadFile;
+struct CPackForServer;
+
+/// Records everything needed to reproduce a game: start options, seed of server RNG and every pack
+/// accepted from clients together with the number of packs server has applied to gamestate before it.
+class CGameRecorder : boost::noncopyable
+{
+public:
+	static const std::string MAGIC;
+
+	/// Starts recording into user cache directory if enabled in settings ("server"/"recordReplay"), nullptr otherwise
+	static std::unique_ptr<CGameRecorder> createIfEnabled(CGameState * gs, int rngSeed);
+
+	CGameRecorder(const boost::filesystem::path & fname, CGameState * gs, int rngSeed); //throws!
+	~CGameRecorder();
+
+	void recordPack(const CPackForServer * pack, PlayerColor player, ui64 appliedPacks);
+
+private:
+	boost::mutex mx;
+	std::unique_ptr<CSaveFile> file;
+};
+
+/// Plays recorded game on a headless server, without any connections or AIs.
+/// Each pack is applied as soon as server reaches the state in which the pack was originally received,
+/// so the replay runs as fast as engine can handle the game.
+class CGameReplayer : boost::noncopyable
+{
+public:
+	CGameReplayer(const boost::filesystem::path & fname); //throws!
+	~CGameReplayer();
+
+	/// Plays whole recording and logs timing report; returns false if replay desynchronized
+	bool run();
+
+private:
+	static const int DESYNC_TIMEOUT = 30; //seconds without any progress of server before replay is aborted
+
+	bool waitForServer(ui64 appliedPacks) const; //false if server got stuck or the game ended
+
+	std::unique_ptr<CLoadFile> file;
+	std::unique_ptr<CGameHandler> gh;
+};
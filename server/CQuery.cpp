@@ -124,17 +124,96 @@ void CObjectVisitQuery::onExposure(CGameHandler *gh, QueryPtr topQuery)
 	gh->queries.popQuery(*this);
 }
 
+Queries::Queries():
+	gh(nullptr)
+{
+	for(int i = 0; i < PlayerColor::PLAYER_LIMIT_I; i++)
+		queries[PlayerColor(i)];
+}
+
+Queries::PlayerQueries * Queries::getPlayerQueries(PlayerColor player)
+{
+	auto it = queries.find(player);
+	return it != queries.end() ? &it->second : nullptr;
+}
+
+const Queries::PlayerQueries * Queries::getPlayerQueries(PlayerColor player) const
+{
+	auto it = queries.find(player);
+	return it != queries.end() ? &it->second : nullptr;
+}
+
+void Queries::addToIndex(QueryPtr query)
+{
+	boost::unique_lock<boost::mutex> lock(indexMx);
+	if(stacksCount[query.get()]++)
+		return; //already indexed
+
+	if(auto visit = std::dynamic_pointer_cast<CObjectVisitQuery>(query))
+	{
+		visitsByObject.insert(std::make_pair(visit->visitedObject, visit));
+	}
+	else if(auto battle = std::dynamic_pointer_cast<CBattleQuery>(query))
+	{
+		battles[battle->bi] = battle;
+	}
+}
+
+template <typename Index, typename Key>
+static void eraseFromIndex(Index & index, const Key & key, QueryPtr query)
+{
+	auto range = index.equal_range(key);
+	for(auto it = range.first; it != range.second; ++it)
+	{
+		if(it->second == query)
+		{
+			index.erase(it);
+			return;
+		}
+	}
+}
+
+void Queries::removeFromIndex(QueryPtr query)
+{
+	boost::unique_lock<boost::mutex> lock(indexMx);
+	auto count = stacksCount.find(query.get());
+	if(count == stacksCount.end() || --count->second > 0)
+		return; //still on stack of another player
+	stacksCount.erase(count);
+
+	if(auto visit = std::dynamic_pointer_cast<CObjectVisitQuery>(query))
+	{
+		eraseFromIndex(visitsByObject, visit->visitedObject, query);
+	}
+	else if(auto battle = std::dynamic_pointer_cast<CBattleQuery>(query))
+	{
+		eraseFromIndex(battles, battle->bi, query);
+	}
+}
+
 void Queries::popQuery(PlayerColor player, QueryPtr query)
 {
 	LOG_TRACE_PARAMS(logGlobal, "player='%s', query='%s'", player % query);
-	if(topQuery(player) != query)
+	PlayerQueries * playerQueries = getPlayerQueries(player);
+	if(!playerQueries)
 	{
-		logGlobal->traceStream() << "Cannot remove, not a top!";
+		logGlobal->traceStream() << "Cannot remove, no queries of player " << player;
 		return;
 	}
 
-	queries[player] -= query;
-	auto nextQuery = topQuery(player);
+	QueryPtr nextQuery;
+	{
+		boost::unique_lock<boost::mutex> lock(playerQueries->mx);
+		if(vstd::backOrNull(playerQueries->stack) != query)
+		{
+			logGlobal->traceStream() << "Cannot remove, not a top!";
+			return;
+		}
+
+		playerQueries->stack.pop_back();
+		nextQuery = vstd::backOrNull(playerQueries->stack);
+	}
+	removeFromIndex(query);
 
 	query->onRemoval(gh, player);
 
@@ -175,13 +254,29 @@ void Queries::addQuery(QueryPtr query)
 void Queries::addQuery(PlayerColor player, QueryPtr query)
 {
 	LOG_TRACE_PARAMS(logGlobal, "player='%s', query='%s'", player % query);
+	PlayerQueries * playerQueries = getPlayerQueries(player);
+	if(!playerQueries)
+	{
+		logGlobal->errorStream() << "Cannot add query for invalid player " << player;
+		return;
+	}
+
 	query->onAdding(gh, player);
-	queries[player].push_back(query);
+	{
+		boost::unique_lock<boost::mutex> lock(playerQueries->mx);
+		playerQueries->stack.push_back(query);
+	}
+	addToIndex(query);
 }
 
 QueryPtr Queries::topQuery(PlayerColor player)
 {
-	return vstd::backOrNull(queries[player]);
+	const PlayerQueries * playerQueries = getPlayerQueries(player);
+	if(!playerQueries)
+		return QueryPtr();
+
+	boost::unique_lock<boost::mutex> lock(playerQueries->mx);
+	return vstd::backOrNull(playerQueries->stack);
 }
 
 void Queries::popIfTop(QueryPtr query)
@@ -200,12 +295,36 @@ void Queries::popIfTop(const CQuery &query)
 			popQuery(color, topQuery(color));
 }
 
+std::shared_ptr<CObjectVisitQuery> Queries::getVisitQuery(const CGObjectInstance * visitedObject) const
+{
+	boost::unique_lock<boost::mutex> lock(indexMx);
+	auto it = visitsByObject.find(visitedObject);
+	return it != visitsByObject.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<CBattleQuery> Queries::getBattleQuery(const BattleInfo * battle) const
+{
+	boost::unique_lock<boost::mutex> lock(indexMx);
+	auto it = battles.find(battle);
+	return it != battles.end() ? it->second : nullptr;
+}
+
+int Queries::getStacksCount(QueryPtr query) const
+{
+	boost::unique_lock<boost::mutex> lock(indexMx);
+	auto it = stacksCount.find(query.get());
+	return it != stacksCount.end() ? it->second : 0;
+}
+
 std::vector<std::shared_ptr<const CQuery>> Queries::allQueries() const
 {
 	std::vector<std::shared_ptr<const CQuery>> ret;
 	for(auto &playerQueries : queries)
-		for(auto &query : playerQueries.second)
+	{
+		boost::unique_lock<boost::mutex> lock(playerQueries.second.mx);
+		for(auto &query : playerQueries.second.stack)
 			ret.push_back(query);
+	}
 
 	return ret;
 }
@@ -215,8 +334,11 @@ std::vector<std::shared_ptr<CQuery>> Queries::allQueries()
 	//TODO code duplication with const function :(
 	std::vector<std::shared_ptr<CQuery>> ret;
 	for(auto &playerQueries : queries)
-		for(auto &query : playerQueries.second)
-		ret.push_back(query);
+	{
+		boost::unique_lock<boost::mutex> lock(playerQueries.second.mx);
+		for(auto &query : playerQueries.second.stack)
+			ret.push_back(query);
+	}
 
 	return ret;
 }
@@ -166,14 +166,31 @@ public:
 struct Queries
 {
 private:
+	struct PlayerQueries
+	{
+		mutable boost::mutex mx; //guards stack, never held while calling query callbacks
+		std::vector<QueryPtr> stack;
+	};
+
 	void addQuery(PlayerColor player, QueryPtr query);
 	void popQuery(PlayerColor player, QueryPtr query);
+	PlayerQueries * getPlayerQueries(PlayerColor player); //nullptr if player is not valid
+	const PlayerQueries * getPlayerQueries(PlayerColor player) const;
+	void addToIndex(QueryPtr query);
+	void removeFromIndex(QueryPtr query);
+
+	std::map<PlayerColor, PlayerQueries> queries; //player => stack of queries, created for all players at once and never modified afterwards
 
-	std::map<PlayerColor, std::vector<QueryPtr>> queries; //player => stack of queries
+	mutable boost::mutex indexMx; //guards all indices below
+	std::map<const CQuery *, int> stacksCount; //query => number of player stacks it is on
+	std::multimap<const CGObjectInstance *, std::shared_ptr<CObjectVisitQuery>> visitsByObject;
+	std::map<const BattleInfo *, std::shared_ptr<CBattleQuery>> battles;
 
 public:
 	CGameHandler *gh;
-	static boost::mutex mx;
+	static boost::mutex mx; //guards generation of query IDs
+
+	Queries();
 
 	void addQuery(QueryPtr query);
 	void popQuery(const CQuery &query);
@@ -183,6 +200,10 @@ public:
 
 	QueryPtr topQuery(PlayerColor player);
 
+	std::shared_ptr<CObjectVisitQuery> getVisitQuery(const CGObjectInstance * visitedObject) const; //nullptr if object is not being visited
+	std::shared_ptr<CBattleQuery> getBattleQuery(const BattleInfo * battle) const; //nullptr if there is no query for the battle
+	int getStacksCount(QueryPtr query) const; //number of players whose stack contains the query
+
 	std::vector<std::shared_ptr<const CQuery>> allQueries() const;
 	std::vector<std::shared_ptr<CQuery>> allQueries();
 	//void removeQuery
@@ -24,6 +24,7 @@
 #include "../lib/VCMI_Lib.h"
 #include "../lib/VCMIDirs.h"
 #include "CGameHandler.h"
+#include "CGameRecorder.h"
 #include "../lib/mapping/CMapInfo.h"
 #include "../lib/GameConstants.h"
 #include "../lib/logging/CBasicLogConfigurator.h"
@@ -520,7 +521,10 @@ static void handleCommandOptions(int argc, char *argv[])
 		("help,h", "display help and exit")
 		("version,v", "display version information and exit")
 		("port", po::value<int>()->default_value(3030), "port at which server will listen to connections from client")
-		("resultsFile", po::value<std::string>()->default_value("./results.txt"), "file to which the battle result will be appended. Used only in the DUEL mode.");
+		("resultsFile", po::value<std::string>()->default_value("./results.txt"), "file to which the battle result will be appended. Used only in the DUEL mode.")
+		("replay", po::value<std::string>(), "plays recorded game from given file without any clients and reports its timing")
+		("sequentialTurns", "players take turns one by one even if concurrentAiTurns is enabled, so game with given seed can be reproduced")
+		("console", "reads commands (e.g. netstats) from standard input, use only when server does not share terminal with client");
 
 	if(argc > 1)
 	{
@@ -583,6 +587,28 @@ void handleLinuxSignal(int sig)
 }
 #endif
 
+static void processCommand(const std::string &message)
+{
+	std::istringstream readed;
+	readed.str(message);
+	std::string cn; //command name
+	readed >> cn;
+
+	if(cn == "netstats")
+	{
+		std::string what;
+		readed >> what;
+		if(what == "reset")
+			CNetworkStatistics::get().reset();
+		else
+			CNetworkStatistics::get().report(std::cout);
+	}
+	else if(!cn.empty())
+	{
+		logGlobal->warnStream() << "Unknown server command: " << cn;
+	}
+}
+
 int main(int argc, char** argv)
 {
 	// Installs a sig sev segmentation violation handler
@@ -605,6 +631,27 @@ int main(int argc, char** argv)
 
 	loadDLLClasses();
 	srand ( (ui32)time(nullptr) );
+
+	if(cmdLineOptions.count("console"))
+	{
+		*console->cb = processCommand;
+		console->start();
+	}
+
+	if(cmdLineOptions.count("replay"))
+	{
+		bool synchronized = false;
+		try
+		{
+			CGameReplayer replayer(cmdLineOptions["replay"].as<std::string>());
+			synchronized = replayer.run();
+		}
+		catch(std::exception &e)
+		{
+			logGlobal->errorStream() << "Cannot replay game: " << e.what();
+		}
+		return synchronized ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 	try
 	{
 		boost::asio::io_service io_service;
@@ -0,0 +1,223 @@
+/*
+ * CConcurrentTurnsTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../server/CConcurrentTurns.h"
+#include "../lib/CGameState.h"
+#include "../lib/CPlayerState.h"
+#include "../lib/Connection.h"
+#include "../lib/NetPacks.h"
+#include "../lib/mapObjects/CGHeroInstance.h"
+#include "../lib/mapObjects/MiscObjects.h"
+#include "../lib/mapping/CMap.h"
+
+namespace
+{
+	/// Map of 12x6 grass tiles split by wall in column 5: rock in upper half, blocked grass (e.g. trees) in lower half.
+	/// Players 0 and 2 have heroes left of the wall, player 1 right of it.
+	struct CConcurrentTurnsFixture
+	{
+		CGameState gs;
+		const std::vector<PlayerColor> first, second;
+
+		CConcurrentTurnsFixture():
+			first(1, PlayerColor(0)), second(1, PlayerColor(1))
+		{
+			gs.map = new CMap();
+			gs.map->width = 12;
+			gs.map->height = 6;
+			gs.map->twoLevel = false;
+			gs.map->initTerrain();
+			for(int y = 0; y < gs.map->height; y++)
+			{
+				for(int x = 0; x < gs.map->width; x++)
+				{
+					TerrainTile & tile = gs.map->getTile(int3(x, y, 0));
+					tile.terType = x == 5 && y < 3 ? ETerrainType::ROCK : ETerrainType::GRASS;
+					tile.blocked = x == 5;
+					tile.visitable = false;
+				}
+			}
+
+			for(int i = 0; i < 3; i++)
+			{
+				PlayerState & state = gs.players[PlayerColor(i)];
+				state.color = PlayerColor(i);
+				state.human = false;
+			}
+			addHero(PlayerColor(0), int3(1, 1, 0));
+			addHero(PlayerColor(1), int3(8, 1, 0));
+			addHero(PlayerColor(2), int3(3, 4, 0));
+		}
+
+		CGHeroInstance * addHero(PlayerColor owner, const int3 & pos)
+		{
+			auto hero = new CGHeroInstance();
+			hero->id = ObjectInstanceID(gs.map->objects.size());
+			hero->tempOwner = owner;
+			hero->pos = pos;
+			gs.map->objects.push_back(hero);
+			gs.players[owner].heroes.push_back(hero);
+			return hero;
+		}
+
+		void addTeleport(const int3 & entrance, const int3 & exit)
+		{
+			auto channel = std::make_shared<TeleportChannel>();
+			for(auto pos : {entrance, exit})
+			{
+				auto obj = new CGObjectInstance();
+				obj->id = ObjectInstanceID(gs.map->objects.size());
+				obj->pos = pos;
+				gs.map->objects.push_back(obj);
+				(pos == entrance ? channel->entrances : channel->exits).push_back(obj->id);
+			}
+			gs.map->teleportChannels[TeleportChannelID(gs.map->teleportChannels.size())] = channel;
+		}
+
+		static CConcurrentTurns::Request makeRequest(PlayerColor player, si32 requestID)
+		{
+			CConcurrentTurns::Request ret;
+			ret.pack = nullptr;
+			ret.c = nullptr;
+			ret.player = player;
+			ret.requestID = requestID;
+			return ret;
+		}
+	};
+}
+
+BOOST_FIXTURE_TEST_CASE(CConcurrentTurns_Regions, CConcurrentTurnsFixture)
+{
+	CConcurrentTurns subject(&gs);
+
+	const si32 left = subject.getRegion(int3(0, 0, 0));
+	const si32 right = subject.getRegion(int3(11, 5, 0));
+	BOOST_CHECK_NE(-1, left);
+	BOOST_CHECK_NE(-1, right);
+	BOOST_CHECK_NE(left, right);
+	for(int y = 0; y < gs.map->height; y++)
+	{
+		for(int x = 0; x < gs.map->width; x++)
+		{
+			const si32 expected = x < 5 ? left : (x == 5 ? -1 : right);
+			BOOST_CHECK_EQUAL(expected, subject.getRegion(int3(x, y, 0)));
+		}
+	}
+
+	BOOST_CHECK(subject.canJoin(first, PlayerColor(1)));
+	BOOST_CHECK(subject.canJoin(second, PlayerColor(2)));
+	BOOST_CHECK(!subject.canJoin(first, PlayerColor(2))); //same region
+	BOOST_CHECK(!subject.canJoin({PlayerColor(0), PlayerColor(1)}, PlayerColor(2)));
+
+	gs.players[PlayerColor(1)].human = true;
+	BOOST_CHECK(!subject.canJoin(first, PlayerColor(1)));
+}
+
+BOOST_FIXTURE_TEST_CASE(CConcurrentTurns_Connections, CConcurrentTurnsFixture)
+{
+	//blocked tile that can be visited (guarding monster) joins regions as any passable one
+	gs.map->getTile(int3(5, 4, 0)).visitable = true;
+	{
+		CConcurrentTurns subject(&gs);
+		BOOST_CHECK_EQUAL(subject.getRegion(int3(0, 0, 0)), subject.getRegion(int3(11, 0, 0)));
+		BOOST_CHECK(!subject.canJoin(first, PlayerColor(1)));
+	}
+
+	gs.map->getTile(int3(5, 4, 0)).visitable = false;
+	addTeleport(int3(2, 2, 0), int3(10, 2, 0));
+	{
+		CConcurrentTurns subject(&gs);
+		BOOST_CHECK_EQUAL(subject.getRegion(int3(0, 0, 0)), subject.getRegion(int3(11, 0, 0)));
+		BOOST_CHECK_EQUAL(-1, subject.getRegion(int3(5, 4, 0)));
+		BOOST_CHECK(!subject.canJoin(first, PlayerColor(1)));
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(CConcurrentTurns_Flying, CConcurrentTurnsFixture)
+{
+	CConcurrentTurns subject(&gs);
+	BOOST_CHECK(!subject.canLeaveRegions(PlayerColor(1)));
+
+	auto hero = gs.players[PlayerColor(1)].heroes.front();
+	hero->addNewBonus(new Bonus(Bonus::PERMANENT, Bonus::FLYING_MOVEMENT, Bonus::ARTIFACT, 0, 0));
+	BOOST_CHECK(subject.canLeaveRegions(PlayerColor(1)));
+	BOOST_CHECK(!subject.canJoin(first, PlayerColor(1)));
+	BOOST_CHECK(!subject.canJoin(second, PlayerColor(2)));
+}
+
+BOOST_FIXTURE_TEST_CASE(CConcurrentTurns_FlyingDuringTurn, CConcurrentTurnsFixture)
+{
+	CConcurrentTurns subject(&gs);
+	subject.begin({PlayerColor(0), PlayerColor(1)});
+	BOOST_CHECK(subject.isTakingTurn(PlayerColor(1)));
+	BOOST_CHECK(!subject.isTakingTurn(PlayerColor(2)));
+	BOOST_CHECK(!subject.defer(makeRequest(PlayerColor(2), 1)));
+
+	for(int i = 0; i < 4; i++)
+		BOOST_CHECK(subject.defer(makeRequest(PlayerColor(i % 2), i)));
+
+	CConcurrentTurns::Request request;
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(0, request.requestID);
+	subject.requestApplied(PlayerColor(0));
+
+	//hero of player 1 gets wings, from now on only his requests are taken
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(1, request.requestID);
+	gs.players[PlayerColor(1)].heroes.front()->addNewBonus(new Bonus(Bonus::PERMANENT, Bonus::FLYING_MOVEMENT, Bonus::ARTIFACT, 0, 0));
+	subject.requestApplied(PlayerColor(1));
+
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(3, request.requestID);
+	BOOST_CHECK(!subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+
+	subject.requestApplied(PlayerColor(0)); //others can't stop the group meanwhile
+	BOOST_CHECK(!subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+
+	subject.turnEnded(PlayerColor(1));
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(2, request.requestID);
+	BOOST_CHECK(subject.end().empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(CConcurrentTurns_MapChanged, CConcurrentTurnsFixture)
+{
+	CConcurrentTurns subject(&gs);
+	subject.begin({PlayerColor(0), PlayerColor(1)});
+
+	//blocking object in the wall is removed, regions are computed again only after pack that can change blocked tiles
+	gs.map->getTile(int3(5, 4, 0)).blocked = false;
+	subject.packApplied(typeList.getTypeID<SetMovePoints>());
+	BOOST_CHECK_NE(subject.getRegion(int3(0, 0, 0)), subject.getRegion(int3(11, 0, 0)));
+	subject.packApplied(typeList.getTypeID<RemoveObject>());
+	BOOST_CHECK_EQUAL(subject.getRegion(int3(0, 0, 0)), subject.getRegion(int3(11, 0, 0)));
+	BOOST_CHECK(!subject.canJoin(first, PlayerColor(1)));
+
+	//player whose request joined the regions takes its turn alone
+	for(int i = 0; i < 3; i++)
+		BOOST_CHECK(subject.defer(makeRequest(PlayerColor(i % 2), i)));
+	subject.requestApplied(PlayerColor(1));
+
+	CConcurrentTurns::Request request;
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(1, request.requestID);
+	BOOST_CHECK(!subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+
+	//the other one can't meet anybody that didn't end turn
+	subject.turnEnded(PlayerColor(1));
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(0, request.requestID);
+	BOOST_REQUIRE(subject.takeRequest(request, boost::posix_time::milliseconds(1)));
+	BOOST_CHECK_EQUAL(2, request.requestID);
+	BOOST_CHECK(subject.end().empty());
+}
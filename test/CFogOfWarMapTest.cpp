@@ -0,0 +1,243 @@
+/*
+ * CFogOfWarMapTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/CFogOfWarMap.h"
+
+namespace
+{
+	/// Fog of war stored as one byte per tile, changed by same scans as before bit planes were introduced
+	struct ReferenceFog
+	{
+		int3 sizes;
+		std::vector<std::vector<std::vector<ui8> > > tiles;
+
+		ReferenceFog(const int3 & Sizes):
+			sizes(Sizes)
+		{
+			tiles.resize(sizes.x);
+			for(auto & column : tiles)
+			{
+				column.resize(sizes.y);
+				for(auto & tile : column)
+					tile.resize(sizes.z, 0);
+			}
+		}
+
+		/// Tiles in range as returned by getTilesInRange
+		std::vector<int3> circle(const int3 & pos, int radius) const
+		{
+			std::vector<int3> ret;
+			if(radius == -1)
+			{
+				for(int x = 0; x < sizes.x; x++)
+					for(int y = 0; y < sizes.y; y++)
+						for(int z = 0; z < sizes.z; z++)
+							ret.push_back(int3(x, y, z));
+				return ret;
+			}
+			for(int xd = std::max<int>(pos.x - radius, 0); xd <= std::min<int>(pos.x + radius, sizes.x - 1); xd++)
+			{
+				for(int yd = std::max<int>(pos.y - radius, 0); yd <= std::min<int>(pos.y + radius, sizes.y - 1); yd++)
+				{
+					int3 tilePos(xd, yd, pos.z);
+					if(pos.dist2d(tilePos) - 0.5 <= radius)
+						ret.push_back(tilePos);
+				}
+			}
+			return ret;
+		}
+
+		void setCircle(const int3 & pos, int radius, bool visible)
+		{
+			for(const int3 & tile : circle(pos, radius))
+				tiles[tile.x][tile.y][tile.z] = visible;
+		}
+	};
+
+	void checkSameTiles(const CFogOfWarMap & subject, const ReferenceFog & reference)
+	{
+		ui32 visible = 0;
+		for(int x = 0; x < reference.sizes.x; x++)
+		{
+			for(int y = 0; y < reference.sizes.y; y++)
+			{
+				for(int z = 0; z < reference.sizes.z; z++)
+				{
+					BOOST_REQUIRE_EQUAL(bool(reference.tiles[x][y][z]), subject.isVisible(int3(x, y, z)));
+					visible += reference.tiles[x][y][z];
+				}
+			}
+		}
+		BOOST_CHECK_EQUAL(visible, subject.count());
+	}
+
+	std::unordered_set<int3, ShashInt3> spansToTiles(const std::vector<TileSpan> & spans)
+	{
+		std::unordered_set<int3, ShashInt3> ret;
+		CFogOfWarMap::getTiles(spans, ret);
+		return ret;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CFogOfWarMap_Circles)
+{
+	//width not divisible by word size, so padding of rows matters
+	const int3 sizes(100, 70, 2);
+	CFogOfWarMap subject(sizes);
+	ReferenceFog reference(sizes);
+	checkSameTiles(subject, reference);
+
+	std::mt19937 gen(1337);
+	std::uniform_int_distribution<int> x(-5, sizes.x + 5), y(-5, sizes.y + 5), z(0, sizes.z - 1), radius(0, 70);
+	std::bernoulli_distribution visible(0.7);
+	for(int i = 0; i < 200; i++)
+	{
+		const int3 center(x(gen), y(gen), z(gen));
+		const int r = radius(gen);
+		const bool show = visible(gen);
+		subject.setCircle(center, r, show);
+		reference.setCircle(center, r, show);
+		checkSameTiles(subject, reference);
+	}
+
+	subject.setCircle(int3(), -1, true);
+	reference.setCircle(int3(), -1, true);
+	checkSameTiles(subject, reference);
+	BOOST_CHECK_EQUAL(sizes.x * sizes.y, subject.count(1));
+}
+
+BOOST_AUTO_TEST_CASE(CFogOfWarMap_CircleSpans)
+{
+	const int3 sizes(130, 40, 1);
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> x(0, sizes.x - 1), y(0, sizes.y - 1), radius(0, 80);
+	for(int i = 0; i < 100; i++)
+	{
+		const int3 center(x(gen), y(gen), 0);
+		const int r = radius(gen);
+		ReferenceFog reference(sizes);
+
+		std::vector<TileSpan> spans;
+		CFogOfWarMap::getCircleSpans(spans, center, r, sizes);
+		auto circle = reference.circle(center, r);
+		const std::unordered_set<int3, ShashInt3> expected(circle.begin(), circle.end());
+		BOOST_CHECK(spansToTiles(spans) == expected);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CFogOfWarMap_FilteredCircleSpans)
+{
+	const int3 sizes(72, 72, 1);
+	CFogOfWarMap subject(sizes);
+	ReferenceFog reference(sizes);
+	subject.setCircle(int3(20, 20, 0), 15, true);
+	reference.setCircle(int3(20, 20, 0), 15, true);
+	subject.setCircle(int3(60, 30, 0), 9, true);
+	reference.setCircle(int3(60, 30, 0), 9, true);
+
+	for(int mode = -1; mode <= 1; mode += 2) //as in getTilesInRange: 1 - hidden tiles, -1 - visible ones
+	{
+		const int3 center(40, 25, 0);
+		std::vector<TileSpan> spans;
+		subject.getCircleSpans(spans, center, 30, mode == -1);
+
+		std::unordered_set<int3, ShashInt3> expected;
+		for(const int3 & tile : reference.circle(center, 30))
+			if(reference.tiles[tile.x][tile.y][tile.z] == (mode == -1))
+				expected.insert(tile);
+		BOOST_CHECK(spansToTiles(spans) == expected);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CFogOfWarMap_SpansAndSets)
+{
+	const int3 sizes(150, 20, 2);
+	CFogOfWarMap subject(sizes);
+	std::unordered_set<int3, ShashInt3> tiles;
+
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> x(0, sizes.x - 1), y(0, sizes.y - 1), z(0, sizes.z - 1);
+	for(int i = 0; i < 1500; i++)
+	{
+		const int3 tile(x(gen), y(gen), z(gen));
+		subject.setVisible(tile, true);
+		tiles.insert(tile);
+	}
+	BOOST_CHECK_EQUAL(tiles.size(), subject.count());
+
+	auto spans = subject.toSpans();
+	BOOST_CHECK(spansToTiles(spans) == tiles);
+	BOOST_CHECK_EQUAL(CFogOfWarMap::toSpans(tiles).size(), spans.size());
+
+	CFogOfWarMap copy(sizes);
+	copy.setSpans(spans, true);
+	BOOST_CHECK(spansToTiles(copy.toSpans()) == tiles);
+
+	//everything hidden except subject's tiles, then subject's tiles removed again
+	CFogOfWarMap inverted(sizes);
+	inverted.setAll(true);
+	inverted.subtract(subject);
+	BOOST_CHECK_EQUAL(sizes.x * sizes.y * sizes.z - tiles.size(), inverted.count());
+	inverted.unite(subject);
+	BOOST_CHECK_EQUAL(sizes.x * sizes.y * sizes.z, inverted.count());
+	inverted.setSpans(spans, false);
+	BOOST_CHECK_EQUAL(sizes.x * sizes.y * sizes.z - tiles.size(), inverted.count());
+}
+
+BOOST_AUTO_TEST_CASE(CFogOfWarMap_CountCircle)
+{
+	//rows crossing several words and ending inside them, centers also outside of map
+	const int3 sizes(140, 50, 2);
+	CFogOfWarMap subject(sizes);
+	ReferenceFog reference(sizes);
+
+	std::mt19937 gen(2718);
+	std::uniform_int_distribution<int> x(-10, sizes.x + 10), y(-10, sizes.y + 10), z(0, sizes.z - 1), radius(0, 90);
+	for(int i = 0; i < 40; i++)
+	{
+		const int3 center(x(gen), y(gen), z(gen));
+		const int r = radius(gen) / 2;
+		const bool show = i % 3 != 0;
+		subject.setCircle(center, r, show);
+		reference.setCircle(center, r, show);
+	}
+
+	for(int i = 0; i < 300; i++)
+	{
+		const int3 center(x(gen), y(gen), z(gen));
+		const int r = radius(gen);
+
+		//same scan as howManyTilesWillBeDiscovered did before counting by rows
+		ui32 hidden = 0, visible = 0;
+		for(int xd = center.x - r; xd <= center.x + r; xd++)
+		{
+			for(int yd = center.y - r; yd <= center.y + r; yd++)
+			{
+				const int3 tile(xd, yd, center.z);
+				if(tile.x >= 0 && tile.y >= 0 && tile.x < sizes.x && tile.y < sizes.y && center.dist2d(tile) - 0.5 < r)
+				{
+					if(reference.tiles[tile.x][tile.y][tile.z])
+						visible++;
+					else
+						hidden++;
+				}
+			}
+		}
+
+		BOOST_CHECK_EQUAL(hidden, subject.countCircle(center, r, false));
+		BOOST_CHECK_EQUAL(visible, subject.countCircle(center, r, true));
+	}
+
+	BOOST_CHECK_EQUAL(subject.count(), subject.countCircle(int3(), -1, true));
+	BOOST_CHECK_EQUAL(sizes.x * sizes.y * sizes.z - subject.count(), subject.countCircle(int3(), -1, false));
+}
@@ -0,0 +1,83 @@
+/*
+ * CFuzzyEnginesTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../AI/VCAI/FuzzyEngines.h"
+
+namespace
+{
+	const double SAFE_ATTACK_CONSTANT = 1.5;
+	const size_t RANDOM_INPUTS = 20000;
+
+	/// Inputs at edges of range and of terms, slightly outside the range, then random ones
+	std::vector<double> inputValues(const fl::InputVariable * variable, std::mt19937 & gen)
+	{
+		std::vector<double> ret = {variable->getMinimum() - 1, variable->getMinimum(), variable->getMaximum(), variable->getMaximum() + 1};
+		for(int i = 0; i <= 20; i++)
+			ret.push_back(variable->getMinimum() + (variable->getMaximum() - variable->getMinimum()) * i / 20);
+
+		std::uniform_real_distribution<double> dist(variable->getMinimum(), variable->getMaximum());
+		while(ret.size() < 64)
+			ret.push_back(dist(gen));
+		return ret;
+	}
+
+	template <typename Engine>
+	void checkSameResults(Engine & interpreted, Engine & compiled)
+	{
+		BOOST_REQUIRE(!interpreted.compiled.isCompiled());
+		BOOST_REQUIRE(compiled.compiled.isCompiled());
+		BOOST_REQUIRE_EQUAL(interpreted.engine.numberOfInputVariables(), compiled.engine.numberOfInputVariables());
+
+		std::mt19937 gen(42);
+		const int inputsCount = interpreted.engine.numberOfInputVariables();
+		std::vector<std::vector<double>> values;
+		for(int i = 0; i < inputsCount; i++)
+			values.push_back(inputValues(interpreted.engine.getInputVariable(i), gen));
+
+		int mismatches = 0;
+		for(size_t n = 0; n < RANDOM_INPUTS; n++)
+		{
+			for(int i = 0; i < inputsCount; i++)
+			{
+				//first inputs walk through edge values of each variable together, later ones are mixed
+				const auto & candidates = values[i];
+				const double input = n < candidates.size() ? candidates[n] : candidates[gen() % candidates.size()];
+				interpreted.engine.getInputVariable(i)->setInputValue(input);
+				compiled.engine.getInputVariable(i)->setInputValue(input);
+			}
+			interpreted.process();
+			compiled.process();
+
+			for(int i = 0; i < interpreted.engine.numberOfOutputVariables(); i++)
+			{
+				const double expected = interpreted.engine.getOutputVariable(i)->getOutputValue();
+				const double actual = compiled.engine.getOutputVariable(i)->getOutputValue();
+				if(expected != actual && !(std::isnan(expected) && std::isnan(actual)))
+					mismatches++;
+			}
+		}
+		BOOST_CHECK_EQUAL(mismatches, 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CFuzzyEngines_TacticalAdvantage_SameAsInterpreter)
+{
+	TacticalAdvantage interpreted(false), compiled(true);
+	checkSameResults(interpreted, compiled);
+}
+
+BOOST_AUTO_TEST_CASE(CFuzzyEngines_EvalVisitTile_SameAsInterpreter)
+{
+	EvalVisitTile interpreted(SAFE_ATTACK_CONSTANT, false), compiled(SAFE_ATTACK_CONSTANT, true);
+	checkSameResults(interpreted, compiled);
+}
@@ -0,0 +1,220 @@
+/*
+ * CGoalEvaluationTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../AI/VCAI/GoalEvaluation.h"
+
+namespace
+{
+	/// Stands for a goal: its priority and whether it can be evaluated on any thread
+	struct CTestGoal
+	{
+		float priority;
+		bool reentrant;
+	};
+
+	bool isReentrant(const CTestGoal & goal)
+	{
+		return goal.reentrant;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_BestCandidate)
+{
+	BOOST_CHECK_EQUAL(0, bestCandidate({1.0f}));
+	BOOST_CHECK_EQUAL(1, bestCandidate({1.0f, 3.0f, 2.0f}));
+	BOOST_CHECK_EQUAL(0, bestCandidate({3.0f, 1.0f, 2.0f}));
+	BOOST_CHECK_EQUAL(2, bestCandidate({-3.0f, -2.0f, -1.0f}));
+
+	//last one of equal priorities is chosen, as by FuzzyHelper::chooseSolution before
+	BOOST_CHECK_EQUAL(2, bestCandidate({1.0f, 3.0f, 3.0f, 2.0f}));
+	BOOST_CHECK_EQUAL(3, bestCandidate({0.0f, 0.0f, 0.0f, 0.0f}));
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_NoCandidates)
+{
+	int evaluations = 0;
+	auto priorities = evaluateCandidates(std::vector<CTestGoal>(), isReentrant, [&](const CTestGoal & goal)
+	{
+		evaluations++;
+		return goal.priority;
+	});
+	BOOST_CHECK(priorities.empty());
+	BOOST_CHECK_EQUAL(0, evaluations);
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_PrioritiesInOrder)
+{
+	//reentrant goals are spread over workers, one each, others are mixed in between
+	std::vector<CTestGoal> goals;
+	for(int i = 0; i < 20; i++)
+		goals.push_back(CTestGoal{i * 0.5f, i % 3 != 0});
+
+	auto priorities = evaluateCandidates(goals, isReentrant, [](const CTestGoal & goal)
+	{
+		return goal.priority;
+	}, 1);
+	BOOST_REQUIRE_EQUAL(goals.size(), priorities.size());
+	for(size_t i = 0; i < goals.size(); i++)
+		BOOST_CHECK_EQUAL(goals[i].priority, priorities[i]);
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_NonReentrantFirstOnCallingThread)
+{
+	std::vector<CTestGoal> goals;
+	for(int i = 0; i < 12; i++)
+		goals.push_back(CTestGoal{float(i), i % 4 == 0});
+
+	boost::mutex mx;
+	std::vector<int> order;
+	std::vector<boost::thread::id> threads(goals.size());
+	evaluateCandidates(goals, isReentrant, [&](const CTestGoal & goal)
+	{
+		boost::unique_lock<boost::mutex> lock(mx);
+		order.push_back(int(goal.priority));
+		threads[int(goal.priority)] = boost::this_thread::get_id();
+		return goal.priority;
+	}, 1);
+
+	const std::vector<int> nonReentrant = {1, 2, 3, 5, 6, 7, 9, 10, 11};
+	BOOST_REQUIRE_EQUAL(goals.size(), order.size());
+	BOOST_CHECK_EQUAL_COLLECTIONS(nonReentrant.begin(), nonReentrant.end(), order.begin(), order.begin() + nonReentrant.size());
+	for(int i : nonReentrant)
+		BOOST_CHECK(threads[i] == boost::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_ReentrantException)
+{
+	std::vector<CTestGoal> goals;
+	for(int i = 0; i < 10; i++)
+		goals.push_back(CTestGoal{float(i), i != 0});
+
+	//failure of reentrant goal is rethrown once other evaluations, also later ones, have ended
+	std::atomic<int> evaluations(0);
+	BOOST_CHECK_THROW(evaluateCandidates(goals, isReentrant, [&](const CTestGoal & goal) -> float
+	{
+		evaluations++;
+		if(goal.priority == 3)
+			throw std::runtime_error("evaluation failed");
+		return goal.priority;
+	}, 1), std::runtime_error);
+	BOOST_CHECK_EQUAL(goals.size(), evaluations.load());
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_NonReentrantException)
+{
+	std::vector<CTestGoal> goals;
+	for(int i = 0; i < 10; i++)
+		goals.push_back(CTestGoal{float(i), i > 2});
+
+	//failure on calling thread stops evaluation at once, reentrant goals are not started
+	std::atomic<int> evaluations(0);
+	BOOST_CHECK_THROW(evaluateCandidates(goals, isReentrant, [&](const CTestGoal & goal) -> float
+	{
+		evaluations++;
+		if(goal.priority == 1)
+			throw std::runtime_error("evaluation failed");
+		return goal.priority;
+	}, 1), std::runtime_error);
+	BOOST_CHECK_EQUAL(2, evaluations.load());
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_MemoRemembersPriority)
+{
+	EvaluationMemo<int, int> memo;
+	int evaluations = 0;
+	auto evaluate = [&](float priority)
+	{
+		return [&evaluations, priority]()
+		{
+			evaluations++;
+			return priority;
+		};
+	};
+
+	BOOST_CHECK_EQUAL(1.0f, memo.get(1, 0, 10, evaluate(1.0f)));
+	BOOST_CHECK_EQUAL(2.0f, memo.get(2, 0, 10, evaluate(2.0f)));
+	BOOST_CHECK_EQUAL(2, evaluations);
+
+	//same key, revision and stamp: remembered priority is returned
+	BOOST_CHECK_EQUAL(1.0f, memo.get(1, 0, 10, evaluate(5.0f)));
+	BOOST_CHECK_EQUAL(2, evaluations);
+
+	//different stamp: priority is stale, it is evaluated again and replaced
+	BOOST_CHECK_EQUAL(3.0f, memo.get(1, 0, 11, evaluate(3.0f)));
+	BOOST_CHECK_EQUAL(3.0f, memo.get(1, 0, 11, evaluate(5.0f)));
+	BOOST_CHECK_EQUAL(3, evaluations);
+
+	//other keys are not affected
+	BOOST_CHECK_EQUAL(2.0f, memo.get(2, 0, 10, evaluate(5.0f)));
+	BOOST_CHECK_EQUAL(3, evaluations);
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_MemoRevisions)
+{
+	EvaluationMemo<int, int> memo;
+	int evaluations = 0;
+	auto evaluate = [&](float priority)
+	{
+		return [&evaluations, priority]()
+		{
+			evaluations++;
+			return priority;
+		};
+	};
+	memo.get(1, 0, 10, evaluate(1.0f));
+	memo.get(2, 0, 10, evaluate(2.0f));
+
+	//game has changed: nothing remembered is valid
+	BOOST_CHECK_EQUAL(4.0f, memo.get(1, 1, 10, evaluate(4.0f)));
+	BOOST_CHECK_EQUAL(5.0f, memo.get(2, 1, 10, evaluate(5.0f)));
+	BOOST_CHECK_EQUAL(4, evaluations);
+
+	//evaluation for earlier revision is neither taken from memo nor stored in it
+	BOOST_CHECK_EQUAL(6.0f, memo.get(1, 0, 10, evaluate(6.0f)));
+	BOOST_CHECK_EQUAL(7.0f, memo.get(1, 0, 10, evaluate(7.0f)));
+	BOOST_CHECK_EQUAL(6, evaluations);
+	BOOST_CHECK_EQUAL(4.0f, memo.get(1, 1, 10, evaluate(8.0f)));
+	BOOST_CHECK_EQUAL(6, evaluations);
+}
+
+BOOST_AUTO_TEST_CASE(CGoalEvaluation_MemoSharedByWorkers)
+{
+	//many goals have the same key, as when requested by different parents
+	std::vector<CTestGoal> goals;
+	for(int i = 0; i < 64; i++)
+		goals.push_back(CTestGoal{float(i % 4), true});
+
+	EvaluationMemo<int, int> memo;
+	std::atomic<int> evaluations(0);
+	auto evaluate = [&](const CTestGoal & goal)
+	{
+		return memo.get(int(goal.priority), 0, 0, [&]()
+		{
+			evaluations++;
+			return goal.priority * 1.5f;
+		});
+	};
+
+	auto priorities = evaluateCandidates(goals, isReentrant, evaluate, 1);
+	BOOST_REQUIRE_EQUAL(goals.size(), priorities.size());
+	for(size_t i = 0; i < goals.size(); i++)
+		BOOST_CHECK_EQUAL(goals[i].priority * 1.5f, priorities[i]);
+	BOOST_CHECK_GE(evaluations.load(), 4);
+	BOOST_CHECK_LE(evaluations.load(), int(goals.size()));
+
+	//everything is remembered now
+	evaluations = 0;
+	priorities = evaluateCandidates(goals, isReentrant, evaluate, 1);
+	BOOST_CHECK_EQUAL(0, evaluations.load());
+	BOOST_CHECK_EQUAL(goals.size() - 1, bestCandidate(priorities));
+}
@@ -0,0 +1,188 @@
+/*
+ * CGuardingCreaturesTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/mapping/CMap.h"
+#include "../lib/mapObjects/CObjectHandler.h"
+#include "MapTestUtils.h"
+
+namespace
+{
+	/// Two level map of land, water and rock; guards kept up to date by adding and removing objects are compared with bulk recalculation
+	struct CGuardingCreaturesFixture
+	{
+		const int3 sizes;
+		CMap map;
+		std::vector<std::unique_ptr<CGObjectInstance>> objects;
+		std::vector<ObjectTemplate> templates;
+		std::mt19937 gen;
+
+		CGuardingCreaturesFixture():
+			sizes(36, 30, 2), gen(1234)
+		{
+			templates =
+			{
+				makeTemplate("{\"mask\" : [\"A\"], \"visitableFrom\" : [\"+++\", \"+-+\", \"+++\"]}"),
+				makeTemplate("{\"mask\" : [\"A\"], \"visitableFrom\" : [\"---\", \"+-+\", \"+++\"]}"),
+				makeTemplate("{\"mask\" : [\"VVV\", \"BBA\"], \"visitableFrom\" : [\"---\", \"+-+\", \"+++\"]}"),
+				makeTemplate("{\"mask\" : [\"VVVV\", \"BBBB\", \"BBBA\"], \"visitableFrom\" : [\"---\", \"--+\", \"+++\"]}")
+			};
+
+			map.width = sizes.x;
+			map.height = sizes.y;
+			map.twoLevel = sizes.z == 2;
+			map.initTerrain();
+
+			std::uniform_int_distribution<int> terrain(0, 9);
+			for(int z = 0; z < sizes.z; z++)
+			{
+				for(int y = 0; y < sizes.y; y++)
+				{
+					for(int x = 0; x < sizes.x; x++)
+					{
+						const int roll = terrain(gen);
+						map.getTile(int3(x, y, z)).terType = roll < 2 ? ETerrainType::WATER : roll < 3 ? ETerrainType::ROCK : ETerrainType::GRASS;
+					}
+				}
+			}
+			map.calculateGuardingGreaturePositions();
+		}
+
+		int3 randomPos()
+		{
+			//every fourth object is put on border of map, where its neighbourhood is cut
+			std::uniform_int_distribution<int> x(0, sizes.x - 1), y(0, sizes.y - 1), z(0, sizes.z - 1), border(0, 7);
+			int3 pos(x(gen), y(gen), z(gen));
+			switch(border(gen))
+			{
+			case 0: pos.x = 0; break;
+			case 1: pos.x = sizes.x - 1; break;
+			case 2: pos.y = 0; break;
+			case 3: pos.y = sizes.y - 1; break;
+			}
+			return pos;
+		}
+
+		CGObjectInstance * place(bool monster, const int3 & pos)
+		{
+			std::uniform_int_distribution<int> type(0, templates.size() - 1);
+			return place(monster, pos, templates[monster ? 0 : type(gen)]);
+		}
+
+		CGObjectInstance * place(bool monster, const int3 & pos, const ObjectTemplate & appearance)
+		{
+			auto obj = make_unique<CGObjectInstance>();
+			obj->id = ObjectInstanceID(objects.size());
+			obj->ID = Obj(monster ? Obj::MONSTER : Obj::MINE);
+			obj->appearance = appearance;
+			obj->blockVisit = monster || appearance.getWidth() == 1; //as monsters and resources
+			obj->pos = pos;
+			map.addBlockVisTiles(obj.get());
+			objects.push_back(std::move(obj));
+			return objects.back().get();
+		}
+
+		void move(CGObjectInstance * obj, const int3 & pos)
+		{
+			//as ChangeObjPos does
+			map.removeBlockVisTiles(obj);
+			obj->pos = pos;
+			map.addBlockVisTiles(obj);
+		}
+
+		void checkSameAsRecalculated()
+		{
+			std::vector<int3> positions;
+			std::vector<ui16> masks;
+			for(int z = 0; z < sizes.z; z++)
+			{
+				for(int y = 0; y < sizes.y; y++)
+				{
+					for(int x = 0; x < sizes.x; x++)
+					{
+						positions.push_back(map.getGuardingCreaturePosition(int3(x, y, z)));
+						masks.push_back(map.getGuardingCreaturesMask(int3(x, y, z)));
+					}
+				}
+			}
+
+			map.calculateGuardingGreaturePositions();
+			size_t index = 0;
+			for(int z = 0; z < sizes.z; z++)
+			{
+				for(int y = 0; y < sizes.y; y++)
+				{
+					for(int x = 0; x < sizes.x; x++, index++)
+					{
+						const int3 pos(x, y, z);
+						BOOST_CHECK_MESSAGE(positions[index] == map.getGuardingCreaturePosition(pos), "guard position of " << pos);
+						BOOST_CHECK_MESSAGE(masks[index] == map.getGuardingCreaturesMask(pos), "guards mask of " << pos);
+					}
+				}
+			}
+		}
+	};
+}
+
+BOOST_FIXTURE_TEST_CASE(CGuardingCreatures_Corners, CGuardingCreaturesFixture)
+{
+	for(int z = 0; z < sizes.z; z++)
+	{
+		place(true, int3(0, 0, z));
+		place(true, int3(sizes.x - 1, sizes.y - 1, z));
+		place(false, int3(1, 0, z), templates.back()); //partially outside of map
+		place(true, int3(0, sizes.y - 1, z));
+	}
+	checkSameAsRecalculated();
+
+	//monster on other level guards nothing here
+	const int3 lower(sizes.x - 1, 0, 1);
+	place(true, lower);
+	BOOST_CHECK_EQUAL(int3(-1, -1, -1), map.getGuardingCreaturePosition(int3(sizes.x - 2, 0, 0)));
+	checkSameAsRecalculated();
+
+	for(auto & obj : objects)
+		map.removeBlockVisTiles(obj.get(), true);
+	checkSameAsRecalculated();
+	BOOST_CHECK_EQUAL(int3(-1, -1, -1), map.getGuardingCreaturePosition(int3(0, 0, 0)));
+}
+
+BOOST_FIXTURE_TEST_CASE(CGuardingCreatures_Updates, CGuardingCreaturesFixture)
+{
+	for(int i = 0; i < 300; i++)
+		place(i % 3 != 0, randomPos());
+	checkSameAsRecalculated();
+
+	//monsters are killed, join other ones and move around; other objects are taken and placed again
+	for(size_t i = 0; i < objects.size(); i++)
+	{
+		CGObjectInstance * obj = objects[i].get();
+		switch(i % 4)
+		{
+		case 0:
+			map.removeBlockVisTiles(obj, true);
+			break;
+		case 1:
+			if(map.isInTheMap(obj->pos + int3(1, -1, 0)))
+				move(obj, obj->pos + int3(1, -1, 0));
+			break;
+		case 2:
+			move(obj, randomPos());
+			break;
+		}
+	}
+	checkSameAsRecalculated();
+
+	for(int i = 0; i < 100; i++)
+		place(true, randomPos());
+	checkSameAsRecalculated();
+}
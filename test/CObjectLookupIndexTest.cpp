@@ -0,0 +1,118 @@
+/*
+ * CObjectLookupIndexTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/mapping/CObjectLookupIndex.h"
+#include "../lib/mapObjects/CObjectHandler.h"
+
+namespace
+{
+	/// Objects kept as in CMap::objects (indexed by id, removed ones are null), index is compared with scans of them
+	struct CObjectLookupIndexFixture
+	{
+		std::vector<std::unique_ptr<CGObjectInstance>> objects;
+		CObjectLookupIndex subject;
+		std::mt19937 gen;
+		std::uniform_int_distribution<int> type, owner;
+
+		CObjectLookupIndexFixture():
+			gen(4321), type(0, 5), owner(0, 3)
+		{
+			for(int i = 0; i < 300; i++)
+			{
+				auto obj = make_unique<CGObjectInstance>();
+				obj->id = ObjectInstanceID(i);
+				randomize(obj.get());
+				objects.push_back(std::move(obj));
+			}
+			//index is built in other order than ids, groups must be sorted anyway
+			for(auto it = objects.rbegin(); it != objects.rend(); ++it)
+				subject.update(it->get());
+		}
+
+		void randomize(CGObjectInstance * obj)
+		{
+			static const Obj types[] = {Obj::MINE, Obj::TOWN, Obj::HERO, Obj::MONSTER, Obj::CREATURE_GENERATOR1, Obj::RESOURCE};
+			obj->ID = types[type(gen)];
+			const int color = owner(gen);
+			obj->tempOwner = color == 3 ? PlayerColor::NEUTRAL : PlayerColor(color);
+		}
+
+		template <typename Predicate>
+		std::vector<CGObjectInstance *> scan(const Predicate & predicate) const
+		{
+			std::vector<CGObjectInstance *> ret;
+			for(auto & obj : objects)
+				if(obj && predicate(obj.get()))
+					ret.push_back(obj.get());
+			return ret;
+		}
+
+		void checkSameAsScans() const
+		{
+			for(Obj t : {Obj::MINE, Obj::TOWN, Obj::HERO, Obj::MONSTER, Obj::CREATURE_GENERATOR1, Obj::RESOURCE, Obj::BOAT})
+			{
+				auto expected = scan([t](const CGObjectInstance * obj){ return obj->ID == t; });
+				BOOST_CHECK(subject.getObjectsOfType(t) == expected);
+			}
+			for(PlayerColor color : {PlayerColor(0), PlayerColor(1), PlayerColor(2), PlayerColor::NEUTRAL, PlayerColor(7)})
+			{
+				auto expected = scan([color](const CGObjectInstance * obj){ return obj->tempOwner == color; });
+				BOOST_CHECK(subject.getObjectsOwnedBy(color) == expected);
+			}
+		}
+	};
+}
+
+BOOST_FIXTURE_TEST_CASE(CObjectLookupIndex_Build, CObjectLookupIndexFixture)
+{
+	checkSameAsScans();
+	for(auto & obj : objects)
+		BOOST_CHECK(subject.contains(obj.get()));
+}
+
+BOOST_FIXTURE_TEST_CASE(CObjectLookupIndex_Updates, CObjectLookupIndexFixture)
+{
+	std::uniform_int_distribution<int> index(0, objects.size() - 1);
+	for(int i = 0; i < 500; i++)
+	{
+		auto & obj = objects[index(gen)];
+		if(!obj)
+			continue;
+
+		if(i % 10 == 0)
+		{
+			subject.remove(obj.get());
+			BOOST_CHECK(!subject.contains(obj.get()));
+			obj.reset();
+		}
+		else
+		{
+			randomize(obj.get());
+			subject.update(obj.get());
+		}
+
+		if(i % 50 == 0)
+			checkSameAsScans();
+	}
+	checkSameAsScans();
+
+	//updating object without changes keeps it in place
+	for(auto & obj : objects)
+		if(obj)
+			subject.update(obj.get());
+	checkSameAsScans();
+
+	subject.clear();
+	BOOST_CHECK(subject.getObjectsOfType(Obj::MINE).empty());
+	BOOST_CHECK(subject.getObjectsOwnedBy(PlayerColor(0)).empty());
+}
@@ -0,0 +1,154 @@
+/*
+ * CObjectSpatialIndexTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/mapping/CObjectSpatialIndex.h"
+#include "../lib/mapObjects/CObjectHandler.h"
+#include "MapTestUtils.h"
+
+namespace
+{
+	/// Objects placed randomly on map, queries are compared with scans over all of them
+	struct CObjectSpatialIndexFixture
+	{
+		const int3 sizes;
+		std::vector<std::unique_ptr<CGObjectInstance>> objects;
+		CObjectSpatialIndex subject;
+		std::mt19937 gen;
+
+		CObjectSpatialIndexFixture():
+			sizes(90, 60, 2), gen(1234)
+		{
+			const std::vector<ObjectTemplate> templates =
+			{
+				makeTemplate("{\"mask\" : [\"A\"]}"),
+				makeTemplate("{\"mask\" : [\"VVV\", \"BBA\"]}"),
+				makeTemplate("{\"mask\" : [\"VVVV\", \"BBBB\", \"BAB0\"]}")
+			};
+
+			std::uniform_int_distribution<int> x(0, sizes.x - 1), y(0, sizes.y - 1), z(0, sizes.z - 1);
+			std::uniform_int_distribution<int> type(0, templates.size() - 1), owner(0, 3);
+			subject.resize(sizes);
+			for(int i = 0; i < 400; i++)
+			{
+				auto obj = make_unique<CGObjectInstance>();
+				obj->id = ObjectInstanceID(i);
+				obj->ID = Obj(i % 2 ? Obj::MINE : Obj::MONSTER);
+				obj->tempOwner = PlayerColor(owner(gen));
+				obj->pos = int3(x(gen), y(gen), z(gen));
+				obj->appearance = templates[type(gen)];
+				subject.add(obj.get());
+				objects.push_back(std::move(obj));
+			}
+		}
+
+		std::vector<CGObjectInstance *> indexed() const
+		{
+			std::vector<CGObjectInstance *> ret;
+			for(auto & obj : objects)
+				if(subject.contains(obj.get()))
+					ret.push_back(obj.get());
+			return ret;
+		}
+
+		static std::set<CGObjectInstance *> asSet(const std::vector<CGObjectInstance *> & objects)
+		{
+			return std::set<CGObjectInstance *>(objects.begin(), objects.end());
+		}
+
+		void checkRanges()
+		{
+			std::uniform_int_distribution<int> x(-10, sizes.x + 10), y(-10, sizes.y + 10), z(0, sizes.z - 1), radius(0, 40);
+			for(int i = 0; i < 50; i++)
+			{
+				const int3 center(x(gen), y(gen), z(gen));
+				const int r = radius(gen);
+
+				//same metric as getTilesInRange
+				std::set<CGObjectInstance *> inRange, inRect, ofMine;
+				const int3 corner = center + int3(r, r / 2, 0);
+				for(CGObjectInstance * obj : indexed())
+				{
+					const int3 pos = obj->visitablePos();
+					if(pos.z != center.z)
+						continue;
+					if(pos.dist2d(center) - 0.5 <= r)
+					{
+						inRange.insert(obj);
+						if(obj->ID == Obj::MINE)
+							ofMine.insert(obj);
+					}
+					if(pos.x >= center.x && pos.x <= corner.x && pos.y >= center.y && pos.y <= corner.y)
+						inRect.insert(obj);
+				}
+
+				BOOST_CHECK(asSet(subject.getObjectsInRange(center, r)) == inRange);
+				BOOST_CHECK(asSet(subject.getObjectsInRange(center, r, CObjectSpatialIndex::ofType(Obj::MINE))) == ofMine);
+				BOOST_CHECK(asSet(subject.getObjectsInRect(corner, center)) == inRect);
+			}
+		}
+
+		void checkNearest()
+		{
+			std::uniform_int_distribution<int> x(0, sizes.x - 1), y(0, sizes.y - 1), z(0, sizes.z - 1), count(1, 20);
+			for(int i = 0; i < 50; i++)
+			{
+				const int3 pos(x(gen), y(gen), z(gen));
+				const size_t n = count(gen);
+				const PlayerColor owner(i % 4);
+
+				std::vector<std::pair<std::pair<ui32, si32>, CGObjectInstance *>> sorted;
+				for(CGObjectInstance * obj : indexed())
+					if(obj->visitablePos().z == pos.z && obj->tempOwner == owner)
+						sorted.push_back(std::make_pair(std::make_pair(obj->visitablePos().dist2dSQ(pos), obj->id.getNum()), obj));
+				boost::sort(sorted);
+
+				auto nearest = subject.getNearestObjects(pos, n, CObjectSpatialIndex::ownedBy(owner));
+				BOOST_REQUIRE_EQUAL(std::min(n, sorted.size()), nearest.size());
+				for(size_t j = 0; j < nearest.size(); j++)
+					BOOST_CHECK_EQUAL(sorted[j].second, nearest[j]);
+			}
+		}
+	};
+}
+
+BOOST_FIXTURE_TEST_CASE(CObjectSpatialIndex_Queries, CObjectSpatialIndexFixture)
+{
+	BOOST_CHECK_EQUAL(objects.size(), subject.size());
+	checkRanges();
+	checkNearest();
+}
+
+BOOST_FIXTURE_TEST_CASE(CObjectSpatialIndex_Updates, CObjectSpatialIndexFixture)
+{
+	std::uniform_int_distribution<int> x(0, sizes.x - 1), y(0, sizes.y - 1), z(0, sizes.z - 1);
+	for(size_t i = 0; i < objects.size(); i++)
+	{
+		if(i % 3 == 0)
+		{
+			subject.remove(objects[i].get());
+		}
+		else if(i % 3 == 1) //moved object is added again, as CMap does
+		{
+			objects[i]->pos = int3(x(gen), y(gen), z(gen));
+			subject.add(objects[i].get());
+		}
+	}
+
+	BOOST_CHECK_EQUAL(objects.size() - (objects.size() + 2) / 3, subject.size());
+	checkRanges();
+	checkNearest();
+
+	subject.resize(sizes);
+	BOOST_CHECK_EQUAL(0, subject.size());
+	BOOST_CHECK(subject.getObjectsInRange(int3(10, 10, 0), 100).empty());
+}
@@ -0,0 +1,204 @@
+/*
+ * CQueriesTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../server/CQuery.h"
+#include "../server/CGameHandler.h"
+#include "../lib/BattleState.h"
+#include "../lib/mapObjects/CGHeroInstance.h"
+
+namespace
+{
+	// Callbacks of queries used here do nothing, so that queries can be added and popped without game handler
+
+	class CTestVisitQuery : public CObjectVisitQuery
+	{
+	public:
+		CTestVisitQuery(const CGObjectInstance * Obj, const CGHeroInstance * Hero):
+			CObjectVisitQuery(Obj, Hero, Obj->visitablePos())
+		{
+		}
+		void onRemoval(CGameHandler * gh, PlayerColor color) override {}
+		void onExposure(CGameHandler * gh, QueryPtr topQuery) override {}
+	};
+
+	class CTestBattleQuery : public CBattleQuery
+	{
+	public:
+		CTestBattleQuery(const BattleInfo * Bi, PlayerColor first, PlayerColor second)
+		{
+			bi = Bi;
+			addPlayer(first);
+			addPlayer(second);
+		}
+		void onRemoval(CGameHandler * gh, PlayerColor color) override {}
+		void onExposure(CGameHandler * gh, QueryPtr topQuery) override {}
+	};
+
+	class CTestDialogQuery : public CDialogQuery
+	{
+	public:
+		CTestDialogQuery(PlayerColor player)
+		{
+			addPlayer(player);
+		}
+		void onExposure(CGameHandler * gh, QueryPtr topQuery) override {}
+	};
+
+	std::unique_ptr<CGHeroInstance> makeHero(PlayerColor owner)
+	{
+		auto hero = make_unique<CGHeroInstance>();
+		hero->tempOwner = owner;
+		return hero;
+	}
+
+	std::unique_ptr<CGObjectInstance> makeObject(const int3 & pos)
+	{
+		auto obj = make_unique<CGObjectInstance>();
+		obj->pos = pos;
+		return obj;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CQueries_Empty)
+{
+	Queries queries;
+	auto obj = makeObject(int3(1, 1, 0));
+	BattleInfo battle;
+	auto dialog = std::make_shared<CTestDialogQuery>(PlayerColor(0));
+
+	BOOST_CHECK(queries.allQueries().empty());
+	for(int i = 0; i < PlayerColor::PLAYER_LIMIT_I; i++)
+		BOOST_CHECK(!queries.topQuery(PlayerColor(i)));
+	BOOST_CHECK(!queries.getVisitQuery(obj.get()));
+	BOOST_CHECK(!queries.getBattleQuery(&battle));
+	BOOST_CHECK_EQUAL(0, queries.getStacksCount(dialog));
+
+	//popping query that was never added does nothing
+	queries.popQuery(dialog);
+	queries.popIfTop(dialog);
+	BOOST_CHECK(queries.allQueries().empty());
+}
+
+BOOST_AUTO_TEST_CASE(CQueries_AddAndPopVisit)
+{
+	Queries queries;
+	auto hero = makeHero(PlayerColor(0));
+	auto obj = makeObject(int3(1, 1, 0));
+	auto other = makeObject(int3(2, 1, 0));
+	auto visit = std::make_shared<CTestVisitQuery>(obj.get(), hero.get());
+
+	queries.addQuery(visit);
+	BOOST_CHECK(queries.topQuery(PlayerColor(0)) == visit);
+	BOOST_CHECK(!queries.topQuery(PlayerColor(1)));
+	BOOST_CHECK_EQUAL(1, queries.allQueries().size());
+	BOOST_CHECK_EQUAL(1, queries.getStacksCount(visit));
+	BOOST_CHECK(queries.getVisitQuery(obj.get()) == visit);
+	BOOST_CHECK(!queries.getVisitQuery(other.get()));
+
+	queries.popQuery(visit);
+	BOOST_CHECK(!queries.topQuery(PlayerColor(0)));
+	BOOST_CHECK(queries.allQueries().empty());
+	BOOST_CHECK_EQUAL(0, queries.getStacksCount(visit));
+	BOOST_CHECK(!queries.getVisitQuery(obj.get()));
+}
+
+BOOST_AUTO_TEST_CASE(CQueries_PopBelowTop)
+{
+	Queries queries;
+	auto hero = makeHero(PlayerColor(0));
+	auto obj = makeObject(int3(1, 1, 0));
+	auto visit = std::make_shared<CTestVisitQuery>(obj.get(), hero.get());
+	auto dialog = std::make_shared<CTestDialogQuery>(PlayerColor(0));
+	queries.addQuery(visit);
+	queries.addQuery(dialog);
+
+	//query below top is left on stack and in indices, whichever way it is popped
+	queries.popQuery(visit);
+	queries.popQuery(*visit);
+	queries.popIfTop(visit);
+	queries.popIfTop(*visit);
+	BOOST_CHECK(queries.topQuery(PlayerColor(0)) == dialog);
+	BOOST_CHECK_EQUAL(2, queries.allQueries().size());
+	BOOST_CHECK_EQUAL(1, queries.getStacksCount(visit));
+	BOOST_CHECK(queries.getVisitQuery(obj.get()) == visit);
+
+	queries.popQuery(*dialog);
+	BOOST_CHECK(queries.topQuery(PlayerColor(0)) == visit);
+	BOOST_CHECK_EQUAL(0, queries.getStacksCount(dialog));
+
+	queries.popIfTop(visit);
+	BOOST_CHECK(queries.allQueries().empty());
+	BOOST_CHECK(!queries.getVisitQuery(obj.get()));
+}
+
+BOOST_AUTO_TEST_CASE(CQueries_BattleOfTwoPlayers)
+{
+	Queries queries;
+	BattleInfo battle, otherBattle;
+	auto query = std::make_shared<CTestBattleQuery>(&battle, PlayerColor(0), PlayerColor(1));
+	auto dialog = std::make_shared<CTestDialogQuery>(PlayerColor(0));
+	queries.addQuery(query);
+	BOOST_CHECK(queries.topQuery(PlayerColor(0)) == query);
+	BOOST_CHECK(queries.topQuery(PlayerColor(1)) == query);
+	BOOST_CHECK_EQUAL(2, queries.allQueries().size());
+	BOOST_CHECK_EQUAL(2, queries.getStacksCount(query));
+	BOOST_CHECK(queries.getBattleQuery(&battle) == query);
+	BOOST_CHECK(!queries.getBattleQuery(&otherBattle));
+
+	//battle is popped only from stack of second player, where it is on top; it stays indexed
+	queries.addQuery(dialog);
+	queries.popQuery(query);
+	BOOST_CHECK(queries.topQuery(PlayerColor(0)) == dialog);
+	BOOST_CHECK(!queries.topQuery(PlayerColor(1)));
+	BOOST_CHECK_EQUAL(1, queries.getStacksCount(query));
+	BOOST_CHECK(queries.getBattleQuery(&battle) == query);
+
+	//popped from last stack, it leaves index
+	queries.popIfTop(dialog);
+	queries.popIfTop(*query);
+	BOOST_CHECK(queries.allQueries().empty());
+	BOOST_CHECK_EQUAL(0, queries.getStacksCount(query));
+	BOOST_CHECK(!queries.getBattleQuery(&battle));
+}
+
+BOOST_AUTO_TEST_CASE(CQueries_ObjectVisitedTwice)
+{
+	Queries queries;
+	auto red = makeHero(PlayerColor(0));
+	auto blue = makeHero(PlayerColor(1));
+	auto obj = makeObject(int3(1, 1, 0));
+	auto first = std::make_shared<CTestVisitQuery>(obj.get(), red.get());
+	auto second = std::make_shared<CTestVisitQuery>(obj.get(), blue.get());
+	queries.addQuery(first);
+	queries.addQuery(second);
+
+	auto found = queries.getVisitQuery(obj.get());
+	BOOST_CHECK(found == first || found == second);
+
+	//object is still being visited until both visits end
+	queries.popQuery(first);
+	BOOST_CHECK(queries.getVisitQuery(obj.get()) == second);
+	queries.popQuery(second);
+	BOOST_CHECK(!queries.getVisitQuery(obj.get()));
+}
+
+// server/CQuery.cpp is linked without the rest of server, queries of this test never call game handler
+bool CGameHandler::isValidObject(const CGObjectInstance * obj) const
+{
+	return false;
+}
+void CGameHandler::visitObjectOnTile(const TerrainTile & t, const CGHeroInstance * h) {}
+void CGameHandler::levelUpHero(const CGHeroInstance * hero, SecondarySkill skill) {}
+void CGameHandler::levelUpCommander(const CCommanderInstance * c, int skill) {}
+void CGameHandler::objectVisitEnded(const CObjectVisitQuery & query) {}
+void CGameHandler::battleAfterLevelUp(const BattleResult & result) {}
@@ -0,0 +1,305 @@
+/*
+ * CVictoryConditionWatcherTest.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include <boost/test/unit_test.hpp>
+
+#include "../lib/CVictoryConditionWatcher.h"
+#include "../lib/CArtHandler.h"
+#include "../lib/CTownHandler.h"
+#include "../lib/CGameState.h"
+#include "../lib/CPlayerState.h"
+#include "../lib/IGameCallback.h"
+#include "../lib/NetPacks.h"
+#include "../lib/Connection.h"
+#include "../lib/StartInfo.h"
+#include "../lib/VCMI_Lib.h"
+#include "../lib/mapping/CMap.h"
+#include "../lib/mapObjects/MapObjects.h"
+#include "../lib/rmg/CMapGenOptions.h"
+
+namespace
+{
+	/// Game state reached through IObjectInterface::cb, everything else does nothing as in CClient
+	class CTestGameCallback : public IGameCallback
+	{
+	public:
+		CTestGameCallback(CGameState * GS)
+		{
+			gs = GS;
+		}
+
+		void commitPackage(CPackForClient *pack) override {}
+
+		void changeSpells(const CGHeroInstance * hero, bool give, const std::set<SpellID> &spells) override {}
+		bool removeObject(const CGObjectInstance * obj) override {return false;}
+		void setBlockVis(ObjectInstanceID objid, bool bv) override {}
+		void setOwner(const CGObjectInstance * obj, PlayerColor owner) override {}
+		void changePrimSkill(const CGHeroInstance * hero, PrimarySkill::PrimarySkill which, si64 val, bool abs=false) override {}
+		void changeSecSkill(const CGHeroInstance * hero, SecondarySkill which, int val, bool abs=false) override {}
+
+		void showBlockingDialog(BlockingDialog *iw) override {}
+		void showGarrisonDialog(ObjectInstanceID upobj, ObjectInstanceID hid, bool removableUnits) override {}
+		void showTeleportDialog(TeleportDialog *iw) override {}
+		void showThievesGuildWindow(PlayerColor player, ObjectInstanceID requestingObjId) override {}
+		void giveResource(PlayerColor player, Res::ERes which, int val) override {}
+		void giveResources(PlayerColor player, TResources resources) override {}
+
+		void giveCreatures(const CArmedInstance * objid, const CGHeroInstance * h, const CCreatureSet &creatures, bool remove) override {}
+		void takeCreatures(ObjectInstanceID objid, const std::vector<CStackBasicDescriptor> &creatures) override {}
+		bool changeStackType(const StackLocation &sl, const CCreature *c) override {return false;}
+		bool changeStackCount(const StackLocation &sl, TQuantity count, bool absoluteValue = false) override {return false;}
+		bool insertNewStack(const StackLocation &sl, const CCreature *c, TQuantity count) override {return false;}
+		bool eraseStack(const StackLocation &sl, bool forceRemoval = false) override {return false;}
+		bool swapStacks(const StackLocation &sl1, const StackLocation &sl2) override {return false;}
+		bool addToSlot(const StackLocation &sl, const CCreature *c, TQuantity count) override {return false;}
+		void tryJoiningArmy(const CArmedInstance *src, const CArmedInstance *dst, bool removeObjWhenFinished, bool allowMerging) override {}
+		bool moveStack(const StackLocation &src, const StackLocation &dst, TQuantity count = -1) override {return false;}
+
+		void removeAfterVisit(const CGObjectInstance *object) override {}
+
+		void giveHeroNewArtifact(const CGHeroInstance *h, const CArtifact *artType, ArtifactPosition pos) override {}
+		void giveHeroArtifact(const CGHeroInstance *h, const CArtifactInstance *a, ArtifactPosition pos) override {}
+		void putArtifact(const ArtifactLocation &al, const CArtifactInstance *a) override {}
+		void removeArtifact(const ArtifactLocation &al) override {}
+		bool moveArtifact(const ArtifactLocation &al1, const ArtifactLocation &al2) override {return false;}
+		void synchronizeArtifactHandlerLists() override {}
+
+		void showCompInfo(ShowInInfobox * comp) override {}
+		void heroVisitCastle(const CGTownInstance * obj, const CGHeroInstance * hero) override {}
+		void stopHeroVisitCastle(const CGTownInstance * obj, const CGHeroInstance * hero) override {}
+		void startBattlePrimary(const CArmedInstance *army1, const CArmedInstance *army2, int3 tile, const CGHeroInstance *hero1, const CGHeroInstance *hero2, bool creatureBank = false, const CGTownInstance *town = nullptr) override {}
+		void startBattleI(const CArmedInstance *army1, const CArmedInstance *army2, int3 tile, bool creatureBank = false) override {}
+		void startBattleI(const CArmedInstance *army1, const CArmedInstance *army2, bool creatureBank = false) override {}
+		void setAmount(ObjectInstanceID objid, ui32 val) override {}
+		bool moveHero(ObjectInstanceID hid, int3 dst, ui8 teleporting, bool transit = false, PlayerColor asker = PlayerColor::NEUTRAL) override {return false;}
+		void giveHeroBonus(GiveBonus * bonus) override {}
+		void setMovePoints(SetMovePoints * smp) override {}
+		void setManaPoints(ObjectInstanceID hid, int val) override {}
+		void giveHero(ObjectInstanceID id, PlayerColor player) override {}
+		void changeObjPos(ObjectInstanceID objid, int3 newPos, ui8 flags) override {}
+		void sendAndApply(CPackForClient * info) override {}
+		void heroExchange(ObjectInstanceID hero1, ObjectInstanceID hero2) override {}
+
+		void changeFogOfWar(int3 center, ui32 radius, PlayerColor player, bool hide) override {}
+		void changeFogOfWar(std::unordered_set<int3, ShashInt3> &tiles, PlayerColor player, bool hide) override {}
+	};
+
+	/// Random map for two players; packs are applied to game state as on server, cached checks are compared with fresh evaluation
+	struct CVictoryConditionWatcherFixture
+	{
+		std::unique_ptr<CGameState> gs;
+		std::unique_ptr<CTestGameCallback> cb;
+		PlayerColor first, second;
+		CGHeroInstance * hero;
+		CGTownInstance * ownTown;
+		CGTownInstance * enemyTown;
+
+		CVictoryConditionWatcherFixture()
+		{
+			StartInfo si;
+			si.mode = StartInfo::NEW_GAME;
+			si.seedToBeUsed = 1337;
+			si.mapGenOptions = std::make_shared<CMapGenOptions>();
+			si.mapGenOptions->setWidth(CMapHeader::MAP_SIZE_SMALL);
+			si.mapGenOptions->setHeight(CMapHeader::MAP_SIZE_SMALL);
+			si.mapGenOptions->setHasTwoLevels(false);
+			si.mapGenOptions->setPlayerCount(2);
+			si.mapGenOptions->setPlayerTypeForStandardPlayer(PlayerColor(0), EPlayerType::AI);
+			si.mapGenOptions->setPlayerTypeForStandardPlayer(PlayerColor(1), EPlayerType::AI);
+
+			gs = make_unique<CGameState>();
+			cb = make_unique<CTestGameCallback>(gs.get());
+			IObjectInterface::cb = cb.get();
+			gs->init(&si);
+
+			std::vector<PlayerColor> players;
+			for(auto & elem : gs->players)
+				if(elem.first != PlayerColor::NEUTRAL)
+					players.push_back(elem.first);
+			BOOST_REQUIRE_EQUAL(2, players.size());
+			first = players[0];
+			second = players[1];
+
+			BOOST_REQUIRE(!gs->getPlayer(first)->heroes.empty());
+			BOOST_REQUIRE(!gs->getPlayer(first)->towns.empty());
+			BOOST_REQUIRE(!gs->getPlayer(second)->towns.empty());
+			hero = gs->getPlayer(first)->heroes.front();
+			ownTown = gs->getPlayer(first)->towns.front();
+			enemyTown = gs->getPlayer(second)->towns.front();
+		}
+
+		~CVictoryConditionWatcherFixture()
+		{
+			IObjectInterface::cb = nullptr;
+		}
+
+		void addVictory(const std::string & identifier, const EventCondition & condition)
+		{
+			TriggeredEvent event;
+			event.identifier = identifier;
+			event.trigger = EventExpression(condition);
+			event.effect.type = EventEffect::VICTORY;
+			gs->map->triggeredEvents.push_back(event);
+		}
+
+		void apply(CPack & pack)
+		{
+			gs->apply(&pack);
+			checkSameAsUncached();
+		}
+
+		/// Results cached for all players before last pack must be same as evaluated from scratch
+		void checkSameAsUncached()
+		{
+			std::map<PlayerColor, EVictoryLossCheckResult> cached;
+			for(auto & elem : gs->players)
+				if(elem.first != PlayerColor::NEUTRAL)
+					cached[elem.first] = gs->checkForVictoryAndLoss(elem.first);
+
+			gs->victoryLossStateChanged();
+			for(auto & elem : cached)
+				BOOST_CHECK(elem.second == gs->checkForVictoryAndLoss(elem.first)); //caches results for next pack
+		}
+
+		bool won(PlayerColor player) const
+		{
+			return gs->checkForVictoryAndLoss(player).victory();
+		}
+	};
+}
+
+BOOST_AUTO_TEST_CASE(CVictoryConditionWatcher_Classification)
+{
+	BOOST_CHECK_EQUAL(CVictoryConditionWatcher::NOTHING, CVictoryConditionWatcher::getModifiedState(typeList.getTypeID<TryMoveHero>()));
+	BOOST_CHECK_EQUAL(CVictoryConditionWatcher::TOWN_HEROES, CVictoryConditionWatcher::getModifiedState(typeList.getTypeID<HeroVisitCastle>()));
+	BOOST_CHECK_EQUAL(CVictoryConditionWatcher::RESOURCES, CVictoryConditionWatcher::getModifiedState(typeList.getTypeID<SetResources>()));
+	BOOST_CHECK_EQUAL(CVictoryConditionWatcher::BUILDINGS, CVictoryConditionWatcher::getModifiedState(typeList.getTypeID<NewStructures>()));
+	//packs not listed may modify anything
+	BOOST_CHECK_EQUAL(CVictoryConditionWatcher::EVERYTHING, CVictoryConditionWatcher::getModifiedState(typeList.getTypeID<SetObjectProperty>()));
+	BOOST_CHECK_EQUAL(CVictoryConditionWatcher::EVERYTHING, CVictoryConditionWatcher::getModifiedState(typeList.getTypeID<NewTurn>()));
+
+	CVictoryConditionWatcher watcher;
+	std::vector<TriggeredEvent> events(1);
+	events[0].trigger = EventExpression(EventCondition(EventCondition::HAVE_RESOURCES, 1000, Res::GOLD));
+	EVictoryLossCheckResult result;
+	BOOST_CHECK(!watcher.getResult(PlayerColor(0), events, result));
+
+	watcher.setResult(PlayerColor(0), EVictoryLossCheckResult::victory("", ""));
+	watcher.packApplied(typeList.getTypeID<TryMoveHero>());
+	watcher.packApplied(typeList.getTypeID<NewStructures>()); //not read by the only condition
+	BOOST_REQUIRE(watcher.getResult(PlayerColor(0), events, result));
+	BOOST_CHECK(result.victory());
+
+	watcher.packApplied(typeList.getTypeID<SetResources>());
+	BOOST_CHECK(!watcher.getResult(PlayerColor(0), events, result));
+
+	watcher.setResult(PlayerColor(0), EVictoryLossCheckResult());
+	watcher.packApplied(typeList.getTypeID<NewTurn>());
+	BOOST_CHECK(!watcher.getResult(PlayerColor(0), events, result));
+}
+
+BOOST_FIXTURE_TEST_CASE(CVictoryConditionWatcher_Packs, CVictoryConditionWatcherFixture)
+{
+	const CArtifactInstance * carried = hero->getArt(ArtifactPosition::MACH4);
+	BOOST_REQUIRE(carried);
+	BuildingID missing = BuildingID::NONE;
+	for(auto & building : ownTown->town->buildings)
+		if(building.second && !ownTown->hasBuilt(building.first) && building.first >= BuildingID::MAGES_GUILD_1)
+			missing = building.first;
+	BOOST_REQUIRE(missing != BuildingID::NONE);
+	const int gold = gs->getPlayer(first)->resources[Res::GOLD];
+
+	gs->map->triggeredEvents.clear();
+	EventCondition transport(EventCondition::TRANSPORT, 0, carried->artType->id);
+	transport.object = ownTown;
+	addVictory("transport", transport);
+	EventCondition building(EventCondition::HAVE_BUILDING, 0, missing);
+	building.object = ownTown;
+	addVictory("building", building);
+	addVictory("resources", EventCondition(EventCondition::HAVE_RESOURCES, gold + 1000, Res::GOLD));
+	EventCondition control(EventCondition::CONTROL, 0, Obj::TOWN);
+	control.object = enemyTown;
+	addVictory("control", control);
+	addVictory("days", EventCondition(EventCondition::DAYS_PASSED, gs->day, 0));
+	gs->victoryLossStateChanged();
+
+	if(ownTown->visitingHero)
+	{
+		HeroVisitCastle leave;
+		leave.tid = ownTown->id;
+		leave.hid = ownTown->visitingHero->id;
+		gs->apply(&leave);
+	}
+	checkSameAsUncached();
+	BOOST_REQUIRE(!won(first));
+	BOOST_CHECK(won(second));
+
+	TryMoveHero tmh;
+	tmh.id = hero->id;
+	tmh.movePoints = hero->movement / 2;
+	tmh.result = TryMoveHero::FAILED;
+	tmh.start = tmh.end = hero->pos;
+	apply(tmh);
+	BOOST_CHECK(!won(first));
+
+	HeroVisitCastle hvc;
+	hvc.flags = 1;
+	hvc.tid = ownTown->id;
+	hvc.hid = hero->id;
+	apply(hvc);
+	BOOST_CHECK(won(first));
+	hvc.flags = 0;
+	apply(hvc);
+	BOOST_CHECK(!won(first));
+
+	NewStructures ns;
+	ns.tid = ownTown->id;
+	ns.bid.insert(missing);
+	ns.builded = 1;
+	apply(ns);
+	BOOST_CHECK(won(first));
+	RazeStructures rs;
+	rs.tid = ownTown->id;
+	rs.bid.insert(missing);
+	rs.destroyed = 1;
+	apply(rs);
+	BOOST_CHECK(!won(first));
+
+	SetResources sr;
+	sr.player = first;
+	sr.res = gs->getPlayer(first)->resources;
+	sr.res[Res::GOLD] = gold + 1000;
+	apply(sr);
+	BOOST_CHECK(won(first));
+	sr.res[Res::GOLD] = gold;
+	apply(sr);
+	BOOST_CHECK(!won(first));
+
+	SetObjectProperty sop(enemyTown->id, ObjProperty::OWNER, first.getNum());
+	apply(sop);
+	BOOST_CHECK(won(first));
+	BOOST_CHECK(!won(second));
+	sop.val = second.getNum();
+	apply(sop);
+	BOOST_CHECK(!won(first));
+	BOOST_CHECK(won(second));
+
+	SetObjectProperty unrelated(ownTown->id, ObjProperty::BONUS_VALUE_FIRST, 1);
+	apply(unrelated);
+	BOOST_CHECK(!won(first));
+
+	NewTurn nt;
+	nt.day = gs->day + 2; //not first day of week, no rumor update
+	nt.specialWeek = NewTurn::NO_ACTION;
+	nt.creatureid = CreatureID::NONE;
+	apply(nt);
+	BOOST_CHECK(won(first));
+}
@@ -0,0 +1,21 @@
+/*
+ * MapTestUtils.cpp, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#include "StdInc.h"
+#include "MapTestUtils.h"
+
+#include "../lib/JsonNode.h"
+
+ObjectTemplate makeTemplate(const std::string & json)
+{
+	ObjectTemplate ret;
+	ret.readJson(JsonNode(json.c_str(), json.size()), false);
+	return ret;
+}
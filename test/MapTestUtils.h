@@ -0,0 +1,16 @@
+/*
+ * MapTestUtils.h, part of VCMI engine
+ *
+ * Authors: listed in file AUTHORS in main folder
+ *
+ * License: GNU General Public License v2.0 or later
+ * Full text of license available in license.txt file, in main folder
+ *
+ */
+
+#pragma once
+
+#include "../lib/mapObjects/ObjectTemplate.h"
+
+/// Reads object template from json as in object configs, e.g. {"mask" : ["VVV", "BBA"]}
+ObjectTemplate makeTemplate(const std::string & json);